@@ -0,0 +1,104 @@
+/**
+ * @file arena.c
+ * @author Willow Rimlinger
+ *
+ * Allocates the Line headers of a FileProxy out of large blocks so that they
+ * are packed together in memory and can all be freed with a few calls to free.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "types.h"
+#include "arena.h"
+
+// blocks start small so that short files and the command line stay small and
+// double up to a limit so that huge files only need a few hundred blocks
+static const size_t MIN_BLOCK_LINES = 64;
+static const size_t MAX_BLOCK_LINES = 65536;
+
+/** A block of Line headers. Headers are carved from the front of the block. */
+typedef struct LineBlock_s {
+    struct LineBlock_s *next;
+    size_t used;
+    size_t cap;
+    Line lines[];
+} LineBlock;
+
+struct LineArena_s {
+    // the newest block is first
+    LineBlock *blocks;
+    // headers that have been freed. the text of a freed header points to the next one.
+    Line *free_lines;
+};
+
+LineArena *create_arena(void) {
+    LineArena *arena = malloc(sizeof(LineArena));
+    if (arena == NULL) {
+        fprintf(stderr, "Error allocating space for lines.\n");
+        exit(EXIT_FAILURE);
+    }
+    arena->blocks = NULL;
+    arena->free_lines = NULL;
+    return arena;
+}
+
+Line *alloc_line(LineArena *arena) {
+    if (arena->free_lines != NULL) {
+        Line *line = arena->free_lines;
+        arena->free_lines = (Line *) line->text;
+        return line;
+    }
+
+    LineBlock *block = arena->blocks;
+    if (block == NULL || block->used == block->cap) {
+        size_t cap = block == NULL ? MIN_BLOCK_LINES : block->cap * 2;
+        if (cap > MAX_BLOCK_LINES) {
+            cap = MAX_BLOCK_LINES;
+        }
+        LineBlock *new_block = malloc(sizeof(LineBlock) + cap * sizeof(Line));
+        if (new_block == NULL) {
+            fprintf(stderr, "Error allocating space for lines.\n");
+            exit(EXIT_FAILURE);
+        }
+        new_block->next = block;
+        new_block->used = 0;
+        new_block->cap = cap;
+        arena->blocks = new_block;
+        block = new_block;
+    }
+    return &block->lines[block->used++];
+}
+
+/** Whether the text of a line is in a buffer that was allocated for it */
+static bool owns_text_buffer(Line *line) {
+    // views have no capacity and inline text lives in the header
+    return line->cap > 0 && line->text != line->inline_text;
+}
+
+void free_line(LineArena *arena, Line *line) {
+    if (owns_text_buffer(line)) {
+        free(line->text);
+    }
+    // mark the header as not owning any text so free_arena skips it
+    line->cap = 0;
+    line->text = (char *) arena->free_lines;
+    arena->free_lines = line;
+}
+
+void free_arena(LineArena *arena) {
+    LineBlock *block = arena->blocks;
+    while (block != NULL) {
+        for (size_t i = 0; i < block->used; i++) {
+            if (owns_text_buffer(&block->lines[i])) {
+                free(block->lines[i].text);
+            }
+        }
+        LineBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
@@ -0,0 +1,49 @@
+/**
+ * @file arena.h
+ * @author Willow Rimlinger
+ *
+ * Header for arena.c
+ *
+ * Allocates the Line headers of a FileProxy out of large blocks so that they
+ * are packed together in memory and can all be freed with a few calls to free.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "types.h"
+
+/**
+ * Creates an empty LineArena. No blocks are allocated until the first Line is.
+ *
+ * @return the new arena
+ */
+LineArena *create_arena(void);
+
+/**
+ * Allocates a Line header from an arena. Reuses headers that have been freed
+ * before carving a new one out of a block.
+ *
+ * @param arena the arena to allocate from
+ * @return an uninitialized Line
+ */
+Line *alloc_line(LineArena *arena);
+
+/**
+ * Gives a Line header back to its arena to be reused. The text of the line is
+ * freed if the line owns it.
+ *
+ * @param arena the arena the line was allocated from
+ * @param line the line to free
+ */
+void free_line(LineArena *arena, Line *line);
+
+/**
+ * Frees every block of an arena along with the text owned by each Line in them.
+ *
+ * @param arena the arena to free
+ */
+void free_arena(LineArena *arena);
+
+#endif
+
@@ -0,0 +1,411 @@
+/**
+ * @file bench.c
+ * @author Willow Rimlinger
+ *
+ * Microbenchmarks for the editing core. Runs the core modules on synthetic
+ * files without a terminal and prints one JSON object per result so that runs
+ * can be compared with each other.
+ *
+ * usage: wim_bench [max size in MB]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "../types.h"
+#include "../fileproxy.h"
+#include "../insert.h"
+#include "../motions.h"
+#include "../text_objects.h"
+#include "../display.h"
+#include "../render.h"
+#include "../search.h"
+#include "../match_index.h"
+
+static const size_t MB = 1024 * 1024;
+static const size_t DEFAULT_MAX_MB = 1024;
+// each size is this many times bigger than the last
+static const size_t SIZE_STEP = 4;
+// split small buffers several times so they take long enough to time
+static const size_t SPLIT_BYTES_PER_SIZE = 64 * 1024 * 1024;
+static const size_t INSERT_CHAR_OPS = 100000;
+// the number of chars typed in a row before moving somewhere else
+static const size_t INSERT_CHAR_RUN = 100;
+static const size_t INSERT_NEWLINE_OPS = 10000;
+static const size_t WORD_OPS = 1000000;
+// how many words a counted word motion goes over, like 5000w
+static const size_t COUNTED_WORDS = 5000;
+// how many line numbers are jumped to, like 40G
+static const size_t LINE_JUMP_OPS = 1000000;
+static const size_t DISPLAY_OPS = 10000;
+static const size_t SCREEN_LINES = 50;
+static const size_t SCREEN_COLS = 200;
+// generated files never have a _ in them, so this is searched for through the whole file
+static const char *RARE_TOKEN = "wim_rare_token";
+// the same for a regular expression, which is run over every byte
+static const char *RARE_REGEX = "wim_\\w+_(token|mark)";
+// in a generated file about once every few hundred bytes, so there are plenty of matches to count
+static const char *COMMON_TOKEN = "qz";
+// how long to wait between checks for the matches being counted
+static const useconds_t COUNT_POLL_US = 100;
+
+/** The kinds of files to benchmark */
+typedef enum Content_e {
+    LONG_LINES,
+    SHORT_LINES,
+    MIXED,
+} Content;
+
+static const char *CONTENT_NAMES[] = {"long", "short", "mixed"};
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15;
+
+/** xorshift so that every run benchmarks the same files */
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static size_t rng_range(size_t lo, size_t hi) {
+    return lo + rng() % (hi - lo + 1);
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/**
+ * Fills a line with words and punctuation.
+ *
+ * @param buf where to write the line
+ * @param len how many chars to write, not including the \n
+ */
+static void fill_line(char *buf, size_t len) {
+    static const char PUNCT[] = ".,;:()[]{}=+-*/\"'";
+    size_t i = 0;
+    while (i < len) {
+        size_t word_len = rng_range(1, 10);
+        for (size_t j = 0; j < word_len && i < len; j++) {
+            buf[i++] = 'a' + rng() % 26;
+        }
+        if (i < len && rng() % 4 == 0) {
+            buf[i++] = PUNCT[rng() % (sizeof(PUNCT) - 1)];
+        }
+        if (i < len) {
+            buf[i++] = ' ';
+        }
+    }
+}
+
+/**
+ * Generates a synthetic file.
+ *
+ * @param content the kind of lines to fill the file with
+ * @param len the size of the file in bytes
+ * @return the contents of the file, which end in a \n
+ */
+static char *generate(Content content, size_t len) {
+    char *buf = malloc(len);
+    if (buf == NULL) {
+        fprintf(stderr, "Error allocating space for benchmark file.\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t i = 0;
+    while (i < len) {
+        size_t line_len;
+        size_t indent = 0;
+        if (content == LONG_LINES) {
+            line_len = rng_range(2000, 20000);
+        } else if (content == SHORT_LINES) {
+            line_len = rng_range(0, 30);
+        } else {
+            // mostly code-like lines with some blank and some very long ones
+            size_t kind = rng() % 16;
+            line_len = kind == 0 ? 0 : kind == 1 ? rng_range(500, 5000) : rng_range(10, 100);
+            indent = line_len > 0 ? 4 * (rng() % 4) : 0;
+        }
+        // leave room for the \n
+        if (i + line_len + indent + 1 > len) {
+            line_len = len - i - 1;
+            indent = 0;
+        }
+        memset(buf + i, ' ', indent);
+        fill_line(buf + i + indent, line_len);
+        i += indent + line_len;
+        buf[i++] = '\n';
+    }
+    return buf;
+}
+
+/**
+ * Prints the result of a benchmark as one line of JSON.
+ *
+ * @param bench the name of the benchmark
+ * @param content the kind of file it was run on
+ * @param size the size of the file in bytes
+ * @param ops the number of operations that were timed
+ * @param ns the total time the operations took
+ * @param bytes the number of bytes that were processed, 0 if throughput doesn't apply
+ */
+static void report(const char *bench, Content content, size_t size, size_t ops, double ns, size_t bytes) {
+    double mb_per_s = bytes > 0 && ns > 0 ? (bytes / (double) MB) / (ns / 1e9) : 0;
+    printf("{\"bench\": \"%s\", \"content\": \"%s\", \"size_mb\": %zu, \"ops\": %zu, "
+            "\"ns_per_op\": %.1f, \"mb_per_s\": %.1f, \"peak_rss_kb\": %ld}\n",
+            bench, CONTENT_NAMES[content], size / MB, ops, ops > 0 ? ns / ops : 0, mb_per_s, peak_rss_kb());
+    fflush(stdout);
+}
+
+/**
+ * Puts the cursor somewhere random in a FileProxy.
+ */
+static void jump(FileProxy fp, View *view) {
+    view->cur.line = rng() % get_num_lines(fp);
+    size_t len = get_line(fp, view->cur.line)->len;
+    view->cur.ch = rng() % (len + 1);
+    view->cur_desired_col = view->cur.ch;
+    view->top_line = view->cur.line;
+    view->left_col = 0;
+}
+
+static void bench_split_buffer(Content content, const char *buf, size_t size) {
+    size_t reps = size < SPLIT_BYTES_PER_SIZE ? SPLIT_BYTES_PER_SIZE / size : 1;
+    double start = now_ns();
+    for (size_t i = 0; i < reps; i++) {
+        free_fp(split_buffer(buf, size));
+    }
+    report("split_buffer", content, size, reps, now_ns() - start, size * reps);
+}
+
+static void bench_read_fp(Content content, const char *filename, size_t size) {
+    FileProxy fp;
+    double start = now_ns();
+    if (!read_fp(&fp, filename)) {
+        fprintf(stderr, "Error reading %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    wait_for_line(fp, SIZE_MAX);
+    report("read_fp", content, size, 1, now_ns() - start, size);
+    free_fp(fp);
+}
+
+static void bench_write_fp(const char *bench, Content content, FileProxy fp, const char *filename, size_t size) {
+    SaveStats stats;
+    double start = now_ns();
+    if (!write_fp(fp, filename, false, &stats)) {
+        perror("Error writing benchmark file");
+        exit(EXIT_FAILURE);
+    }
+    report(bench, content, size, 1, now_ns() - start, stats.bytes);
+}
+
+/**
+ * Times moving forward through a file by a number of words at a time.
+ *
+ * @param count how many words each move goes over
+ */
+static void bench_get_beg_pos_n_word(const char *bench, Content content, FileProxy fp, size_t size, size_t count) {
+    CurPos pos = {0, 0};
+    size_t ops = 0;
+    double start = now_ns();
+    for (; ops < WORD_OPS; ops++) {
+        CurPos next = get_beg_pos_n_tobj(fp, pos, WORD, count);
+        if (next.line == pos.line && next.ch == pos.ch) {
+            // end of the file
+            break;
+        }
+        pos = next;
+    }
+    report(bench, content, size, ops, now_ns() - start, 0);
+}
+
+/**
+ * Times jumping to random line numbers, which moves the cursor and scrolls
+ * the view to it.
+ *
+ * @param wrap_width the width lines are wrapped at, 0 for no wrapping
+ */
+static void bench_move_to_line_num(const char *bench, Content content, FileProxy fp, MimState ms, size_t size,
+                                   size_t wrap_width) {
+    set_wrap_width(fp, wrap_width);
+    View view = {0, 0, SCREEN_LINES, SCREEN_COLS, {0, 0}, 0, 0};
+    size_t num_lines = get_num_lines(fp);
+    double start = now_ns();
+    for (size_t i = 0; i < LINE_JUMP_OPS; i++) {
+        move_to_line_num(fp, &view, ms, 1 + rng() % num_lines);
+    }
+    report(bench, content, size, LINE_JUMP_OPS, now_ns() - start, 0);
+    set_wrap_width(fp, 0);
+}
+
+/**
+ * Times searching for a pattern that isn't in the file, so every line is
+ * scanned once before going around to the start.
+ */
+static void bench_search(const char *bench, Content content, FileProxy fp, size_t size, const char *pat_text) {
+    const char *err;
+    Pattern *pat = compile_pattern(pat_text, strlen(pat_text), &err);
+    CurPos from = {0, 0};
+    CurPos match;
+    bool wrapped;
+    double start = now_ns();
+    search_fp(fp, pat, from, false, &match, &wrapped);
+    report(bench, content, size, 1, now_ns() - start, size);
+    free_pattern(pat);
+}
+
+/**
+ * Times counting the matches of a pattern in every line in the background,
+ * until the counts are ready. The pattern is left set so later benchmarks
+ * keep the counts up to date.
+ */
+static void bench_count_matches(Content content, FileProxy fp, size_t size, const Pattern *pat) {
+    double start = now_ns();
+    set_match_pattern(fp, pat);
+    while (update_match_index(fp)) {
+        usleep(COUNT_POLL_US);
+    }
+    report("count_matches", content, size, 1, now_ns() - start, size);
+}
+
+static void bench_insert_char(const char *bench, Content content, FileProxy *fp, View *view, MimState ms,
+        size_t size) {
+    double start = now_ns();
+    for (size_t i = 0; i < INSERT_CHAR_OPS; i++) {
+        if (i % INSERT_CHAR_RUN == 0) {
+            jump(*fp, view);
+        }
+        insert_char('a' + i % 26, fp, view, ms);
+    }
+    report(bench, content, size, INSERT_CHAR_OPS, now_ns() - start, 0);
+}
+
+static void bench_insert_newline(Content content, FileProxy *fp, View *view, MimState ms, size_t size) {
+    double start = now_ns();
+    for (size_t i = 0; i < INSERT_NEWLINE_OPS; i++) {
+        jump(*fp, view);
+        insert_newline(fp, view, ms);
+    }
+    report("insert_newline", content, size, INSERT_NEWLINE_OPS, now_ns() - start, 0);
+}
+
+/**
+ * Times drawing whole frames while scrolling down through a file a line at a
+ * time, so every row is drawn again each frame.
+ */
+static void bench_display(const char *bench, Content content, Renderer renderer, FileProxy fp, MimState ms,
+        size_t size) {
+    set_renderer(renderer);
+    View view = {0, 0, SCREEN_LINES - 1, SCREEN_COLS, {0, 0}, 0, 0};
+    size_t num_lines = get_num_lines(fp);
+    double start = now_ns();
+    for (size_t i = 0; i < DISPLAY_OPS; i++) {
+        view.top_line = i % num_lines;
+        view.cur.line = view.top_line;
+        display(ms, fp, view);
+    }
+    report(bench, content, size, DISPLAY_OPS, now_ns() - start, 0);
+    free_renderer(renderer);
+}
+
+/**
+ * Runs every benchmark on one synthetic file.
+ *
+ * @param content the kind of file
+ * @param size the size of the file in bytes
+ * @param filename where to save the file
+ */
+static void run(Content content, size_t size, const char *filename) {
+    char *buf = generate(content, size);
+    FILE *file = fopen(filename, "w");
+    if (file == NULL || fwrite(buf, 1, size, file) != size || fclose(file) != 0) {
+        perror("Error writing benchmark file");
+        exit(EXIT_FAILURE);
+    }
+
+    bench_split_buffer(content, buf, size);
+    bench_read_fp(content, filename, size);
+
+    FileProxy fp = split_buffer(buf, size);
+    bench_write_fp("write_fp", content, fp, filename, size);
+    bench_get_beg_pos_n_word("get_beg_pos_n_word", content, fp, size, 1);
+    bench_get_beg_pos_n_word("get_beg_pos_n_word_5000", content, fp, size, COUNTED_WORDS);
+    bench_search("search", content, fp, size, RARE_TOKEN);
+    bench_search("search_regex", content, fp, size, RARE_REGEX);
+
+    FileProxy cmd_fp = create_empty_fp();
+    View cmd_view = {0, 0, 1, 80, {0, 0}, 0, 0};
+    char status_msg[1] = "";
+    MimState ms = {&cmd_fp, &cmd_view, status_msg, NORMAL, ':', {NULL, false}};
+    bench_move_to_line_num("move_to_line_num", content, fp, ms, size, 0);
+    bench_move_to_line_num("move_to_line_num_wrapped", content, fp, ms, size, SCREEN_COLS);
+    bench_display("display_grid", content, create_grid_renderer(SCREEN_LINES, SCREEN_COLS), fp, ms, size);
+    bench_display("display_null", content, create_null_renderer(SCREEN_LINES, SCREEN_COLS), fp, ms, size);
+
+    ms.mode = INSERT;
+    View view = {0, 0, 50, 200, {0, 0}, 0, 0};
+    bench_insert_char("insert_char", content, &fp, &view, ms, size);
+    bench_insert_newline(content, &fp, &view, ms, size);
+    bench_write_fp("write_fp_edited", content, fp, filename, size);
+    bench_search("search_edited", content, fp, size, RARE_TOKEN);
+
+    // the same again with the matches of a pattern highlighted and counted
+    const char *err;
+    Pattern *pat = compile_pattern(COMMON_TOKEN, strlen(COMMON_TOKEN), &err);
+    bench_count_matches(content, fp, size, pat);
+    ms.mode = NORMAL;
+    bench_display("display_highlight", content, create_grid_renderer(SCREEN_LINES, SCREEN_COLS), fp, ms, size);
+    ms.mode = INSERT;
+    bench_insert_char("insert_char_counted", content, &fp, &view, ms, size);
+    set_match_pattern(fp, NULL);
+    free_pattern(pat);
+
+    free_fp(cmd_fp);
+    free_fp(fp);
+    free(buf);
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_mb = DEFAULT_MAX_MB;
+    if (argc > 1) {
+        max_mb = strtoul(argv[1], NULL, 10);
+        if (max_mb == 0) {
+            fprintf(stderr, "usage: %s [max size in MB]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const char *tmp_dir = getenv("TMPDIR");
+    char filename[4096];
+    snprintf(filename, sizeof(filename), "%s/wim_bench_XXXXXX", tmp_dir != NULL ? tmp_dir : "/tmp");
+    int fd = mkstemp(filename);
+    if (fd == -1) {
+        perror("Error creating benchmark file");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    for (size_t mb = 1; mb <= max_mb; mb *= SIZE_STEP) {
+        for (Content content = LONG_LINES; content <= MIXED; content++) {
+            fprintf(stderr, "%s %zuMB\n", CONTENT_NAMES[content], mb);
+            run(content, mb * MB, filename);
+        }
+    }
+    unlink(filename);
+    return EXIT_SUCCESS;
+}
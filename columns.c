@@ -0,0 +1,405 @@
+/**
+ * @file columns.c
+ * @author Willow Rimlinger
+ *
+ * Maps between the bytes of a line and the screen columns they take up. Finding
+ * the column of a byte means decoding every char before it, so long lines keep
+ * a checkpoint of the column every CHECKPOINT_STEP bytes. Checkpoints are made
+ * as they are first needed and kept for the last few long lines that were used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "types.h"
+#include "columns.h"
+
+static const size_t TAB_WIDTH = 8;
+// lines shorter than this are always scanned from the start
+#define CHECKPOINT_STEP 4096
+// the number of lines that keep their checkpoints at once
+#define CACHED_LINES 64
+
+/** A char boundary in a line and the column it is at */
+typedef struct Checkpoint_s {
+    size_t ch;
+    size_t col;
+} Checkpoint;
+
+/** The checkpoints of one line */
+typedef struct CachedLine_s {
+    // NULL if the checkpoints don't belong to a line
+    const Line *line;
+    // the text and length of the line when the checkpoints were made, so they
+    // aren't trusted if the line changed without being forgotten
+    const char *text;
+    size_t len;
+    // checkpoint i is at the first char boundary at or after i * CHECKPOINT_STEP
+    Checkpoint *checkpoints;
+    size_t num_checkpoints;
+    size_t cap;
+} CachedLine;
+
+struct ColCache_s {
+    CachedLine lines[CACHED_LINES];
+};
+
+/** A range of code points */
+typedef struct CodeRange_s {
+    uint32_t first;
+    uint32_t last;
+} CodeRange;
+
+// chars that combine with the char before them and take up no columns of their own
+static const CodeRange ZERO_WIDTH[] = {
+    {0x0300, 0x036f}, {0x0483, 0x0489}, {0x0591, 0x05bd}, {0x05bf, 0x05bf}, {0x05c1, 0x05c2},
+    {0x05c4, 0x05c5}, {0x05c7, 0x05c7}, {0x0610, 0x061a}, {0x064b, 0x065f}, {0x0670, 0x0670},
+    {0x06d6, 0x06dc}, {0x06df, 0x06e4}, {0x06e7, 0x06e8}, {0x06ea, 0x06ed}, {0x0711, 0x0711},
+    {0x0730, 0x074a}, {0x07a6, 0x07b0}, {0x0900, 0x0902}, {0x093a, 0x093a}, {0x093c, 0x093c},
+    {0x0941, 0x0948}, {0x094d, 0x094d}, {0x0951, 0x0957}, {0x0962, 0x0963}, {0x0e31, 0x0e31},
+    {0x0e34, 0x0e3a}, {0x0e47, 0x0e4e}, {0x1ab0, 0x1aff}, {0x1dc0, 0x1dff}, {0x200b, 0x200f},
+    {0x202a, 0x202e}, {0x2060, 0x2064}, {0x20d0, 0x20ff}, {0xfe00, 0xfe0f}, {0xfe20, 0xfe2f},
+    {0xfeff, 0xfeff}, {0xe0100, 0xe01ef},
+};
+
+// chars that take up two columns
+static const CodeRange WIDE[] = {
+    {0x1100, 0x115f}, {0x231a, 0x231b}, {0x2329, 0x232a}, {0x23e9, 0x23ec}, {0x23f0, 0x23f0},
+    {0x23f3, 0x23f3}, {0x25fd, 0x25fe}, {0x2614, 0x2615}, {0x2648, 0x2653}, {0x267f, 0x267f},
+    {0x2693, 0x2693}, {0x26a1, 0x26a1}, {0x26aa, 0x26ab}, {0x26bd, 0x26be}, {0x26c4, 0x26c5},
+    {0x26ce, 0x26ce}, {0x26d4, 0x26d4}, {0x26ea, 0x26ea}, {0x26f2, 0x26f3}, {0x26f5, 0x26f5},
+    {0x26fa, 0x26fa}, {0x26fd, 0x26fd}, {0x2705, 0x2705}, {0x270a, 0x270b}, {0x2728, 0x2728},
+    {0x274c, 0x274c}, {0x274e, 0x274e}, {0x2753, 0x2755}, {0x2757, 0x2757}, {0x2795, 0x2797},
+    {0x27b0, 0x27b0}, {0x27bf, 0x27bf}, {0x2b1b, 0x2b1c}, {0x2b50, 0x2b50}, {0x2b55, 0x2b55},
+    {0x2e80, 0x303e}, {0x3041, 0x33ff}, {0x3400, 0x4dbf}, {0x4e00, 0x9fff}, {0xa000, 0xa4cf},
+    {0xa960, 0xa97f}, {0xac00, 0xd7a3}, {0xf900, 0xfaff}, {0xfe10, 0xfe19}, {0xfe30, 0xfe6f},
+    {0xff00, 0xff60}, {0xffe0, 0xffe6}, {0x16fe0, 0x16fe4}, {0x17000, 0x18aff}, {0x1b000, 0x1b2ff},
+    {0x1f004, 0x1f004}, {0x1f0cf, 0x1f0cf}, {0x1f18e, 0x1f18e}, {0x1f191, 0x1f19a}, {0x1f200, 0x1f202},
+    {0x1f210, 0x1f23b}, {0x1f240, 0x1f248}, {0x1f250, 0x1f251}, {0x1f260, 0x1f265}, {0x1f300, 0x1f320},
+    {0x1f32d, 0x1f335}, {0x1f337, 0x1f37c}, {0x1f37e, 0x1f393}, {0x1f3a0, 0x1f3ca}, {0x1f3cf, 0x1f3d3},
+    {0x1f3e0, 0x1f3f0}, {0x1f3f4, 0x1f3f4}, {0x1f3f8, 0x1f43e}, {0x1f440, 0x1f440}, {0x1f442, 0x1f4fc},
+    {0x1f4ff, 0x1f53d}, {0x1f54b, 0x1f54e}, {0x1f550, 0x1f567}, {0x1f57a, 0x1f57a}, {0x1f595, 0x1f596},
+    {0x1f5a4, 0x1f5a4}, {0x1f5fb, 0x1f64f}, {0x1f680, 0x1f6c5}, {0x1f6cc, 0x1f6cc}, {0x1f6d0, 0x1f6d2},
+    {0x1f6d5, 0x1f6d7}, {0x1f6eb, 0x1f6ec}, {0x1f6f4, 0x1f6fc}, {0x1f7e0, 0x1f7eb}, {0x1f90c, 0x1f93a},
+    {0x1f93c, 0x1f945}, {0x1f947, 0x1f9ff}, {0x1fa70, 0x1faff}, {0x20000, 0x2fffd}, {0x30000, 0x3fffd},
+};
+
+/**
+ * Checks whether a code point is in one of a sorted list of ranges.
+ *
+ * @param code the code point
+ * @param ranges the ranges
+ * @param len the number of ranges
+ * @return true if it is in one of them
+ */
+static bool in_ranges(uint32_t code, const CodeRange *ranges, size_t len) {
+    if (code < ranges[0].first || code > ranges[len - 1].last) {
+        return false;
+    }
+    size_t lo = 0;
+    size_t hi = len;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (code > ranges[mid].last) {
+            lo = mid + 1;
+        } else if (code < ranges[mid].first) {
+            hi = mid;
+        } else {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Checks whether 8 bytes are all printable ASCII, which take up one column
+ * each, without looking at them one at a time.
+ */
+static bool is_plain_word(uint64_t word) {
+    static const uint64_t ONES = 0x0101010101010101;
+    static const uint64_t HIGH_BITS = 0x8080808080808080;
+    // a byte under 0x20 borrows into its high bit when 0x20 is subtracted
+    uint64_t control = (word - 0x20 * ONES) & ~word;
+    uint64_t del = word ^ (0x7f * ONES);
+    // a byte that was 0x7f is now 0, which borrows into its high bit
+    uint64_t is_del = (del - ONES) & ~del;
+    return ((word | control | is_del) & HIGH_BITS) == 0;
+}
+
+/**
+ * Walks the chars of some text until reaching a byte or until the next char
+ * would cover a column.
+ *
+ * @param text the text
+ * @param len the length of the text
+ * @param from the char to start at
+ * @param stop_ch stop at the first char boundary at or after this
+ * @param stop_col stop at the char that covers this column
+ * @return the char that was stopped at, which is len at the end of the text
+ */
+static Checkpoint walk(const char *text, size_t len, Checkpoint from, size_t stop_ch, size_t stop_col) {
+    size_t ch = from.ch;
+    size_t col = from.col;
+    if (stop_ch > len) {
+        stop_ch = len;
+    }
+    while (ch < stop_ch) {
+        if (ch + sizeof(uint64_t) <= stop_ch && col + sizeof(uint64_t) <= stop_col) {
+            uint64_t word;
+            memcpy(&word, text + ch, sizeof(uint64_t));
+            if (is_plain_word(word)) {
+                ch += sizeof(uint64_t);
+                col += sizeof(uint64_t);
+                continue;
+            }
+        }
+        uint32_t code;
+        size_t char_len = decode_char(text + ch, len - ch, &code);
+        size_t width = char_width(code, col);
+        if (col + width > stop_col) {
+            break;
+        }
+        ch += char_len;
+        col += width;
+    }
+    return (Checkpoint) {ch, col};
+}
+
+ColCache *create_col_cache(void) {
+    ColCache *cache = calloc(1, sizeof(ColCache));
+    if (cache == NULL) {
+        fprintf(stderr, "Error allocating space for column cache.\n");
+        exit(EXIT_FAILURE);
+    }
+    return cache;
+}
+
+void free_col_cache(ColCache *cache) {
+    for (size_t i = 0; i < CACHED_LINES; i++) {
+        free(cache->lines[i].checkpoints);
+    }
+    free(cache);
+}
+
+size_t decode_char(const char *text, size_t len, uint32_t *code) {
+    const unsigned char *bytes = (const unsigned char *) text;
+    if (bytes[0] < 0x80) {
+        *code = bytes[0];
+        return 1;
+    }
+    size_t char_len;
+    uint32_t value;
+    // the smallest code point that needs char_len bytes, so overlong encodings are invalid
+    uint32_t min_value;
+    if (bytes[0] >= 0xc2 && bytes[0] <= 0xdf) {
+        char_len = 2;
+        value = bytes[0] & 0x1f;
+        min_value = 0x80;
+    } else if (bytes[0] >= 0xe0 && bytes[0] <= 0xef) {
+        char_len = 3;
+        value = bytes[0] & 0x0f;
+        min_value = 0x800;
+    } else if (bytes[0] >= 0xf0 && bytes[0] <= 0xf4) {
+        char_len = 4;
+        value = bytes[0] & 0x07;
+        min_value = 0x10000;
+    } else {
+        *code = INVALID_CODE;
+        return 1;
+    }
+    if (len < char_len) {
+        *code = INVALID_CODE;
+        return 1;
+    }
+    for (size_t i = 1; i < char_len; i++) {
+        if ((bytes[i] & 0xc0) != 0x80) {
+            *code = INVALID_CODE;
+            return 1;
+        }
+        value = (value << 6) | (bytes[i] & 0x3f);
+    }
+    if (value < min_value || value > 0x10ffff || (value >= 0xd800 && value <= 0xdfff)) {
+        *code = INVALID_CODE;
+        return 1;
+    }
+    *code = value;
+    return char_len;
+}
+
+bool is_printable(uint32_t code) {
+    return code != INVALID_CODE && code >= 0x20 && code != 0x7f && !(code >= 0x80 && code < 0xa0);
+}
+
+size_t char_width(uint32_t code, size_t col) {
+    if (code == '\t') {
+        return TAB_WIDTH - col % TAB_WIDTH;
+    }
+    // everything else in the first block takes up one column, including the
+    // substitute that unprintable chars are shown as
+    if (code < ZERO_WIDTH[0].first || !is_printable(code)) {
+        return 1;
+    }
+    if (in_ranges(code, ZERO_WIDTH, sizeof(ZERO_WIDTH) / sizeof(CodeRange))) {
+        return 0;
+    }
+    if (in_ranges(code, WIDE, sizeof(WIDE) / sizeof(CodeRange))) {
+        return 2;
+    }
+    return 1;
+}
+
+size_t count_cols(const char *text, size_t len, size_t col) {
+    Checkpoint start = {0, col};
+    return walk(text, len, start, len, SIZE_MAX).col;
+}
+
+/**
+ * Checks whether the char starting at a byte of a line combines with the one
+ * before it.
+ */
+static bool is_combining(Line *line, size_t ch) {
+    uint32_t code;
+    decode_char(line->text + ch, line->len - ch, &code);
+    return char_width(code, 0) == 0;
+}
+
+/**
+ * Finds where the char before a position in a line starts, counting combining
+ * chars as chars of their own.
+ */
+static size_t prev_code(Line *line, size_t ch) {
+    // a multibyte char ends at ch if one starts a few bytes before it
+    for (size_t char_len = 2; char_len <= 4 && char_len <= ch; char_len++) {
+        uint32_t code;
+        if (decode_char(line->text + ch - char_len, char_len, &code) == char_len) {
+            return ch - char_len;
+        }
+    }
+    return ch - 1;
+}
+
+size_t next_ch(Line *line, size_t ch) {
+    uint32_t code;
+    ch += decode_char(line->text + ch, line->len - ch, &code);
+    // the cursor never stops on a char that combines with the one before it
+    while (ch < line->len && is_combining(line, ch)) {
+        ch += decode_char(line->text + ch, line->len - ch, &code);
+    }
+    return ch;
+}
+
+size_t prev_ch(Line *line, size_t ch) {
+    ch = prev_code(line, ch);
+    while (ch > 0 && is_combining(line, ch)) {
+        ch = prev_code(line, ch);
+    }
+    return ch;
+}
+
+/**
+ * Gets the checkpoints of a line, starting them over if the line isn't the one
+ * they were made for.
+ *
+ * @param fp the FileProxy the line is in
+ * @param line the line
+ * @return the checkpoints, of which there is at least the one at the start
+ */
+static CachedLine *get_cached_line(FileProxy fp, const Line *line) {
+    CachedLine *cached = &fp.col_cache->lines[((uintptr_t) line / sizeof(Line)) % CACHED_LINES];
+    if (cached->line == line && cached->text == line->text && cached->len == line->len) {
+        return cached;
+    }
+    if (cached->cap == 0) {
+        cached->cap = 16;
+        cached->checkpoints = malloc(cached->cap * sizeof(Checkpoint));
+        if (cached->checkpoints == NULL) {
+            fprintf(stderr, "Error allocating space for column checkpoints.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    cached->line = line;
+    cached->text = line->text;
+    cached->len = line->len;
+    cached->checkpoints[0] = (Checkpoint) {0, 0};
+    cached->num_checkpoints = 1;
+    return cached;
+}
+
+/**
+ * Makes the next checkpoint of a line.
+ *
+ * @param cached the checkpoints of the line
+ * @return false if the last checkpoint is already at the end of the line
+ */
+static bool add_checkpoint(CachedLine *cached) {
+    Checkpoint last = cached->checkpoints[cached->num_checkpoints - 1];
+    if (last.ch >= cached->len) {
+        return false;
+    }
+    if (cached->num_checkpoints == cached->cap) {
+        cached->cap *= 2;
+        cached->checkpoints = realloc(cached->checkpoints, cached->cap * sizeof(Checkpoint));
+        if (cached->checkpoints == NULL) {
+            fprintf(stderr, "Error allocating space for column checkpoints.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    size_t stop_ch = cached->num_checkpoints * CHECKPOINT_STEP;
+    cached->checkpoints[cached->num_checkpoints++] = walk(cached->text, cached->len, last, stop_ch, SIZE_MAX);
+    return true;
+}
+
+size_t get_col(FileProxy fp, Line *line, size_t ch) {
+    Checkpoint start = {0, 0};
+    if (ch >= CHECKPOINT_STEP) {
+        CachedLine *cached = get_cached_line(fp, line);
+        size_t idx = ch / CHECKPOINT_STEP;
+        while (cached->num_checkpoints <= idx && add_checkpoint(cached)) {
+        }
+        if (idx >= cached->num_checkpoints) {
+            idx = cached->num_checkpoints - 1;
+        }
+        // a checkpoint can be a few bytes past where it was meant to be if a char was in the way
+        if (cached->checkpoints[idx].ch > ch) {
+            idx--;
+        }
+        start = cached->checkpoints[idx];
+    }
+    return walk(line->text, line->len, start, ch, SIZE_MAX).col;
+}
+
+size_t get_ch_at_col(FileProxy fp, Line *line, size_t col, size_t *ch_col) {
+    Checkpoint start = {0, 0};
+    if (line->len >= CHECKPOINT_STEP) {
+        CachedLine *cached = get_cached_line(fp, line);
+        // make checkpoints until one is past the column or the line ends
+        while (cached->checkpoints[cached->num_checkpoints - 1].col <= col && add_checkpoint(cached)) {
+        }
+        // the last checkpoint at or before the column
+        size_t lo = 0;
+        size_t hi = cached->num_checkpoints;
+        while (hi - lo > 1) {
+            size_t mid = (lo + hi) / 2;
+            if (cached->checkpoints[mid].col <= col) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        start = cached->checkpoints[lo];
+    }
+    Checkpoint found = walk(line->text, line->len, start, line->len, col);
+    if (ch_col != NULL) {
+        *ch_col = found.col;
+    }
+    return found.ch;
+}
+
+void forget_cols(FileProxy fp, Line *line) {
+    CachedLine *cached = &fp.col_cache->lines[((uintptr_t) line / sizeof(Line)) % CACHED_LINES];
+    if (cached->line == line) {
+        cached->line = NULL;
+    }
+}
@@ -0,0 +1,129 @@
+/**
+ * @file columns.h
+ * @author Willow Rimlinger
+ *
+ * Header for columns.c
+ *
+ * Maps between the bytes of a line and the screen columns they take up. Text
+ * is decoded as UTF-8, tabs go to the next tab stop and wide chars take up two
+ * columns. Bytes that aren't valid UTF-8 and control chars take up one column
+ * each and are printed as a substitute.
+ */
+
+#ifndef COLUMNS_H
+#define COLUMNS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "types.h"
+
+/** The code decode_char gives bytes that aren't valid UTF-8 */
+#define INVALID_CODE UINT32_MAX
+
+/**
+ * Creates an empty cache of column checkpoints for the lines of a FileProxy.
+ *
+ * @return the new cache
+ */
+ColCache *create_col_cache(void);
+
+/**
+ * Frees a cache of column checkpoints.
+ *
+ * @param cache the cache to free
+ */
+void free_col_cache(ColCache *cache);
+
+/**
+ * Decodes the char at the start of some text.
+ *
+ * @param text the text. must have at least one byte.
+ * @param len the number of bytes left in the text
+ * @param code set to the code point of the char or INVALID_CODE
+ * @return the number of bytes in the char. 1 if it isn't valid UTF-8.
+ */
+size_t decode_char(const char *text, size_t len, uint32_t *code);
+
+/**
+ * Gets the number of columns a char takes up.
+ *
+ * @param code the code point of the char
+ * @param col the column the char starts at, which decides how wide a tab is
+ * @return the number of columns. 0 for chars that combine with the one before.
+ */
+size_t char_width(uint32_t code, size_t col);
+
+/**
+ * Checks whether a char can be printed as it is. Control chars and bytes that
+ * aren't valid UTF-8 can't be.
+ *
+ * @param code the code point of the char
+ * @return true if the char can be printed
+ */
+bool is_printable(uint32_t code);
+
+/**
+ * Counts the columns some text takes up.
+ *
+ * @param text the text
+ * @param len the number of bytes in the text
+ * @param col the column the text starts at
+ * @return the column after the end of the text
+ */
+size_t count_cols(const char *text, size_t len, size_t col);
+
+/**
+ * Finds where the char after a char in a line starts. Chars that combine with
+ * the one before them are skipped along with it.
+ *
+ * @param line the line
+ * @param ch where a char starts. must be less than the length of the line.
+ * @return where the next char starts, which is the length of the line after the last char
+ */
+size_t next_ch(Line *line, size_t ch);
+
+/**
+ * Finds where the char before a position in a line starts. Chars that combine
+ * with the one before them are skipped along with it.
+ *
+ * @param line the line
+ * @param ch where a char starts or the length of the line. must be more than 0.
+ * @return where the char before it starts
+ */
+size_t prev_ch(Line *line, size_t ch);
+
+/**
+ * Gets the column a char of a line starts at. Long lines remember checkpoints
+ * along the way so they are only scanned from the start once until they change.
+ *
+ * @param fp the FileProxy the line is in
+ * @param line the line
+ * @param ch where the char starts. may be the length of the line.
+ * @return the column
+ */
+size_t get_col(FileProxy fp, Line *line, size_t ch);
+
+/**
+ * Finds the char of a line that covers a column.
+ *
+ * @param fp the FileProxy the line is in
+ * @param line the line
+ * @param col the column
+ * @param ch_col set to the column the char starts at, which is before col if the
+ *     char is more than one column wide. may be NULL.
+ * @return where the char starts. the length of the line if col is past the end.
+ */
+size_t get_ch_at_col(FileProxy fp, Line *line, size_t col, size_t *ch_col);
+
+/**
+ * Forgets the checkpoints of a line. Must be called whenever a line is edited
+ * or freed.
+ *
+ * @param fp the FileProxy the line is in
+ * @param line the line
+ */
+void forget_cols(FileProxy fp, Line *line);
+
+#endif
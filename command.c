@@ -7,7 +7,9 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <errno.h>
 
 #include "fileproxy.h"
 #include "log.h"
@@ -16,17 +18,163 @@
 #include "mode.h"
 #include "insert.h"
 #include "display.h"
+#include "stats.h"
+#include "search.h"
+#include "motions.h"
+#include "columns.h"
+#include "match_index.h"
+
+/**
+ * Saves a FileProxy and describes how it went.
+ *
+ * @param fp the FileProxy to save
+ * @param filename the name of the file to save to
+ * @param status_msg set to a message about the save
+ * @return true if the file was saved
+ */
+static bool save(FileProxy fp, const char *filename, char *status_msg) {
+    SaveStats stats;
+    if (!write_fp(fp, filename, true, &stats)) {
+        snprintf(status_msg, MAX_STATUS_MSG_LEN, "Error saving \"%s\": %s", filename, strerror(errno));
+        log_error("%s", status_msg);
+        return false;
+    }
+    snprintf(status_msg, MAX_STATUS_MSG_LEN, "\"%s\" %luL, %luB written in %.0fms",
+            filename, stats.lines, stats.bytes, stats.ms);
+    log_info("%s", status_msg);
+    return true;
+}
+
+/**
+ * Reads a command that is only a line number.
+ *
+ * @param line the command
+ * @param line_num set to the line number. lines past the end of the file are
+ *     left to be clamped by the motion.
+ * @return true if the command is a line number
+ */
+static bool parse_line_num(const Line *line, size_t *line_num) {
+    if (line->len == 0) {
+        return false;
+    }
+    size_t num = 0;
+    for (size_t i = 0; i < line->len; i++) {
+        if (line->text[i] < '0' || line->text[i] > '9') {
+            return false;
+        }
+        // saturate instead of overflowing
+        size_t digit = line->text[i] - '0';
+        num = num > (SIZE_MAX - digit) / 10 ? SIZE_MAX : num * 10 + digit;
+    }
+    *line_num = num;
+    return true;
+}
+
+void search_again(MimState *ms, FileProxy fp, View *view, bool reverse) {
+    Search search = ms->search;
+    if (search.pat == NULL) {
+        strcpy(ms->status_msg, "No previous pattern");
+        return;
+    }
+    size_t pat_len;
+    const char *pat_text = get_pattern_text(search.pat, &pat_len);
+    bool backward = search.backward != reverse;
+    CurPos match;
+    bool wrapped;
+    bool found = search_fp(fp, search.pat, view->cur, backward, &match, &wrapped);
+    Line *line = get_line(fp, view->cur.line);
+    if (found && !backward && match.line == view->cur.line && match.ch >= line->len && line->len > 0
+            && next_ch(line, view->cur.ch) >= line->len) {
+        // an empty match at the end of the line is shown on its last char, so
+        // go past it if that's where the cursor already is
+        found = search_fp(fp, search.pat, match, false, &match, &wrapped);
+    }
+    if (!found) {
+        snprintf(ms->status_msg, MAX_STATUS_MSG_LEN, "Pattern not found: %.*s", (int) pat_len, pat_text);
+        return;
+    }
+    if (wrapped) {
+        strcpy(ms->status_msg, backward
+                ? "search hit TOP, continuing at BOTTOM"
+                : "search hit BOTTOM, continuing at TOP");
+    } else {
+        snprintf(ms->status_msg, MAX_STATUS_MSG_LEN, "%c%.*s", backward ? '?' : '/', (int) pat_len, pat_text);
+    }
+    view->cur.line = match.line;
+    // an empty match at the end of a line is shown on its last char
+    if (match.ch >= get_line(fp, match.line)->len) {
+        move_to_eol(fp, view, *ms);
+    } else {
+        move_to_char(fp, view, *ms, match.ch);
+    }
+}
+
+/**
+ * Searches for the text on the command line, or for the last pattern again if
+ * the command line is empty.
+ *
+ * @param ms the state of the program, which remembers the pattern
+ * @param fp the FileProxy to search
+ * @param view the current View, whose cursor is moved to the match
+ */
+static void search(MimState *ms, FileProxy fp, View *view) {
+    Line *cmd_line = get_line(*ms->cmd_fp, 0);
+    bool has_pat = cmd_line->len > 0;
+    const char *err;
+    Pattern *pat = has_pat ? compile_pattern(cmd_line->text, cmd_line->len, &err) : NULL;
+    bool backward = ms->cmd_prompt == '?';
+    // search from where the cursor was before leaving command mode moved it
+    View from = *view;
+    switch_mode(fp, view, ms, NORMAL);
+    *view = from;
+    if (has_pat) {
+        if (pat == NULL) {
+            snprintf(ms->status_msg, MAX_STATUS_MSG_LEN, "Invalid pattern: %s", err);
+            return;
+        }
+        // the old pattern is still being counted until the new one replaces it
+        set_match_pattern(fp, pat);
+        if (ms->search.pat != NULL) {
+            free_pattern(ms->search.pat);
+        }
+        ms->search.pat = pat;
+    }
+    ms->search.backward = backward;
+    search_again(ms, fp, view, false);
+}
 
 bool exec_command(MimState *ms, FileProxy fp, View *view, const char *filename) {
     char status_msg[MAX_STATUS_MSG_LEN];
-    if (linecmp(ms->cmd_fp->lines[0], "w")) {
-        size_t size = write_fp(fp, filename);
-        sprintf(status_msg, "\"%s\" %luL, %luB written", filename, fp.len, size);
-    } else if (linecmp(ms->cmd_fp->lines[0], "q")) {
-        return false;
-    } else if (linecmp(ms->cmd_fp->lines[0], "wq")) {
-        write_fp(fp, filename);
+    status_msg[0] = '\0';
+    if (ms->cmd_prompt != ':') {
+        search(ms, fp, view);
+        return true;
+    }
+    size_t line_num;
+    if (parse_line_num(get_line(*ms->cmd_fp, 0), &line_num)) {
+        switch_mode(fp, view, ms, NORMAL);
+        move_to_line_num(fp, view, *ms, line_num);
+        move_to_bol_non_ws(fp, view, *ms);
+        strcpy(ms->status_msg, status_msg);
+        return true;
+    }
+    if (linecmp(get_line(*ms->cmd_fp, 0), "w")) {
+        save(fp, filename, status_msg);
+    } else if (linecmp(get_line(*ms->cmd_fp, 0), "q")) {
         return false;
+    } else if (linecmp(get_line(*ms->cmd_fp, 0), "wq")) {
+        // stay open so the changes aren't lost if they couldn't be saved
+        if (save(fp, filename, status_msg)) {
+            return false;
+        }
+    } else if (linecmp(get_line(*ms->cmd_fp, 0), "set wrap")) {
+        set_wrap_width(fp, view->hlimit);
+        pan(fp, view);
+    } else if (linecmp(get_line(*ms->cmd_fp, 0), "set nowrap")) {
+        set_wrap_width(fp, 0);
+        pan(fp, view);
+    } else if (linecmp(get_line(*ms->cmd_fp, 0), "stats")) {
+        format_stats(status_msg, MAX_STATUS_MSG_LEN);
     }
     switch_mode(fp, view, ms, NORMAL);
     strcpy(ms->status_msg, status_msg);
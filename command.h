@@ -13,4 +13,15 @@
 
 bool exec_command(MimState *ms, FileProxy fp, View *view, const char *filename);
 
+/**
+ * Moves the cursor to the next match of the last pattern searched for with /
+ * or ? and describes it in the status message.
+ *
+ * @param ms the state of the program
+ * @param fp the FileProxy to search
+ * @param view the current View
+ * @param reverse whether to search the opposite way the pattern was searched for
+ */
+void search_again(MimState *ms, FileProxy fp, View *view, bool reverse);
+
 #endif
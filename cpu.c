@@ -0,0 +1,28 @@
+/**
+ * @file cpu.c
+ * @author Willow Rimlinger
+ *
+ * Checks which instructions the CPU has. The loader and search threads can
+ * both need to know at once, so the answer is worked out exactly once.
+ */
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "cpu.h"
+
+static pthread_once_t detect_once = PTHREAD_ONCE_INIT;
+static bool avx2 = false;
+
+/** Asks the CPU what it has. Run once by pthread_once. */
+static void detect(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool has_avx2(void) {
+    pthread_once(&detect_once, detect);
+    return avx2;
+}
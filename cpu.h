@@ -0,0 +1,24 @@
+/**
+ * @file cpu.h
+ * @author Willow Rimlinger
+ *
+ * Header for cpu.c
+ *
+ * Checks which instructions the CPU has for the scanners that have SIMD
+ * versions. The checks are safe to make from any thread.
+ */
+
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdbool.h>
+
+/**
+ * Checks whether the CPU can run AVX2 instructions. The CPU is only asked the
+ * first time, by whichever thread gets here first.
+ *
+ * @return true if the CPU has AVX2
+ */
+bool has_avx2(void);
+
+#endif
@@ -2,71 +2,475 @@
  * @file display.c
  * @author Max Rimlinger
  *
- * Functions to display the program onto the ncurses window
+ * Functions to display the program onto a Renderer
  */
 
+#include <stdio.h>
 #include <string.h>
-#include <ncurses.h>
 
 #include "types.h"
+#include "fileproxy.h"
+#include "loader.h"
 #include "log.h"
+#include "stats.h"
+#include "render.h"
+#include "display.h"
+#include "columns.h"
+#include "match_index.h"
+
+// what the screen is drawn on. See set_renderer.
+static Renderer screen;
+
+static void screen_move(size_t row, size_t col) {
+    screen.move(screen.data, row, col);
+}
+
+static void screen_clear_to_eol(void) {
+    screen.clear_to_eol(screen.data);
+}
+
+static void screen_put_text(const char *text, size_t len) {
+    screen.put_text(screen.data, text, len);
+}
+
+static void screen_set_highlight(bool on) {
+    screen.set_highlight(screen.data, on);
+}
 
 size_t min(size_t a, size_t b) {
     return a < b ? a : b;
 }
 
-void move_cur(View view) {
-    move(view.cur.line - view.top_line, view.cur.ch - view.left_ch);
+void move_cur(FileProxy fp, View view) {
+    size_t width = get_wrap_width(fp);
+    size_t col = get_col(fp, get_line(fp, view.cur.line), view.cur.ch);
+    if (width == 0) {
+        screen_move(view.cur.line - view.top_line, col - view.left_col);
+        return;
+    }
+    size_t cur_row = get_row_of_pos(fp, view.cur);
+    size_t row_in_line = cur_row - get_row_of_line(fp, view.cur.line);
+    size_t top_row = get_row_of_line(fp, view.top_line) + view.top_row;
+    screen_move(cur_row - top_row, min(col - row_in_line * width, width - 1));
+}
+
+// the most bytes substituted on the stack at once
+#define SUBST_CHUNK_LEN 256
+static const char *INSERT_MSG = "-- INSERT --";
+// printed in place of chars that can't be printed as they are
+static const char SUBST_CHAR = '?';
+// printed in the columns of a wide char that is cut off by the edge of the screen
+static const char PARTIAL_CHAR = '>';
+
+/**
+ * Checks whether a char is printable ASCII, which prints as exactly one column.
+ *
+ * @param ch the char to check
+ * @return true if the char can be printed as is
+ */
+static bool is_plain(char ch) {
+    unsigned char uch = ch;
+    return uch >= 0x20 && uch < 0x7f;
+}
+
+/**
+ * Prints the columns of some text from left up to right at the cursor with as
+ * few calls as possible. Runs of printable ASCII are printed straight from the
+ * text. Otherwise tabs become spaces, chars that can't be printed become
+ * SUBST_CHAR and chars that are cut off by the left or right edge become
+ * PARTIAL_CHAR so the cursor still lines up with the text.
+ *
+ * @param text the text to print
+ * @param len the length of the text
+ * @param ch where in the text to start. set to the first char that didn't fit.
+ * @param col the column the char at ch starts at, which can't be after left.
+ *     set to the column of the first char that didn't fit.
+ * @param left the first column to print
+ * @param right one past the last column to print
+ */
+static void display_text(const char *text, size_t len, size_t *ch, size_t *col, size_t left, size_t right) {
+    char subst[SUBST_CHUNK_LEN];
+    size_t subst_len = 0;
+    bool printed = false;
+    // chars that combine with the last one that fit still go on this row
+    while (*ch < len && *col <= right) {
+        if (*col >= left) {
+            size_t plain_len = 0;
+            size_t max_len = min(len - *ch, right - *col);
+            while (plain_len < max_len && is_plain(text[*ch + plain_len])) {
+                plain_len++;
+            }
+            if (plain_len > 0) {
+                screen_put_text(subst, subst_len);
+                subst_len = 0;
+                screen_put_text(text + *ch, plain_len);
+                printed = true;
+                *ch += plain_len;
+                *col += plain_len;
+                continue;
+            }
+        }
+        uint32_t code;
+        size_t char_len = decode_char(text + *ch, len - *ch, &code);
+        size_t width = char_width(code, *col);
+        // a tab is the widest thing that can be added at once
+        if (subst_len + width + char_len > SUBST_CHUNK_LEN) {
+            screen_put_text(subst, subst_len);
+            subst_len = 0;
+        }
+        bool cut_off = *col + width > right;
+        if (*col < left || cut_off) {
+            for (size_t i = *col; i < *col + width && i < right; i++) {
+                if (i >= left) {
+                    subst[subst_len++] = code == '\t' ? ' ' : PARTIAL_CHAR;
+                }
+            }
+            if (cut_off) {
+                break;
+            }
+        } else if (code == '\t') {
+            memset(subst + subst_len, ' ', width);
+            subst_len += width;
+        } else if (!is_printable(code)) {
+            subst[subst_len++] = SUBST_CHAR;
+        } else if (width > 0 || printed || subst_len > 0) {
+            // chars that combine with the one before are dropped at the start
+            // of a row since there is nothing for them to combine with
+            memcpy(subst + subst_len, text + *ch, char_len);
+            subst_len += char_len;
+        }
+        *ch += char_len;
+        *col += width;
+    }
+    screen_put_text(subst, subst_len);
+}
+
+/** The matches in a line that are highlighted, found as the line is printed */
+typedef struct Highlights_s {
+    FileProxy fp;
+    const char *text;
+    size_t len;
+    // the match that is next or being printed. SIZE_MAX if there are no more.
+    size_t beg;
+    size_t end;
+} Highlights;
+
+/** Finds the next match to highlight at or after a position. */
+static void find_next_highlight(Highlights *hl, size_t from) {
+    if (from > hl->len || !find_highlight(hl->fp, hl->text, hl->len, from, &hl->beg, &hl->end)) {
+        hl->beg = SIZE_MAX;
+        hl->end = SIZE_MAX;
+    }
+}
+
+/** Starts finding the matches to highlight in a line. */
+static Highlights start_highlights(FileProxy fp, const Line *line) {
+    Highlights hl = {fp, line->text, line->len, 0, 0};
+    find_next_highlight(&hl, 0);
+    return hl;
+}
+
+/**
+ * Prints text like display_text with the matches in it highlighted.
+ *
+ * @param hl the matches in the line the text is. updated as matches are printed.
+ * @param ch where in the text to start. set to the first char that didn't fit.
+ * @param col the column the char at ch starts at. set to the column of the
+ *     first char that didn't fit.
+ * @param left the first column to print
+ * @param right one past the last column to print
+ */
+static void display_highlighted(Highlights *hl, size_t *ch, size_t *col, size_t left, size_t right) {
+    while (*ch < hl->len) {
+        // empty matches and the parts of matches that were printed already
+        // have nothing left to highlight
+        while (hl->beg != SIZE_MAX && (hl->end <= *ch || hl->beg == hl->end)) {
+            find_next_highlight(hl, hl->beg == hl->end ? hl->beg + 1 : *ch);
+        }
+        bool on = hl->beg <= *ch;
+        size_t end = min(on ? hl->end : hl->beg, hl->len);
+        if (on) {
+            screen_set_highlight(true);
+        }
+        display_text(hl->text, end, ch, col, left, right);
+        if (on) {
+            screen_set_highlight(false);
+        }
+        if (*ch < end) {
+            // the rest doesn't fit
+            return;
+        }
+    }
+}
+
+// the view the screen was last drawn with, to tell when everything has to be
+// drawn again. there is only one FileProxy on the screen.
+static View drawn_view;
+static size_t drawn_lines = 0;
+static size_t drawn_cols = 0;
+static size_t drawn_wrap_width = 0;
+
+/**
+ * Prints a line of a FileProxy over whatever was on its row of the screen.
+ *
+ * @param fp the FileProxy the line is in
+ * @param view the view the line is printed with
+ * @param line_num the line to print. the row is cleared if there is no such line.
+ */
+static void display_line(FileProxy fp, View view, size_t line_num) {
+    screen_move(line_num - view.top_line, 0);
+    screen_clear_to_eol();
+    if (line_num >= get_num_lines(fp)) {
+        return;
+    }
+    Line *line = get_line(fp, line_num);
+    size_t col;
+    size_t ch = get_ch_at_col(fp, line, view.left_col, &col);
+    Highlights hl = start_highlights(fp, line);
+    display_highlighted(&hl, &ch, &col, view.left_col, view.left_col + view.hlimit);
+}
+
+/**
+ * Prints the rows of wrapped lines on some rows of the screen.
+ *
+ * @param fp the FileProxy to print
+ * @param row the first row of the screen to print
+ * @param end_row one past the last row of the screen to print
+ * @param line_num the line on the first row
+ * @param row_in_line which of the line's rows is on the first row
+ */
+static void display_rows(FileProxy fp, size_t row, size_t end_row, size_t line_num, size_t row_in_line) {
+    size_t width = get_wrap_width(fp);
+    size_t num_lines = get_num_lines(fp);
+    Line *line = NULL;
+    Highlights hl;
+    size_t ch = 0;
+    size_t col = 0;
+    for (; row < end_row; row++) {
+        screen_move(row, 0);
+        screen_clear_to_eol();
+        if (line_num >= num_lines) {
+            continue;
+        }
+        if (line == NULL) {
+            line = get_line(fp, line_num);
+            ch = get_ch_at_col(fp, line, row_in_line * width, &col);
+            hl = start_highlights(fp, line);
+        }
+        // each row picks up where the last one stopped
+        display_highlighted(&hl, &ch, &col, row_in_line * width, (row_in_line + 1) * width);
+        if (ch >= line->len) {
+            line_num++;
+            line = NULL;
+            row_in_line = 0;
+        } else {
+            row_in_line++;
+        }
+    }
+}
+
+/**
+ * Prints the contents of a FileProxy with its lines wrapped. A line that
+ * changed can take up a different number of rows than before, so every row
+ * from the first changed line to the bottom of the screen is printed again.
+ *
+ * @param fp the FileProxy to print
+ * @param view the view to print with
+ * @param damage the lines that changed
+ * @param moved whether the view moved, so every row needs to be printed
+ */
+static void display_wrapped(FileProxy fp, View view, Damage damage, bool moved) {
+    if (moved || (damage.beg <= view.top_line && damage.end > view.top_line)) {
+        display_rows(fp, 0, view.vlimit, view.top_line, view.top_row);
+        return;
+    }
+    if (damage.beg >= damage.end || damage.end <= view.top_line) {
+        return;
+    }
+    size_t num_lines = get_num_lines(fp);
+    size_t beg = damage.beg < num_lines ? damage.beg : num_lines;
+    size_t row = get_row_of_line(fp, beg) - (get_row_of_line(fp, view.top_line) + view.top_row);
+    if (row < view.vlimit) {
+        display_rows(fp, row, view.vlimit, beg, 0);
+    }
+}
+
+/**
+ * Gets the row of the screen that is at the top when a FileProxy is printed with
+ * its lines wrapped, counting from the first row of the first line.
+ */
+static size_t get_top_row(FileProxy fp, View view) {
+    return get_row_of_line(fp, view.top_line) + view.top_row;
+}
+
+/**
+ * Scrolls what is already on the screen when the view only moved up or down by
+ * less than a screen, so that only the rows that came into view need to be
+ * printed.
+ *
+ * @param fp the FileProxy on the screen
+ * @param view the view that is about to be printed
+ * @param damage the lines that changed since the screen was last printed
+ * @return how many rows the screen scrolled up by, negative if it scrolled down
+ *     and 0 if it couldn't be scrolled
+ */
+static long scroll_screen(FileProxy fp, View view, Damage damage) {
+    size_t from = drawn_view.top_line;
+    size_t to = view.top_line;
+    if (get_wrap_width(fp) > 0) {
+        // lines above the screen might take up a different number of rows now
+        if (damage.beg < damage.end) {
+            return 0;
+        }
+        from = get_top_row(fp, drawn_view);
+        to = get_top_row(fp, view);
+    }
+    size_t dist = to > from ? to - from : from - to;
+    if (dist == 0 || dist >= view.vlimit) {
+        return 0;
+    }
+    long rows = to > from ? (long) dist : -(long) dist;
+    screen.scroll(screen.data, 0, view.vlimit, rows);
+    return rows;
 }
 
 /** 
- * Prints the contents of a FileProxy to the ncurses stdscr
+ * Prints the contents of a FileProxy to the screen. Only the lines that
+ * changed since the last time are printed. If the view moved up or down by less
+ * than a screen, what is on the screen is scrolled and only the rows that came
+ * into view are printed as well. Otherwise the view moved and every row is
+ * printed.
  *
  * @param fp the FileProxy to print
  * @param view meta information about where the cursor is and where we are panned
  *      in the file
  */
 void display_fp(FileProxy fp, View view) {
-    size_t line_limit = min(view.top_line + view.vlimit, fp.len);
-    for (size_t i = view.top_line; i < line_limit; i++) {
-        Line line = *fp.lines[i];
-        size_t char_limit = min(view.left_ch + view.hlimit, line.len);
-        for (size_t j = view.left_ch; j < char_limit; j++) {
-            mvaddch(i - view.top_line, j - view.left_ch, line.text[j]);
+    Damage damage = take_damage(fp);
+    size_t wrap_width = get_wrap_width(fp);
+    size_t lines = screen.lines(screen.data);
+    size_t cols = screen.cols(screen.data);
+    bool resized = view.vlimit != drawn_view.vlimit || view.hlimit != drawn_view.hlimit
+        || lines != drawn_lines || cols != drawn_cols || wrap_width != drawn_wrap_width;
+    bool moved = resized || view.top_line != drawn_view.top_line || view.left_col != drawn_view.left_col
+        || view.top_row != drawn_view.top_row;
+    long scrolled = 0;
+    if (moved && !resized && view.left_col == drawn_view.left_col) {
+        scrolled = scroll_screen(fp, view, damage);
+        moved = scrolled == 0;
+    }
+    // the rows that came into view when the screen was scrolled
+    size_t exposed_beg = scrolled > 0 ? view.vlimit - scrolled : 0;
+    size_t exposed_end = scrolled > 0 ? view.vlimit : (size_t) -scrolled;
+
+    if (wrap_width > 0) {
+        display_wrapped(fp, view, damage, moved);
+        if (exposed_beg < exposed_end) {
+            size_t row = get_top_row(fp, view) + exposed_beg;
+            size_t line_num = get_num_lines(fp);
+            size_t row_in_line = 0;
+            // rows past the end of the file are blank
+            if (row < get_row_of_line(fp, line_num)) {
+                line_num = get_line_at_row(fp, row, &row_in_line);
+            }
+            display_rows(fp, exposed_beg, exposed_end, line_num, row_in_line);
+        }
+    } else {
+        size_t beg = view.top_line;
+        size_t end = view.top_line + view.vlimit;
+        if (!moved) {
+            beg = damage.beg > beg ? damage.beg : beg;
+            end = min(damage.end, end);
+        }
+        for (size_t i = beg; i < end; i++) {
+            display_line(fp, view, i);
+        }
+        for (size_t row = exposed_beg; row < exposed_end; row++) {
+            size_t line_num = view.top_line + row;
+            // the changed lines were printed already
+            if (line_num < beg || line_num >= end) {
+                display_line(fp, view, line_num);
+            }
         }
     }
+    drawn_view = view;
+    drawn_lines = lines;
+    drawn_cols = cols;
+    drawn_wrap_width = wrap_width;
 }
 
 void display_status_bar(MimState ms) {
     // mode
-    move(LINES - 1, 0);
+    screen_move(screen.lines(screen.data) - 1, 0);
+    screen_clear_to_eol();
     if (ms.mode == COMMAND) {
-        printw(":");
-        size_t char_limit = min(
-            ms.cmd_view->left_ch + ms.cmd_view->hlimit,
-            ms.cmd_fp->lines[0]->len
-        );
-        for (size_t i = ms.cmd_view->left_ch; i < char_limit; i++) {
-            mvaddch(LINES - 1, i - ms.cmd_view->left_ch + 1, ms.cmd_fp->lines[0]->text[i]);
-        }
+        screen_put_text(&ms.cmd_prompt, 1);
+        Line *cmd_line = get_line(*ms.cmd_fp, 0);
+        size_t left = ms.cmd_view->left_col;
+        size_t col;
+        size_t ch = get_ch_at_col(*ms.cmd_fp, cmd_line, left, &col);
+        display_text(cmd_line->text, cmd_line->len, &ch, &col, left, left + ms.cmd_view->hlimit);
     } else if (ms.mode == INSERT) {
-        printw("%s", "-- INSERT --");
+        screen_put_text(INSERT_MSG, strlen(INSERT_MSG));
     } else {
-        printw("%s", ms.status_msg);
+        size_t ch = 0;
+        size_t col = 0;
+        display_text(ms.status_msg, strlen(ms.status_msg), &ch, &col, 0, screen.cols(screen.data));
     }
 }
 
-void display(MimState ms, FileProxy fp, View view) {
-    erase();
+/**
+ * Prints which match of the last search the cursor is on and how much of a
+ * file has been loaded in the corner of the status bar, while there are
+ * matches and while it is still being loaded in the background.
+ *
+ * @param fp the FileProxy on the screen
+ * @param view the view with the cursor
+ */
+static void display_progress(FileProxy fp, View view) {
+    char progress[96];
+    size_t len = 0;
+    size_t upto;
+    size_t total;
+    if (get_match_count(fp, view.cur, &upto, &total)) {
+        if (upto == 0) {
+            len += snprintf(progress, sizeof(progress), "%zu match%s", total, total == 1 ? "" : "es");
+        } else {
+            len += snprintf(progress, sizeof(progress), "match %zu of %zu", upto, total);
+        }
+    }
+    if (fp.loader != NULL && !is_loader_finished(fp.loader)) {
+        len += snprintf(progress + len, sizeof(progress) - len, "%sloading %d%%", len > 0 ? "  " : "",
+            get_load_percent(fp.loader));
+    }
+    if (len == 0) {
+        return;
+    }
+    size_t cols = screen.cols(screen.data);
+    screen_move(screen.lines(screen.data) - 1, cols > len ? cols - len : 0);
+    screen_put_text(progress, len);
+}
 
+void set_renderer(Renderer renderer) {
+    screen = renderer;
+    // nothing has been drawn on the new screen yet
+    drawn_lines = 0;
+    drawn_cols = 0;
+}
+
+void display(MimState ms, FileProxy fp, View view) {
+    uint64_t start = stat_clock();
     display_fp(fp, view);
     display_status_bar(ms);
+    display_progress(fp, view);
     if (ms.mode == COMMAND) {
-        move(LINES - 1, ms.cmd_view->cur.ch + 1 - ms.cmd_view->left_ch);
+        size_t col = get_col(*ms.cmd_fp, get_line(*ms.cmd_fp, 0), ms.cmd_view->cur.ch);
+        screen_move(screen.lines(screen.data) - 1, col + 1 - ms.cmd_view->left_col);
     } else {
-        move_cur(view);
+        move_cur(fp, view);
     }
 
-    refresh();
+    screen.refresh(screen.data);
+    record_stat(STAT_RENDER, start);
 }
 
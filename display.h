@@ -2,12 +2,24 @@
  * @file display.h
  * @author Max Rimlinger
  *
- * Functions to display the program onto the ncurses window
+ * Functions to display the program onto a Renderer
  */
 
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
 #include "types.h"
 
 static const size_t MAX_STATUS_MSG_LEN = 200;
 
+/**
+ * Sets the screen that display draws on. Must be called before display. The
+ * whole screen is drawn the next time display is called.
+ *
+ * @param renderer the screen to draw on
+ */
+void set_renderer(Renderer renderer);
+
 void display(MimState ms, FileProxy fp, View view);
 
+#endif
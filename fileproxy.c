@@ -8,40 +8,101 @@
  */
 
 #include <stdio.h>
-#include <ncurses.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <time.h>
 
 #include "log.h"
 #include "types.h"
 #include "fileproxy.h"
+#include "line_index.h"
+#include "arena.h"
+#include "line_tree.h"
+#include "loader.h"
+#include "columns.h"
+#include "match_index.h"
+#include "words.h"
 
 static const size_t byte = sizeof(unsigned char);
-static const size_t TEXT_BUF_INCR = 16;
-
-Line *create_line(size_t line_num) {
-    Line *line = malloc(sizeof(Line));
-    char *text = malloc((TEXT_BUF_INCR + 1) * byte); // +1 for terminating null byte
-    text[0] = '\0';
-    Line new_line = {text, line_num, 0, TEXT_BUF_INCR};
-    *line = new_line;
+// the most chars a line can hold inline, not including \0
+static const size_t INLINE_CAP = LINE_INLINE_LEN - 1;
+static const char *TMP_SUFFIX = ".wimtmp";
+static const char *NEWLINE = "\n";
+// the most iovecs written at once
+#define WRITE_BATCH_LEN 1024
+// the most bytes one iovec covers so a batch never adds up to more than writev allows
+static const size_t MAX_IOV_LEN = 1 << 30;
+
+Line *create_line(FileProxy fp) {
+    // new lines start out as views of an empty string and get a buffer of
+    // their own when text is first added to them
+    Line *line = alloc_line(fp.arena);
+    line->text = (char *) "";
+    line->len = 0;
+    line->cap = 0;
     return line;
 }
 
-void check_and_realloc_line(Line *line, size_t additional_text_len) {
-    // check that we actually need to realloc
-    size_t ideal_num_buffers = ((line->len + additional_text_len + 1) / TEXT_BUF_INCR) + 1;
-    size_t actual_num_buffers = ((line->cap + 1) / TEXT_BUF_INCR);
-    if (ideal_num_buffers != actual_num_buffers) {
-        char *tmp = realloc(line->text, (ideal_num_buffers * TEXT_BUF_INCR + 1) * byte);
-        if (tmp != NULL) {
-            line->text = tmp;
-        } else {
-            fprintf(stderr, "Error reallocating space for line text.\n");
-            exit(EXIT_FAILURE);
+/**
+ * Moves the text of a line into a buffer that can hold cap characters. Lines
+ * that fit are kept inline in the Line itself rather than in a buffer of their
+ * own. Lines that are still views into the original buffer get copied.
+ *
+ * @param line the line to move the text of
+ * @param cap the number of chars the buffer needs to hold, not including \0.
+ *     must be at least line->len.
+ */
+static void set_line_cap(Line *line, size_t cap) {
+    bool was_inline = line->text == line->inline_text;
+    bool was_alloced = line->cap > 0 && !was_inline;
+    char *text;
+    if (cap <= INLINE_CAP) {
+        if (was_inline) {
+            return;
         }
-//        line->len += additional_text_len;
-        line->cap = ideal_num_buffers * TEXT_BUF_INCR;
+        text = line->inline_text;
+        memcpy(text, line->text, line->len * byte);
+        if (was_alloced) {
+            free(line->text);
+        }
+        cap = INLINE_CAP;
+    } else if (was_alloced) {
+        text = realloc(line->text, (cap + 1) * byte);
+    } else {
+        text = malloc((cap + 1) * byte);
+        if (text != NULL) {
+            memcpy(text, line->text, line->len * byte);
+        }
+    }
+    if (text == NULL) {
+        fprintf(stderr, "Error reallocating space for line text.\n");
+        exit(EXIT_FAILURE);
+    }
+    text[line->len] = '\0';
+    line->text = text;
+    line->cap = cap;
+}
+
+void check_and_realloc_line(Line *line, size_t additional_text_len) {
+    size_t needed = line->len + additional_text_len;
+    if (line->cap == 0) {
+        // lines that haven't been edited yet still point into the original buffer
+        set_line_cap(line, needed > line->len ? needed : line->len);
+    } else if (needed > line->cap) {
+        // grow geometrically so typing a long line reallocs a logarithmic number of times
+        set_line_cap(line, needed > line->cap * 2 ? needed : line->cap * 2);
+    } else if (needed < line->cap / 4 && line->cap > INLINE_CAP) {
+        // only shrink once the line is much shorter so that typing and deleting
+        // at a boundary doesn't realloc every time. callers shorten the line
+        // after this, so keep room for the text that is still there.
+        set_line_cap(line, needed * 2 > line->len ? needed * 2 : line->len);
     }
 }
 
@@ -57,91 +118,565 @@ bool linecmp(Line *line, const char *string) {
     return true;
 }
 
+const char *peek_line(FileProxy fp, const LineSlot *slot, size_t *len) {
+    if (slot->line != NULL) {
+        *len = slot->line->len;
+        return slot->line->text;
+    }
+    const char *text = fp.orig + slot->off;
+    const char *eol = memchr(text, '\n', fp.orig_len - slot->off);
+    *len = eol == NULL ? fp.orig_len - slot->off : (size_t) (eol - text);
+    return text;
+}
+
+/**
+ * Creates a Damage where every line needs to be displayed.
+ *
+ * @return the new Damage
+ */
+static Damage *create_damage() {
+    Damage *damage = malloc(sizeof(Damage));
+    if (damage == NULL) {
+        fprintf(stderr, "Error allocating space for damage.\n");
+        exit(EXIT_FAILURE);
+    }
+    damage->beg = 0;
+    damage->end = SIZE_MAX;
+    return damage;
+}
+
+/**
+ * Adds a range of lines to the lines that need to be displayed again.
+ *
+ * @param fp the FileProxy the lines are in
+ * @param beg the first line that changed
+ * @param end one past the last line that changed
+ */
+static void add_damage(FileProxy fp, size_t beg, size_t end) {
+    if (beg < fp.damage->beg) {
+        fp.damage->beg = beg;
+    }
+    if (end > fp.damage->end || fp.damage->beg >= fp.damage->end) {
+        fp.damage->end = end;
+    }
+}
+
+/**
+ * Counts the screen rows a line takes up when it is wrapped.
+ *
+ * @param width the number of columns lines are wrapped at. 0 if they aren't.
+ * @param cols the number of columns the line takes up
+ * @return the number of rows. always at least 1.
+ */
+static size_t count_rows(size_t width, size_t cols) {
+    if (width == 0 || cols == 0) {
+        return 1;
+    }
+    return (cols + width - 1) / width;
+}
+
+/**
+ * Counts the rows of the line in a slot. Called by tree_set_all_rows.
+ *
+ * @param slot the slot of the line
+ * @param data the FileProxy the line is in
+ * @return the number of rows
+ */
+static size_t count_slot_rows(const LineSlot *slot, void *data) {
+    FileProxy *fp = data;
+    if (slot->line != NULL) {
+        return count_rows(*fp->wrap_width, get_col(*fp, slot->line, slot->line->len));
+    }
+    size_t len;
+    const char *text = peek_line(*fp, slot, &len);
+    return count_rows(*fp->wrap_width, count_cols(text, len, 0));
+}
+
+/**
+ * Updates the rows the lines in a range take up after they changed. Lines
+ * don't need to be counted when they aren't wrapped.
+ *
+ * @param fp the FileProxy the lines are in
+ * @param beg the first line that changed
+ * @param end one past the last line that changed
+ */
+static void update_rows(FileProxy fp, size_t beg, size_t end) {
+    if (*fp.wrap_width == 0) {
+        return;
+    }
+    LineIter iter = iter_tree(fp.lines, beg);
+    for (size_t i = beg; i < end; i++) {
+        tree_set_rows(fp.lines, i, count_slot_rows(iter_next(&iter), &fp));
+    }
+}
+
+void mark_line_dirty(FileProxy fp, size_t line_num) {
+    Line *line = tree_get(fp.lines, line_num)->line;
+    if (line != NULL) {
+        forget_cols(fp, line);
+        forget_words(fp, line);
+    }
+    add_damage(fp, line_num, line_num + 1);
+    update_rows(fp, line_num, line_num + 1);
+    update_matches(fp, line_num, line_num + 1);
+}
+
+void mark_all_dirty(FileProxy fp) {
+    add_damage(fp, 0, SIZE_MAX);
+}
+
+void set_wrap_width(FileProxy fp, size_t width) {
+    *fp.wrap_width = width;
+    if (width > 0) {
+        tree_set_all_rows(fp.lines, count_slot_rows, &fp);
+    }
+    add_damage(fp, 0, SIZE_MAX);
+}
+
+size_t get_wrap_width(FileProxy fp) {
+    return *fp.wrap_width;
+}
+
+size_t get_row_of_line(FileProxy fp, size_t line_num) {
+    return tree_row_of(fp.lines, line_num);
+}
+
+size_t get_row_of_pos(FileProxy fp, CurPos pos) {
+    size_t row = tree_row_of(fp.lines, pos.line);
+    if (*fp.wrap_width == 0) {
+        return row;
+    }
+    // the cursor can be one past the end of a line that fills its last row
+    Line *line = get_line(fp, pos.line);
+    size_t rows = count_rows(*fp.wrap_width, get_col(fp, line, line->len));
+    size_t row_in_line = get_col(fp, line, pos.ch) / *fp.wrap_width;
+    return row + (row_in_line < rows ? row_in_line : rows - 1);
+}
+
+size_t get_line_at_row(FileProxy fp, size_t row, size_t *row_in_line) {
+    return tree_line_at_row(fp.lines, row, row_in_line);
+}
+
+Damage take_damage(FileProxy fp) {
+    Damage damage = *fp.damage;
+    fp.damage->beg = SIZE_MAX;
+    fp.damage->end = 0;
+    return damage;
+}
+
+/**
+ * Creates the wrap width shared by the copies of a FileProxy. Lines start out
+ * unwrapped.
+ *
+ * @return the new wrap width
+ */
+static size_t *create_wrap_width() {
+    size_t *wrap_width = malloc(sizeof(size_t));
+    if (wrap_width == NULL) {
+        fprintf(stderr, "Error allocating space for wrap width.\n");
+        exit(EXIT_FAILURE);
+    }
+    *wrap_width = 0;
+    return wrap_width;
+}
+
 FileProxy create_empty_fp() {
-    Line **lines = malloc(sizeof(Line *));
-    Line *first_line = create_line(0);
-    lines[0] = first_line;
-    FileProxy fp = {lines, 1};
+    FileProxy fp = {NULL, NULL, create_arena(), NULL, 0, false, create_damage(), create_wrap_width(),
+        create_col_cache(), create_word_cache(), create_match_index()};
+    LineSlot first_line = {create_line(fp), 0};
+    fp.lines = build_tree(&first_line, 1);
     return fp;
 }
 
 FileProxy split_buffer(const char *buffer, size_t buf_len) {
-    size_t num_lines = 1;
-    for (size_t i = 0; i < buf_len; i++) {
-        if (buffer[i] == '\n' && i != buf_len - 1) {
-            num_lines++;
+    // a trailing \n ends the last line rather than starting a new one
+    size_t text_len = buf_len;
+    if (text_len > 0 && buffer[text_len - 1] == '\n') {
+        text_len--;
+    }
+
+    // only record where each line begins in one pass. Lines are created by get_line.
+    LineSlot *first_line = malloc(sizeof(LineSlot));
+    if (first_line == NULL) {
+        fprintf(stderr, "Error allocating space for lines.\n");
+        exit(EXIT_FAILURE);
+    }
+    first_line->line = NULL;
+    first_line->off = 0;
+    LineIndex index = {first_line, 1, 1};
+    index_lines(&index, buffer, 0, text_len);
+
+    FileProxy fp = {build_tree(index.slots, index.len), NULL, create_arena(), buffer, buf_len, false, create_damage(),
+        create_wrap_width(), create_col_cache(), create_word_cache(), create_match_index()};
+    free(index.slots);
+    return fp;
+}
+
+bool read_fp(FileProxy *fp, const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return false;
+    }
+    size_t file_size = st.st_size;
+    if (file_size == 0) {
+        close(fd);
+        *fp = create_empty_fp();
+        return true;
+    }
+
+    // map the file instead of reading it so untouched lines stay in the page cache
+    char *map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    // the first line begins at the beginning. the loader finds the rest.
+    LineSlot first_line = {NULL, 0};
+    FileProxy new_fp = {build_tree(&first_line, 1), start_loader(map, file_size), create_arena(), map, file_size, true,
+        create_damage(), create_wrap_width(), create_col_cache(), create_word_cache(), create_match_index()};
+    *fp = new_fp;
+    return true;
+}
+
+/**
+ * Moves lines the loader has found into the tree of a FileProxy.
+ *
+ * @param fp the FileProxy being loaded
+ * @param wait whether to block until there are new lines or the file is loaded
+ */
+static void take_lines(FileProxy fp, bool wait) {
+    if (fp.loader == NULL || is_loader_finished(fp.loader)) {
+        return;
+    }
+    size_t old_len = tree_len(fp.lines);
+    if (take_loaded_lines(fp.loader, fp.lines, wait) > 0) {
+        add_damage(fp, old_len, SIZE_MAX);
+        update_rows(fp, old_len, tree_len(fp.lines));
+        update_matches(fp, old_len, tree_len(fp.lines));
+    }
+}
+
+bool update_loading(FileProxy fp) {
+    take_lines(fp, false);
+    return fp.loader != NULL && !is_loader_finished(fp.loader);
+}
+
+bool wait_for_line(FileProxy fp, size_t line_num) {
+    while (line_num >= tree_len(fp.lines)) {
+        if (fp.loader == NULL || is_loader_finished(fp.loader)) {
+            return false;
         }
+        take_lines(fp, true);
     }
-    Line **lines = malloc(sizeof(Line *) * num_lines);
-    size_t lines_idx = 0;
+    return true;
+}
 
-    Line *first_line = create_line(lines_idx);
-    lines[lines_idx] = first_line;
+size_t get_num_lines(FileProxy fp) {
+    return tree_len(fp.lines);
+}
 
-    for (size_t i = 0; i < buf_len - 1; i++) {
-        // create a new line
-        if (buffer[i] == '\n') {
-            lines_idx++;
-            Line *line = create_line(lines_idx);
-            lines[lines_idx] = line;
-        } else {
-            // increase the text buffer size of the line if it is full
-            Line *line = lines[lines_idx];
-            check_and_realloc_line(line, 1);
-
-            // add a character on to the line
-            line->text[line->len] = buffer[i];
-            line->text[line->len+1] = '\0';
-            line->len = line->len + 1;
+Line *get_line(FileProxy fp, size_t line_num) {
+    LineSlot *slot = tree_get(fp.lines, line_num);
+    if (slot->line == NULL) {
+        size_t len;
+        const char *text = peek_line(fp, slot, &len);
+        Line *line = alloc_line(fp.arena);
+        line->text = (char *) text;
+        line->len = len;
+        line->cap = 0;
+        // views read one past the end of their text. that is the \n for every
+        // line but a last line without one, which would read past the end of
+        // the mapping, so that line is copied as soon as it is made, even while
+        // the rest of the file is still being loaded.
+        if (text + len == fp.orig + fp.orig_len) {
+            set_line_cap(line, len);
         }
+        slot->line = line;
     }
-    FileProxy fp = {lines, num_lines};
-    return fp;
+    return slot->line;
+}
+
+void insert_line(FileProxy *fp, size_t line_num, Line *line) {
+    // lines still being loaded belong before a line added at the end
+    wait_for_line(*fp, line_num);
+    LineSlot slot = {line, 0};
+    tree_insert(fp->lines, line_num, slot);
+    add_damage(*fp, line_num, SIZE_MAX);
+    update_rows(*fp, line_num, line_num + 1);
+    update_matches(*fp, line_num, line_num + 1);
+}
+
+void insert_lines(FileProxy *fp, size_t line_num, Line **lines, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    // lines still being loaded belong before lines added at the end
+    wait_for_line(*fp, line_num);
+    LineSlot *slots = malloc(len * sizeof(LineSlot));
+    if (slots == NULL) {
+        fprintf(stderr, "Error allocating space for lines.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < len; i++) {
+        slots[i].line = lines[i];
+        slots[i].off = 0;
+    }
+    tree_splice(fp->lines, line_num, slots, len);
+    free(slots);
+    add_damage(*fp, line_num, SIZE_MAX);
+    update_rows(*fp, line_num, line_num + len);
+    update_matches(*fp, line_num, line_num + len);
+}
+
+void remove_line(FileProxy *fp, size_t line_num) {
+    Line *line = tree_get(fp->lines, line_num)->line;
+    if (line != NULL) {
+        forget_cols(*fp, line);
+        forget_words(*fp, line);
+        free_line(fp->arena, line);
+    }
+    tree_remove(fp->lines, line_num);
+    add_damage(*fp, line_num, SIZE_MAX);
 }
 
 void log_fp(FileProxy fp) {
-    log_to_file("fileproxy:");
-    for (size_t i = 0; i < fp.len; i++) {
-        log_to_file("line num: %lu", fp.lines[i]->num);
-        log_to_file("len: %lu", fp.lines[i]->len);
-        log_to_file("cap: %lu", fp.lines[i]->cap);
-        if (fp.lines[i]->len == 0) {
-            log_to_file("text: <empty>");
+    if (!log_enabled(LOG_DEBUG)) {
+        return;
+    }
+    log_debug("fileproxy:");
+    LineIter iter = iter_tree(fp.lines, 0);
+    LineSlot *slot;
+    for (size_t i = 0; (slot = iter_next(&iter)) != NULL; i++) {
+        size_t len;
+        const char *text = peek_line(fp, slot, &len);
+        if (slot->line == NULL) {
+            log_debug("line num: %zu (not loaded)", i);
+        } else {
+            log_debug("line num: %zu", i);
+            log_debug("cap: %zu", slot->line->cap);
+        }
+        log_debug("len: %zu", len);
+        if (len == 0) {
+            log_debug("text: <empty>");
         } else {
-            log_to_file("text: %s", fp.lines[i]->text);
+            log_debug("text: %.*s", (int) len, text);
         }
     }
 }
 
 void free_fp(FileProxy fp) {
-    for (size_t i = 0; i < fp.len; i++) {
-        free(fp.lines[i]->text);
-        fp.lines[i]->text = NULL;
-        free(fp.lines[i]);
-        fp.lines[i] = NULL;
+    if (fp.loader != NULL) {
+        stop_loader(fp.loader);
+        fp.loader = NULL;
     }
-    free(fp.lines);
+    // the Lines are all freed along with the blocks they were allocated from
+    free_arena(fp.arena);
+    fp.arena = NULL;
+    free_tree(fp.lines);
     fp.lines = NULL;
+    if (fp.orig_mapped) {
+        munmap((void *) fp.orig, fp.orig_len);
+    }
+    fp.orig = NULL;
+    free(fp.damage);
+    fp.damage = NULL;
+    free(fp.wrap_width);
+    fp.wrap_width = NULL;
+    free_col_cache(fp.col_cache);
+    fp.col_cache = NULL;
+    free_word_cache(fp.word_cache);
+    fp.word_cache = NULL;
+    free_match_index(fp.match_index);
+    fp.match_index = NULL;
 }
 
-size_t write_fp(FileProxy fp, const char *filename) {
-    FILE *file = fopen(filename, "w");
-    if (file == NULL) {
-        fprintf(stderr, "Error saving %s\n", filename);
+/**
+ * Writes every iovec in a batch, picking up where writev left off if it is
+ * interrupted or only writes part of the batch.
+ *
+ * @param fd the file to write to
+ * @param iov the batch. the iovecs are modified as they are written.
+ * @param iovcnt the number of iovecs in the batch
+ * @return true if everything was written, false if there was an error
+ */
+static bool write_batch(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t written = writev(fd, iov, iovcnt);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        // skip past the iovecs that were fully written
+        while (iovcnt > 0 && (size_t) written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
     }
+    return true;
+}
 
-    for (size_t i = 0; i < fp.len; i++) {
-        if (fp.lines[i]->len > 0) {
-            fprintf(file, "%s", fp.lines[i]->text);
+/**
+ * Adds text to a batch of iovecs, extending the last one if the text comes
+ * right after it. Runs of unedited lines are contiguous in the original buffer
+ * so they end up as a single iovec.
+ *
+ * @param iov the batch
+ * @param iovcnt the number of iovecs in the batch
+ * @param text the text to add
+ * @param len the length of the text
+ */
+static void add_to_batch(struct iovec *iov, int *iovcnt, const char *text, size_t len) {
+    if (*iovcnt > 0) {
+        struct iovec *last = &iov[*iovcnt - 1];
+        if ((const char *) last->iov_base + last->iov_len == text && last->iov_len + len <= MAX_IOV_LEN) {
+            last->iov_len += len;
+            return;
         }
-        fprintf(file, "\n");
     }
-    
-    // get file size
-    fseek(file, 0, SEEK_END);
-    size_t file_size = ftell(file);
+    iov[*iovcnt].iov_base = (char *) text;
+    iov[*iovcnt].iov_len = len;
+    *iovcnt += 1;
+}
 
-    fclose(file);
-    return file_size;
+/**
+ * Writes every line of a FileProxy to a file.
+ *
+ * @param fp the FileProxy to write
+ * @param fd the file to write to
+ * @param bytes set to the number of bytes written
+ * @return true if everything was written, false if there was an error
+ */
+static bool write_lines(FileProxy fp, int fd, size_t *bytes) {
+    struct iovec iov[WRITE_BATCH_LEN];
+    int iovcnt = 0;
+    *bytes = 0;
+    LineIter iter = iter_tree(fp.lines, 0);
+    LineSlot *slot;
+    while ((slot = iter_next(&iter)) != NULL) {
+        // leave room for the text and the \n
+        if (iovcnt + 2 > WRITE_BATCH_LEN) {
+            if (!write_batch(fd, iov, iovcnt)) {
+                return false;
+            }
+            iovcnt = 0;
+        }
+        size_t len;
+        const char *text = peek_line(fp, slot, &len);
+        bool in_orig = fp.orig != NULL && text >= fp.orig && text + len < fp.orig + fp.orig_len;
+        if (in_orig && text[len] == '\n') {
+            // unedited lines are followed by their \n in the original buffer
+            add_to_batch(iov, &iovcnt, text, len + 1);
+        } else {
+            if (len > 0) {
+                add_to_batch(iov, &iovcnt, text, len);
+            }
+            add_to_batch(iov, &iovcnt, NEWLINE, 1);
+        }
+        *bytes += len + 1;
+    }
+    return write_batch(fd, iov, iovcnt);
 }
 
+/**
+ * Flushes the directory a file is in to disk so that a rename into it survives
+ * a crash.
+ *
+ * @param filename the name of the file in the directory
+ * @return true if the directory was flushed
+ */
+static bool sync_parent_dir(const char *filename) {
+    const char *slash = strrchr(filename, '/');
+    char *dirname;
+    if (slash == NULL) {
+        dirname = strdup(".");
+    } else {
+        // the root directory is still / after removing the filename
+        size_t dir_len = slash == filename ? 1 : (size_t) (slash - filename);
+        dirname = strndup(filename, dir_len);
+    }
+    if (dirname == NULL) {
+        fprintf(stderr, "Error allocating space for filename.\n");
+        exit(EXIT_FAILURE);
+    }
+    int dir_fd = open(dirname, O_RDONLY | O_DIRECTORY);
+    free(dirname);
+    if (dir_fd == -1) {
+        return false;
+    }
+    bool synced = fsync(dir_fd) == 0;
+    close(dir_fd);
+    return synced;
+}
+
+bool write_fp(FileProxy fp, const char *filename, bool durable, SaveStats *stats) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // write next to the file and rename over it. truncating the file in place
+    // would pull the text out from under the lines that are still mapped views
+    // and lose the file if the save were interrupted.
+    char *tmp_filename = malloc(strlen(filename) + strlen(TMP_SUFFIX) + 1);
+    if (tmp_filename == NULL) {
+        fprintf(stderr, "Error allocating space for filename.\n");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(tmp_filename, "%s%s", filename, TMP_SUFFIX);
+
+    // every line needs to be loaded before it can be written
+    wait_for_line(fp, SIZE_MAX);
+
+    int fd = open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+        free(tmp_filename);
+        return false;
+    }
+    // keep the permissions of the file being replaced
+    struct stat st;
+    if (stat(filename, &st) == 0) {
+        fchmod(fd, st.st_mode & 07777);
+    }
+
+    size_t bytes;
+    bool saved = write_lines(fp, fd, &bytes);
+    if (saved && durable) {
+        saved = fsync(fd) == 0;
+    }
+    // errors from delayed writes can show up when the file is closed
+    if (close(fd) == -1) {
+        saved = false;
+    }
+    if (saved) {
+        saved = rename(tmp_filename, filename) == 0;
+    }
+    if (saved && durable) {
+        saved = sync_parent_dir(filename);
+    }
+    if (!saved) {
+        int saved_errno = errno;
+        unlink(tmp_filename);
+        errno = saved_errno;
+    }
+    free(tmp_filename);
+
+    if (saved && stats != NULL) {
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        stats->lines = get_num_lines(fp);
+        stats->bytes = bytes;
+        stats->ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    }
+    return saved;
+}
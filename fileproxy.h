@@ -18,16 +18,19 @@
 #include "types.h"
 
 /**
- * Creates a new empty Line with a beginning buffer capacity of TEXT_BUF_INCR
+ * Creates a new empty Line in a FileProxy's arena. The line doesn't get a text
+ * buffer until text is added to it.
  *
+ * @param fp the FileProxy the line will be in
  * @return the newly created line
  */
-Line *create_line(size_t line_num);
+Line *create_line(FileProxy fp);
 
 /**
  * Adjusts the text buffer of a line. Checks if the given line is full and the 
  * buffer needs to be increased or if the line has space to reduce the buffer.
- * Adjusts the capacity of the line.
+ * Adjusts the capacity of the line. If the line is still a view into the
+ * original buffer, its text is first copied into a buffer of its own.
  *
  * @param line the line to check and potentially increase
  * @param additional_text_len the number of chars that are being added (or subtracted), not including \0
@@ -52,32 +55,206 @@ bool linecmp(Line *line, const char *string);
 FileProxy create_empty_fp();
 
 /**
- * Converts a text buffer containing the contents of a file into a FileProxy
+ * Converts a text buffer containing the contents of a file into a FileProxy.
+ * Only the beginning of each line is recorded: the text is not copied and each
+ * Line is a view into the buffer until it is first edited, so the buffer must
+ * outlive the FileProxy.
  * 
  * @param buffer the text buffer to convert
  * @param buf_len the length in characters of the buffer
- * @return A FileProxy whose Lines have been filled with the contents of the buffer
+ * @return A FileProxy whose lines point into the contents of the buffer
  */
 FileProxy split_buffer(const char *buffer, size_t buf_len); 
 
+/**
+ * Maps a file into memory and starts indexing its lines into a FileProxy on a
+ * background thread. Nothing is copied until a line is edited, so lines that
+ * are never displayed or edited stay backed by the page cache. Only the first
+ * line is guaranteed to be there when this returns. See wait_for_line.
+ *
+ * @param fp the FileProxy to fill
+ * @param filename the name of the file to read
+ * @return true if the file was read, false if it could not be opened
+ */
+bool read_fp(FileProxy *fp, const char *filename);
+
+/**
+ * Moves the lines that have been found in the background into a FileProxy
+ * without waiting for more.
+ *
+ * @param fp the FileProxy being loaded
+ * @return true if the file is still being loaded
+ */
+bool update_loading(FileProxy fp);
+
+/**
+ * Waits until a line has been loaded into a FileProxy. Pass SIZE_MAX to wait
+ * for the whole file.
+ *
+ * @param fp the FileProxy being loaded
+ * @param line_num the line to wait for
+ * @return true if the line exists, false if the file has fewer lines
+ */
+bool wait_for_line(FileProxy fp, size_t line_num);
+
+/**
+ * Gets the number of lines that are in a FileProxy so far. Use wait_for_line
+ * to check whether there are more lines while the file is being loaded.
+ *
+ * @param fp the FileProxy
+ * @return the number of lines that have been loaded
+ */
+size_t get_num_lines(FileProxy fp);
+
+/**
+ * Gets a line of a FileProxy, creating the Line for it the first time the line
+ * is needed.
+ *
+ * @param fp the FileProxy to get the line from
+ * @param line_num the index of the line
+ * @return the line
+ */
+Line *get_line(FileProxy fp, size_t line_num);
+
+/**
+ * Gets the text of a line without creating a Line for it if it doesn't have one.
+ *
+ * @param fp the FileProxy the line is in
+ * @param slot the slot of the line
+ * @param len set to the length of the text
+ * @return the text of the line, which is not necessarily null terminated
+ */
+const char *peek_line(FileProxy fp, const LineSlot *slot, size_t *len);
+
+/**
+ * Inserts a Line into a FileProxy. The line that was at line_num and every
+ * line after it move down one.
+ *
+ * @param fp the FileProxy to insert into
+ * @param line_num the number the line will have. may be the number of lines
+ *     to append, which waits for the rest of the file to be loaded.
+ * @param line the line to insert
+ */
+void insert_line(FileProxy *fp, size_t line_num, Line *line);
+
+/**
+ * Inserts several Lines into a FileProxy at once. The line that was at line_num
+ * and every line after it move down by len. Costs O(n) at most no matter how
+ * many lines are inserted.
+ *
+ * @param fp the FileProxy to insert into
+ * @param line_num the number the first line will have. may be the number of
+ *     lines to append, which waits for the rest of the file to be loaded.
+ * @param lines the lines to insert, in order
+ * @param len the number of lines
+ */
+void insert_lines(FileProxy *fp, size_t line_num, Line **lines, size_t len);
+
+/**
+ * Removes a line from a FileProxy and frees it. Every line after it moves up one.
+ *
+ * @param fp the FileProxy to remove from
+ * @param line_num the number of the line to remove
+ */
+void remove_line(FileProxy *fp, size_t line_num);
+
+/**
+ * Marks a line that was edited so that it gets displayed again. Inserting and
+ * removing lines marks the lines they move on their own.
+ *
+ * @param fp the FileProxy the line is in
+ * @param line_num the number of the line that was edited
+ */
+void mark_line_dirty(FileProxy fp, size_t line_num);
+
+/**
+ * Marks every line of a FileProxy to be displayed again, as when how lines are
+ * drawn changes.
+ *
+ * @param fp the FileProxy
+ */
+void mark_all_dirty(FileProxy fp);
+
+/**
+ * Gets the lines that changed since the last time this was called and forgets
+ * about them. Every line has changed the first time it is called.
+ *
+ * @param fp the FileProxy to get the changed lines of
+ * @return the lines that changed
+ */
+Damage take_damage(FileProxy fp);
+
+/**
+ * Wraps the lines of a FileProxy at a number of columns or stops wrapping them.
+ * Counts the rows of every line once. After that only the lines that change
+ * are counted again.
+ *
+ * @param fp the FileProxy to wrap
+ * @param width the number of columns to wrap at. 0 to stop wrapping.
+ */
+void set_wrap_width(FileProxy fp, size_t width);
+
+/**
+ * Gets the number of columns the lines of a FileProxy are wrapped at.
+ *
+ * @param fp the FileProxy
+ * @return the wrap width, 0 if lines aren't wrapped
+ */
+size_t get_wrap_width(FileProxy fp);
+
+/**
+ * Gets the first screen row of a line when lines are wrapped.
+ *
+ * @param fp the FileProxy the line is in
+ * @param line_num the line
+ * @return the number of rows the lines before it take up
+ */
+size_t get_row_of_line(FileProxy fp, size_t line_num);
+
+/**
+ * Gets the screen row of a position when lines are wrapped.
+ *
+ * @param fp the FileProxy the position is in
+ * @param pos the position
+ * @return the row
+ */
+size_t get_row_of_pos(FileProxy fp, CurPos pos);
+
+/**
+ * Finds the line on a screen row when lines are wrapped.
+ *
+ * @param fp the FileProxy to look in
+ * @param row the row
+ * @param row_in_line set to which of the line's rows it is
+ * @return the line on the row
+ */
+size_t get_line_at_row(FileProxy fp, size_t row, size_t *row_in_line);
+
 /** Debug function to see everything about a FileProxy */
 void log_fp(FileProxy fp);
 
 /**
- * Frees a FileProxy and all text within it
+ * Frees a FileProxy and all text within it. The Lines are freed a block at a
+ * time, so only the text of lines that were edited is freed individually.
  *
  * @param fp the FileProxy to free
  */
 void free_fp(FileProxy fp);
 
 /**
- * Writes the contents of a FileProxy to a file, overwriting all previous contents
+ * Writes the contents of a FileProxy to a file, overwriting all previous contents.
+ * The contents are written to a temporary file in large batches straight from
+ * the lines and then renamed over the file, so the file is left as it was if
+ * the save fails. Waits for the whole file to be loaded first.
  *
  * @param fp the FileProxy to write to disk
  * @param filename the name of the file to write to
- * @return the number of bytes in the file
+ * @param durable whether to flush the file to disk before returning so that it
+ *     survives a crash
+ * @param stats filled in with what was written if the save works. may be NULL.
+ * @return true if the file was saved, false if it couldn't be with errno set
  */
-size_t write_fp(FileProxy fp, const char *filename);
+bool write_fp(FileProxy fp, const char *filename, bool durable, SaveStats *stats);
 
 #endif
 
@@ -6,6 +6,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 
@@ -14,6 +15,7 @@
 #include "motions.h"
 #include "log.h"
 #include "text_utils.h"
+#include "columns.h"
 
 static const size_t byte = sizeof(unsigned char);
 
@@ -27,7 +29,7 @@ static const size_t byte = sizeof(unsigned char);
  * @return the new cursor position after inserting
  */
 void insert_char(char ch, FileProxy *fp, View *view, MimState ms) {
-    Line *line = fp->lines[view->cur.line];
+    Line *line = get_line(*fp, view->cur.line);
     check_and_realloc_line(line, 1);
     
     // move every char after ch over 1
@@ -40,6 +42,7 @@ void insert_char(char ch, FileProxy *fp, View *view, MimState ms) {
 
     // insert char
     line->text[view->cur.ch] = ch;
+    mark_line_dirty(*fp, view->cur.line);
     // move cursor
     move_right(*fp, view, ms);
 }
@@ -50,27 +53,7 @@ void delete_line(FileProxy *fp, View *view, MimState ms) {
         return;
     }
 
-    // move subsequent lines up one
-    Line **src = fp->lines + view->cur.line + 1;
-    Line **dest = fp->lines + view->cur.line;
-    memmove(dest, src, (fp->len - (view->cur.line + 1)) * sizeof(Line *));
-
-    // update length
-    fp->len -= 1;
-
-    // update the line numbers of subsequent lines
-    for (size_t i = view->cur.line; i < fp->len; i++) {
-        fp->lines[i]->num -= 1;
-    }
-
-    // shorten lines array
-    Line **tmp = realloc(fp->lines,  fp->len * sizeof(Line *));
-    if (tmp != NULL) {
-        fp->lines = tmp;
-    } else {
-        fprintf(stderr, "Error reallocating space for new line.\n");
-        exit(EXIT_FAILURE);
-    }
+    remove_line(fp, view->cur.line);
 
     move_up(*fp, view, ms);
 }
@@ -89,37 +72,18 @@ void combine_line_with_prev(FileProxy *fp, View *view, MimState ms) {
     }
 
     // move text
-    Line *cur_line = fp->lines[view->cur.line];
-    Line *prev_line = fp->lines[view->cur.line-1];
+    Line *cur_line = get_line(*fp, view->cur.line);
+    Line *prev_line = get_line(*fp, view->cur.line-1);
     size_t prev_line_len_before_combining = prev_line->len;
     if (cur_line->len > 0) {
         // add the text from the current line to the prev line
         check_and_realloc_line(prev_line, cur_line->len);
-        strcpy(prev_line->text + prev_line->len, cur_line->text);
+        memcpy(prev_line->text + prev_line->len, cur_line->text, cur_line->len * byte);
         prev_line->len += cur_line->len;
+        prev_line->text[prev_line->len] = '\0';
+        mark_line_dirty(*fp, view->cur.line - 1);
     }
-
-    // move subsequent lines up one
-    Line **src = fp->lines + view->cur.line + 1;
-    Line **dest = fp->lines + view->cur.line;
-    memmove(dest, src, (fp->len - (view->cur.line + 1)) * sizeof(Line *));
-
-    // update length
-    fp->len -= 1;
-
-    // update the line numbers of subsequent lines
-    for (size_t i = view->cur.line; i < fp->len; i++) {
-        fp->lines[i]->num -= 1;
-    }
-
-    // shorten lines array
-    Line **tmp = realloc(fp->lines,  fp->len * sizeof(Line *));
-    if (tmp != NULL) {
-        fp->lines = tmp;
-    } else {
-        fprintf(stderr, "Error reallocating space for new line.\n");
-        exit(EXIT_FAILURE);
-    }
+    remove_line(fp, view->cur.line);
 
     move_up(*fp, view, ms);
     move_to_char(*fp, view, ms, prev_line_len_before_combining);
@@ -134,44 +98,23 @@ void combine_line_with_prev(FileProxy *fp, View *view, MimState ms) {
  * @return the new cursor position after combining
  */
 void combine_line_with_next(FileProxy *fp, View *view, MimState ms) {
-    if (view->cur.line == fp->len - 1) {
+    if (!wait_for_line(*fp, view->cur.line + 1)) {
         return;
     }
 
     // move text
-    Line *cur_line = fp->lines[view->cur.line];
-    Line *next_line = fp->lines[view->cur.line+1];
+    Line *cur_line = get_line(*fp, view->cur.line);
+    Line *next_line = get_line(*fp, view->cur.line+1);
     size_t cur_line_len_before_combining = cur_line->len;
     if (next_line->len > 0) {
         // add the text from the next line to the current line
         check_and_realloc_line(cur_line, next_line->len);
-        strcpy(cur_line->text + cur_line->len, next_line->text);
+        memcpy(cur_line->text + cur_line->len, next_line->text, next_line->len * byte);
         cur_line->len += next_line->len;
+        cur_line->text[cur_line->len] = '\0';
+        mark_line_dirty(*fp, view->cur.line);
     }
-
-    // move lines after next line up one
-    if (view->cur.line < fp->len - 2) {
-        Line **src = fp->lines + view->cur.line + 2;
-        Line **dest = fp->lines + view->cur.line + 1;
-        memmove(dest, src, (fp->len - (view->cur.line + 2)) * sizeof(Line *));
-    }
-
-    // update length
-    fp->len -= 1;
-
-    // update the line numbers of subsequent lines
-    for (size_t i = view->cur.line + 1; i < fp->len; i++) {
-        fp->lines[i]->num -= 1;
-    }
-
-    // shorten lines array
-    Line **tmp = realloc(fp->lines,  fp->len * sizeof(Line *));
-    if (tmp != NULL) {
-        fp->lines = tmp;
-    } else {
-        fprintf(stderr, "Error reallocating space for new line.\n");
-        exit(EXIT_FAILURE);
-    }
+    remove_line(fp, view->cur.line + 1);
 
     move_to_char(*fp, view, ms, cur_line_len_before_combining);
 }
@@ -190,38 +133,47 @@ void backspace(FileProxy *fp, View *view, MimState ms) {
         return;
     }
 
-    Line *line = fp->lines[view->cur.line];
-    check_and_realloc_line(line, -1);
+    Line *line = get_line(*fp, view->cur.line);
+    // the char before the cursor can be more than one byte
+    size_t char_len = view->cur.ch - prev_ch(line, view->cur.ch);
+    check_and_realloc_line(line, -char_len);
 
-    // move every char from cursor onwards left 1
+    // move every char from cursor onwards left
     char *src = line->text + view->cur.ch;
-    char *dest = src - 1;
+    char *dest = src - char_len;
     memmove(dest, src, (line->len - view->cur.ch + 1) * byte); // +1 for \0
     
     // update length
-    line->len -= 1;
+    line->len -= char_len;
+    mark_line_dirty(*fp, view->cur.line);
     
     // move cursor
-    move_left(*fp, view);
+    view->cur.ch -= char_len;
+    move_to_char(*fp, view, ms, view->cur.ch);
 }
 
 void delete_char(FileProxy *fp, View *view, MimState ms) {
-    Line *line = fp->lines[view->cur.line];
+    Line *line = get_line(*fp, view->cur.line);
     if (view->cur.ch == line->len) {
         combine_line_with_next(fp, view, ms);
         return;
     }
 
-    check_and_realloc_line(line, - 1);
+    // the char under the cursor can be more than one byte
+    size_t char_len = next_ch(line, view->cur.ch) - view->cur.ch;
+    check_and_realloc_line(line, -char_len);
 
-    // move every char from char after cursor onwards left 1
-    char *src = line->text + view->cur.ch + 1;
-    char *dest = src - 1;
-    // +1 for converting 0-indexed cur_ch to 1-indexed len, +1 for \0
-    memmove(dest, src, (line->len - (view->cur.ch + 1) + 1) * byte); 
+    // move every char from char after cursor onwards left
+    char *src = line->text + view->cur.ch + char_len;
+    char *dest = src - char_len;
+    // +1 for \0
+    memmove(dest, src, (line->len - (view->cur.ch + char_len) + 1) * byte); 
     
     // update length
-    line->len -= 1;
+    line->len -= char_len;
+    mark_line_dirty(*fp, view->cur.line);
+    // the line can take up fewer rows now
+    pan(*fp, view);
 }
 
 /**
@@ -232,53 +184,105 @@ void delete_char(FileProxy *fp, View *view, MimState ms) {
  * @return the new view with the cursor at the beginning of the new line
  */
 void insert_newline(FileProxy *fp, View *view, MimState ms) {
-    // make space for a new line
-    Line **tmp = realloc(fp->lines,  (fp->len + 1) * sizeof(Line *));
-    if (tmp != NULL) {
-        fp->lines = tmp;
-    } else {
-        fprintf(stderr, "Error reallocating space for new line.\n");
-        exit(EXIT_FAILURE);
-    }
-
-    // if we aren't on the last line
-    if (view->cur.line != fp->len - 1) {
-        // move every line after the current down 1
-        Line **src = fp->lines + view->cur.line + 1;
-        Line **dest = fp->lines + view->cur.line + 2;
-        memmove(dest, src, (fp->len - (view->cur.line + 1)) * sizeof(Line *));
-    }
-
-    // update length
-    fp->len += 1;
-
-    // insert new line
-    fp->lines[view->cur.line+1] = create_line(view->cur.line + 1);
-
-    // update the line numbers of each subsequent line
-    for (size_t i = view->cur.line + 2; i < fp->len; i++) {
-        fp->lines[i]->num += 1;
-    }
+    insert_line(fp, view->cur.line + 1, create_line(*fp));
 
     // move text
-    Line *cur_line = fp->lines[view->cur.line];
-    Line *new_line = fp->lines[view->cur.line+1];
+    Line *cur_line = get_line(*fp, view->cur.line);
+    Line *new_line = get_line(*fp, view->cur.line+1);
     size_t text_to_eol_len = cur_line->len - view->cur.ch;
 
     // add the text from cursor to eol to the new line including indent
     size_t indent_len = get_len_ws_beginning(*cur_line);
     check_and_realloc_line(new_line, text_to_eol_len + indent_len);
-    strncpy(new_line->text, cur_line->text, indent_len); // add indent
-    strcpy(new_line->text + indent_len, cur_line->text + view->cur.ch); // add rest of text
+    memcpy(new_line->text, cur_line->text, indent_len * byte); // add indent
+    // add rest of text
+    memcpy(new_line->text + indent_len, cur_line->text + view->cur.ch, text_to_eol_len * byte);
     new_line->len += text_to_eol_len + indent_len;
+    new_line->text[new_line->len] = '\0';
+    mark_line_dirty(*fp, view->cur.line + 1);
 
     // remove the text from cursor to eol
     check_and_realloc_line(cur_line, -text_to_eol_len);
     cur_line->len -= text_to_eol_len;
     cur_line->text[cur_line->len] = '\0';
+    mark_line_dirty(*fp, view->cur.line);
 
     // move to new line
     move_down(*fp, view, ms);
     move_to_bol_non_ws(*fp, view, ms);
 }
 
+
+/**
+ * Inserts a block of text at the cursor and moves the cursor to the end of it.
+ * Unlike typing the text, new lines aren't auto indented and all of them are
+ * inserted into the FileProxy at once, so this is used for pasting.
+ *
+ * @param fp the FileProxy to edit
+ * @param view the current View
+ * @param text the text to insert. \n starts a new line.
+ * @param len the length of the text
+ */
+void insert_text(FileProxy *fp, View *view, MimState ms, const char *text, size_t len) {
+    Line *cur_line = get_line(*fp, view->cur.line);
+    size_t ch = view->cur.ch < cur_line->len ? view->cur.ch : cur_line->len;
+    const char *first_nl = memchr(text, '\n', len);
+    if (first_nl == NULL) {
+        check_and_realloc_line(cur_line, len);
+        memmove(cur_line->text + ch + len, cur_line->text + ch, (cur_line->len - ch + 1) * byte); // +1 for \0
+        memcpy(cur_line->text + ch, text, len * byte);
+        cur_line->len += len;
+        mark_line_dirty(*fp, view->cur.line);
+
+        view->cur_desired_col = get_col(*fp, cur_line, ch + len);
+        move_to_line(*fp, view, ms, view->cur.line);
+        return;
+    }
+
+    size_t num_new_lines = 0;
+    for (const char *nl = first_nl; nl != NULL; nl = memchr(nl + 1, '\n', text + len - nl - 1)) {
+        num_new_lines++;
+    }
+    Line **new_lines = malloc(num_new_lines * sizeof(Line *));
+    if (new_lines == NULL) {
+        fprintf(stderr, "Error allocating space for lines.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // the text after the cursor ends up after the last line of the text
+    size_t text_to_eol_len = cur_line->len - ch;
+    const char *seg = first_nl + 1;
+    size_t seg_len = 0;
+    for (size_t i = 0; i < num_new_lines; i++) {
+        const char *seg_end = memchr(seg, '\n', text + len - seg);
+        seg_len = seg_end == NULL ? (size_t) (text + len - seg) : (size_t) (seg_end - seg);
+        size_t extra_len = i == num_new_lines - 1 ? text_to_eol_len : 0;
+
+        Line *new_line = create_line(*fp);
+        check_and_realloc_line(new_line, seg_len + extra_len);
+        memcpy(new_line->text, seg, seg_len * byte);
+        memcpy(new_line->text + seg_len, cur_line->text + ch, extra_len * byte);
+        new_line->len = seg_len + extra_len;
+        new_line->text[new_line->len] = '\0';
+        new_lines[i] = new_line;
+        if (seg_end != NULL) {
+            seg = seg_end + 1;
+        }
+    }
+
+    // replace the text from cursor to eol with the first line of the text
+    size_t first_len = first_nl - text;
+    check_and_realloc_line(cur_line, first_len - text_to_eol_len);
+    memcpy(cur_line->text + ch, text, first_len * byte);
+    cur_line->len = ch + first_len;
+    cur_line->text[cur_line->len] = '\0';
+    mark_line_dirty(*fp, view->cur.line);
+
+    insert_lines(fp, view->cur.line + 1, new_lines, num_new_lines);
+    free(new_lines);
+
+    // move to where the text ends
+    Line *last_line = get_line(*fp, view->cur.line + num_new_lines);
+    view->cur_desired_col = get_col(*fp, last_line, seg_len);
+    move_to_line(*fp, view, ms, view->cur.line + num_new_lines);
+}
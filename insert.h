@@ -20,4 +20,6 @@ void delete_char(FileProxy *fp, View *view, MimState ms);
 
 void insert_newline(FileProxy *fp, View *view, MimState ms);
 
+void insert_text(FileProxy *fp, View *view, MimState ms, const char *text, size_t len);
+
 #endif
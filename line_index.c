@@ -0,0 +1,137 @@
+/**
+ * @file line_index.c
+ * @author Willow Rimlinger
+ *
+ * Finds where the lines in a buffer begin. The newlines are searched for with
+ * SIMD instructions when the CPU has them.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "types.h"
+#include "line_index.h"
+#include "cpu.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// the most bytes any of the scanners looks at in one step
+static const size_t BLOCK_LEN = 64;
+
+/**
+ * Makes sure there is room for at least a block's worth of lines in an index
+ * so the scanners don't need to check on every newline.
+ *
+ * @param index the index to grow
+ * @param hint the number of bytes left to scan, used to guess the final size
+ */
+static void reserve_block(LineIndex *index, size_t hint) {
+    if (index->len + BLOCK_LEN <= index->cap) {
+        return;
+    }
+    // guess one line every 32 bytes but at least double
+    size_t cap = index->len + BLOCK_LEN + hint / 32;
+    if (cap < index->cap * 2) {
+        cap = index->cap * 2;
+    }
+    LineSlot *tmp = realloc(index->slots, cap * sizeof(LineSlot));
+    if (tmp == NULL) {
+        fprintf(stderr, "Error allocating space for lines.\n");
+        exit(EXIT_FAILURE);
+    }
+    index->slots = tmp;
+    index->cap = cap;
+}
+
+/**
+ * Records a line for every set bit in a mask of the newlines in a block.
+ *
+ * @param index the index to add to. must have room for the block.
+ * @param mask bit i is set if the byte at off + i is a \n
+ * @param off the offset of the block in the buffer
+ */
+static inline void add_mask(LineIndex *index, uint64_t mask, size_t off) {
+    LineSlot *slots = index->slots;
+    size_t len = index->len;
+    while (mask != 0) {
+        LineSlot slot = {NULL, off + __builtin_ctzll(mask) + 1};
+        slots[len++] = slot;
+        mask &= mask - 1;
+    }
+    index->len = len;
+}
+
+/** Scans a buffer with memchr. Used for what's left after the blocks and on CPUs without SIMD. */
+static void index_lines_scalar(LineIndex *index, const char *buffer, size_t beg, size_t end) {
+    const char *cur = buffer + beg;
+    const char *buf_end = buffer + end;
+    while (cur < buf_end) {
+        const char *nl = memchr(cur, '\n', buf_end - cur);
+        if (nl == NULL) {
+            break;
+        }
+        reserve_block(index, buf_end - nl);
+        LineSlot slot = {NULL, nl - buffer + 1};
+        index->slots[index->len++] = slot;
+        cur = nl + 1;
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+
+static size_t index_lines_sse2(LineIndex *index, const char *buffer, size_t beg, size_t end) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t off = beg;
+    for (; off + BLOCK_LEN <= end; off += BLOCK_LEN) {
+        const __m128i *block = (const __m128i *) (buffer + off);
+        uint64_t m0 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(block), nl));
+        uint64_t m1 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(block + 1), nl));
+        uint64_t m2 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(block + 2), nl));
+        uint64_t m3 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(block + 3), nl));
+        uint64_t mask = m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+        if (mask != 0) {
+            reserve_block(index, end - off);
+            add_mask(index, mask, off);
+        }
+    }
+    return off;
+}
+
+__attribute__((target("avx2")))
+static size_t index_lines_avx2(LineIndex *index, const char *buffer, size_t beg, size_t end) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t off = beg;
+    for (; off + BLOCK_LEN <= end; off += BLOCK_LEN) {
+        const __m256i *block = (const __m256i *) (buffer + off);
+        uint32_t m0 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(block), nl));
+        uint32_t m1 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(block + 1), nl));
+        uint64_t mask = (uint64_t) m0 | ((uint64_t) m1 << 32);
+        if (mask != 0) {
+            reserve_block(index, end - off);
+            add_mask(index, mask, off);
+        }
+    }
+    return off;
+}
+
+#endif
+
+void index_lines(LineIndex *index, const char *buffer, size_t beg, size_t end) {
+    if (beg >= end) {
+        return;
+    }
+    size_t off = beg;
+#ifdef HAVE_X86_SIMD
+    if (has_avx2()) {
+        off = index_lines_avx2(index, buffer, beg, end);
+    } else {
+        off = index_lines_sse2(index, buffer, beg, end);
+    }
+#endif
+    index_lines_scalar(index, buffer, off, end);
+}
+
@@ -0,0 +1,38 @@
+/**
+ * @file line_index.h
+ * @author Willow Rimlinger
+ *
+ * Header for line_index.c
+ *
+ * Finds where the lines in a buffer begin. The newlines are searched for with
+ * SIMD instructions when the CPU has them.
+ */
+
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include <stdlib.h>
+
+#include "types.h"
+
+/** A growable array of the LineSlots of the lines found in a buffer */
+typedef struct LineIndex_s {
+    LineSlot *slots;
+    size_t len;
+    size_t cap;
+} LineIndex;
+
+/**
+ * Records the beginning of every line that follows a \n in a part of a buffer
+ * as a LineSlot at the end of a LineIndex. Each slot's offset is relative to
+ * the beginning of the buffer.
+ *
+ * @param index the LineIndex to add the lines to
+ * @param buffer the text buffer to search
+ * @param beg the offset in the buffer to start searching at
+ * @param end the offset in the buffer to stop searching at (exclusive)
+ */
+void index_lines(LineIndex *index, const char *buffer, size_t beg, size_t end);
+
+#endif
+
@@ -0,0 +1,884 @@
+/**
+ * @file line_tree.c
+ * @author Willow Rimlinger
+ *
+ * A balanced tree of blocks of LineSlots that can be indexed by line number.
+ * Every node knows how many lines are below it, so line numbers are implicit
+ * and inserting or removing a line costs O(log n) no matter where it is.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "types.h"
+#include "line_tree.h"
+
+// the most slots in a leaf or children in an inner node
+#define NODE_MAX 64
+// nodes with fewer than this many entries are merged with a sibling
+static const size_t NODE_MIN = NODE_MAX / 4;
+// splicing in at least this many slots builds them into nodes of their own
+// rather than inserting them one at a time
+static const size_t SPLICE_BUILD_LEN = NODE_MAX;
+
+/** A node in a LineTree. Leaves hold slots and inner nodes hold other nodes. */
+typedef struct LineNode_s {
+    struct LineNode_s *parent;
+    // leaves are linked in order so that they can be walked without the parents
+    struct LineNode_s *prev;
+    struct LineNode_s *next;
+    // the number of lines in this node and all of the nodes below it
+    size_t count;
+    // the number of screen rows the lines in this node take up. See tree_set_rows.
+    size_t rows;
+    // the number of matches in the lines in this node. See tree_set_matches.
+    size_t matches;
+    // the number of slots or children in this node
+    size_t len;
+    bool leaf;
+    union {
+        struct {
+            struct LineNode_s *children[NODE_MAX];
+            // ends[i] is the number of lines in children 0 through i, so the
+            // child holding a line can be found with a binary search
+            size_t ends[NODE_MAX];
+            // the same for rows
+            size_t row_ends[NODE_MAX];
+            // and for matches
+            size_t match_ends[NODE_MAX];
+        };
+        struct {
+            LineSlot slots[NODE_MAX];
+            uint32_t slot_rows[NODE_MAX];
+            uint32_t slot_matches[NODE_MAX];
+        };
+    };
+} LineNode;
+
+struct LineTree_s {
+    LineNode *root;
+    // the last leaf that was looked up and the number of its first line.
+    // lookups nearby, like walking the lines on screen, start from here.
+    LineNode *hint;
+    size_t hint_beg;
+};
+
+static LineNode *create_node(bool leaf) {
+    LineNode *node = malloc(sizeof(LineNode));
+    if (node == NULL) {
+        fprintf(stderr, "Error allocating space for lines.\n");
+        exit(EXIT_FAILURE);
+    }
+    node->parent = NULL;
+    node->prev = NULL;
+    node->next = NULL;
+    node->count = 0;
+    node->rows = 0;
+    node->matches = 0;
+    node->len = 0;
+    node->leaf = leaf;
+    return node;
+}
+
+/**
+ * Finds the first child of an inner node that ends after a line or row.
+ *
+ * @param ends the ends or row_ends of the node
+ * @param len the number of children
+ * @param target the line or row relative to the beginning of the node
+ * @return the index of the child. the last child if target is past the end.
+ */
+static size_t find_child(const size_t *ends, size_t len, size_t target) {
+    size_t lo = 0;
+    size_t hi = len - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (ends[mid] > target) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Finds the leaf that holds a line by going down from the root.
+ *
+ * @param tree the tree to search
+ * @param line_num the line to find. may be the number of lines in the tree.
+ * @param idx set to the index of the line in the leaf
+ * @param beg set to the number of the first line in the leaf
+ * @return the leaf
+ */
+static LineNode *descend(const LineTree *tree, size_t line_num, size_t *idx, size_t *beg) {
+    LineNode *node = tree->root;
+    *beg = 0;
+    while (!node->leaf) {
+        size_t i = find_child(node->ends, node->len, line_num - *beg);
+        if (i > 0) {
+            *beg += node->ends[i - 1];
+        }
+        node = node->children[i];
+    }
+    *idx = line_num - *beg;
+    return node;
+}
+
+/**
+ * Finds the leaf that holds a line, starting from the leaf of the last lookup.
+ *
+ * @param tree the tree to search
+ * @param line_num the line to find. may be the number of lines in the tree, in
+ *     which case the last leaf is found.
+ * @param idx set to the index of the line in the leaf
+ * @return the leaf
+ */
+static LineNode *find_leaf(LineTree *tree, size_t line_num, size_t *idx) {
+    // check the leaf from the last lookup and its neighbors first
+    LineNode *hint = tree->hint;
+    if (hint != NULL) {
+        if (line_num >= tree->hint_beg + hint->len && hint->next != NULL
+                && line_num < tree->hint_beg + hint->len + hint->next->len) {
+            tree->hint_beg += hint->len;
+            tree->hint = hint = hint->next;
+        } else if (line_num < tree->hint_beg && hint->prev != NULL
+                && line_num >= tree->hint_beg - hint->prev->len) {
+            tree->hint_beg -= hint->prev->len;
+            tree->hint = hint = hint->prev;
+        }
+        if (line_num >= tree->hint_beg && line_num < tree->hint_beg + hint->len) {
+            *idx = line_num - tree->hint_beg;
+            return hint;
+        }
+    }
+
+    size_t beg;
+    LineNode *node = descend(tree, line_num, idx, &beg);
+    tree->hint = node;
+    tree->hint_beg = beg;
+    return node;
+}
+
+static size_t index_in_parent(LineNode *node) {
+    LineNode *parent = node->parent;
+    size_t i = 0;
+    while (parent->children[i] != node) {
+        i++;
+    }
+    return i;
+}
+
+/** Recalculates the ends of the children of an inner node */
+static void update_ends(LineNode *node) {
+    size_t end = 0;
+    size_t row_end = 0;
+    size_t match_end = 0;
+    for (size_t i = 0; i < node->len; i++) {
+        end += node->children[i]->count;
+        node->ends[i] = end;
+        row_end += node->children[i]->rows;
+        node->row_ends[i] = row_end;
+        match_end += node->children[i]->matches;
+        node->match_ends[i] = match_end;
+    }
+}
+
+/** Adds to the line, row and match counts of a node and every node above it */
+static void add_count(LineNode *node, long delta, long row_delta, long match_delta) {
+    node->count += delta;
+    node->rows += row_delta;
+    node->matches += match_delta;
+    for (LineNode *parent = node->parent; parent != NULL; parent = parent->parent) {
+        for (size_t i = index_in_parent(node); i < parent->len; i++) {
+            parent->ends[i] += delta;
+            parent->row_ends[i] += row_delta;
+            parent->match_ends[i] += match_delta;
+        }
+        parent->count += delta;
+        parent->rows += row_delta;
+        parent->matches += match_delta;
+        node = parent;
+    }
+}
+
+/** The number of lines that an entry of a node holds */
+static size_t entry_count(LineNode *node, size_t i) {
+    return node->leaf ? 1 : node->children[i]->count;
+}
+
+/** The number of rows that an entry of a node takes up */
+static size_t entry_rows(LineNode *node, size_t i) {
+    return node->leaf ? node->slot_rows[i] : node->children[i]->rows;
+}
+
+/** The number of matches in an entry of a node */
+static size_t entry_matches(LineNode *node, size_t i) {
+    return node->leaf ? node->slot_matches[i] : node->children[i]->matches;
+}
+
+/**
+ * Moves entries from one node to another. Both nodes must be the same kind.
+ *
+ * @param dest the node to move to
+ * @param dest_idx where in dest to put the entries
+ * @param src the node to move from
+ * @param src_idx the first entry to move
+ * @param n the number of entries to move
+ */
+static void move_entries(LineNode *dest, size_t dest_idx, LineNode *src, size_t src_idx, size_t n) {
+    size_t moved_count = 0;
+    size_t moved_rows = 0;
+    size_t moved_matches = 0;
+    for (size_t i = src_idx; i < src_idx + n; i++) {
+        moved_count += entry_count(src, i);
+        moved_rows += entry_rows(src, i);
+        moved_matches += entry_matches(src, i);
+    }
+
+    if (dest->leaf) {
+        memmove(dest->slots + dest_idx + n, dest->slots + dest_idx, (dest->len - dest_idx) * sizeof(LineSlot));
+        memcpy(dest->slots + dest_idx, src->slots + src_idx, n * sizeof(LineSlot));
+        memmove(src->slots + src_idx, src->slots + src_idx + n, (src->len - src_idx - n) * sizeof(LineSlot));
+        memmove(dest->slot_rows + dest_idx + n, dest->slot_rows + dest_idx, (dest->len - dest_idx) * sizeof(uint32_t));
+        memcpy(dest->slot_rows + dest_idx, src->slot_rows + src_idx, n * sizeof(uint32_t));
+        memmove(src->slot_rows + src_idx, src->slot_rows + src_idx + n, (src->len - src_idx - n) * sizeof(uint32_t));
+        memmove(dest->slot_matches + dest_idx + n, dest->slot_matches + dest_idx,
+                (dest->len - dest_idx) * sizeof(uint32_t));
+        memcpy(dest->slot_matches + dest_idx, src->slot_matches + src_idx, n * sizeof(uint32_t));
+        memmove(src->slot_matches + src_idx, src->slot_matches + src_idx + n,
+                (src->len - src_idx - n) * sizeof(uint32_t));
+    } else {
+        memmove(dest->children + dest_idx + n, dest->children + dest_idx, (dest->len - dest_idx) * sizeof(LineNode *));
+        memcpy(dest->children + dest_idx, src->children + src_idx, n * sizeof(LineNode *));
+        memmove(src->children + src_idx, src->children + src_idx + n, (src->len - src_idx - n) * sizeof(LineNode *));
+        for (size_t i = dest_idx; i < dest_idx + n; i++) {
+            dest->children[i]->parent = dest;
+        }
+    }
+    dest->len += n;
+    dest->count += moved_count;
+    dest->rows += moved_rows;
+    dest->matches += moved_matches;
+    src->len -= n;
+    src->count -= moved_count;
+    src->rows -= moved_rows;
+    src->matches -= moved_matches;
+    if (!dest->leaf) {
+        update_ends(dest);
+        update_ends(src);
+    }
+}
+
+/**
+ * Grows the tree a level by putting a new root above the root.
+ *
+ * @param tree the tree to grow
+ * @return the new root
+ */
+static LineNode *grow_tree(LineTree *tree) {
+    LineNode *node = tree->root;
+    LineNode *root = create_node(false);
+    root->children[0] = node;
+    root->len = 1;
+    root->count = node->count;
+    root->ends[0] = node->count;
+    root->rows = node->rows;
+    root->row_ends[0] = node->rows;
+    root->matches = node->matches;
+    root->match_ends[0] = node->matches;
+    node->parent = root;
+    tree->root = root;
+    return root;
+}
+
+static void split_node(LineTree *tree, LineNode *node);
+
+/**
+ * Splits a node in two at one of its entries, adding the new right half to its
+ * parent. The parent is split first if it is full.
+ *
+ * @param tree the tree the node is in
+ * @param node the node to split
+ * @param at the first entry to move to the right half. more than 0 and less
+ *     than the node's len.
+ * @return the right half
+ */
+static LineNode *split_node_at(LineTree *tree, LineNode *node, size_t at) {
+    LineNode *parent = node->parent;
+    if (parent == NULL) {
+        parent = grow_tree(tree);
+    } else if (parent->len == NODE_MAX) {
+        split_node(tree, parent);
+        parent = node->parent;
+    }
+
+    LineNode *right = create_node(node->leaf);
+    move_entries(right, 0, node, at, node->len - at);
+    right->parent = parent;
+    if (node->leaf) {
+        right->prev = node;
+        right->next = node->next;
+        if (node->next != NULL) {
+            node->next->prev = right;
+        }
+        node->next = right;
+    }
+
+    // the parent's count doesn't change because the lines only moved between its children
+    size_t i = index_in_parent(node);
+    memmove(parent->children + i + 2, parent->children + i + 1, (parent->len - i - 1) * sizeof(LineNode *));
+    parent->children[i + 1] = right;
+    parent->len++;
+    update_ends(parent);
+    return right;
+}
+
+/**
+ * Splits a full node in half. See split_node_at.
+ *
+ * @param tree the tree the node is in
+ * @param node the node to split
+ */
+static void split_node(LineTree *tree, LineNode *node) {
+    split_node_at(tree, node, node->len / 2);
+}
+
+/**
+ * Merges a node that has gotten too small with a sibling, or evens out their
+ * entries if they don't fit in one node. Works up the tree if the parent gets
+ * too small from the merge.
+ *
+ * @param tree the tree the node is in
+ * @param node the node that just lost entries
+ */
+static void rebalance(LineTree *tree, LineNode *node) {
+    LineNode *parent = node->parent;
+    if (parent == NULL) {
+        // the tree shrinks a level when the root only has one child
+        while (!tree->root->leaf && tree->root->len == 1) {
+            LineNode *root = tree->root;
+            tree->root = root->children[0];
+            tree->root->parent = NULL;
+            free(root);
+        }
+        return;
+    }
+    if (node->len >= NODE_MIN) {
+        return;
+    }
+    if (parent->len < 2) {
+        // there's no sibling to merge with until the parent, which is just as
+        // small, is merged with one of its own siblings or stops being the root
+        rebalance(tree, parent);
+        rebalance(tree, node);
+        return;
+    }
+
+    size_t i = index_in_parent(node);
+    size_t left_idx = i > 0 ? i - 1 : i;
+    LineNode *left = parent->children[left_idx];
+    LineNode *right = parent->children[left_idx + 1];
+
+    if (left->len + right->len <= NODE_MAX) {
+        // merge the right node into the left one
+        move_entries(left, left->len, right, 0, right->len);
+        if (left->leaf) {
+            left->next = right->next;
+            if (right->next != NULL) {
+                right->next->prev = left;
+            }
+        }
+        memmove(parent->children + left_idx + 1, parent->children + left_idx + 2,
+                (parent->len - left_idx - 2) * sizeof(LineNode *));
+        parent->len--;
+        free(right);
+        update_ends(parent);
+        rebalance(tree, parent);
+    } else if (node == right) {
+        size_t n = (left->len - right->len) / 2;
+        move_entries(right, 0, left, left->len - n, n);
+        update_ends(parent);
+    } else {
+        move_entries(left, left->len, right, 0, (right->len - left->len) / 2);
+        update_ends(parent);
+    }
+}
+
+/**
+ * Rebalances the nodes on the path from the root to a line until none of them
+ * are too small, for changes that can leave more than one small node on it.
+ *
+ * @param tree the tree to rebalance
+ * @param line_num the line whose path is rebalanced. may be the number of lines
+ *     in the tree.
+ */
+static void rebalance_path(LineTree *tree, size_t line_num) {
+    while (true) {
+        // rebalancing can free nodes on the path, so it's found again each time
+        size_t idx;
+        size_t beg;
+        LineNode *node = descend(tree, line_num, &idx, &beg);
+        while (node->parent != NULL && node->len >= NODE_MIN) {
+            node = node->parent;
+        }
+        if (node->parent == NULL && (node->leaf || node->len > 1)) {
+            return;
+        }
+        rebalance(tree, node);
+    }
+}
+
+/**
+ * Adds an empty node to the right of the last node on its level, adding a new
+ * parent for it if the parent is full.
+ *
+ * @param tree the tree the node is in
+ * @param node the last node on its level
+ * @param sibling the empty node to add
+ */
+static void add_last_sibling(LineTree *tree, LineNode *node, LineNode *sibling) {
+    LineNode *parent = node->parent;
+    if (parent == NULL) {
+        // the root is full, so the tree grows a level
+        parent = grow_tree(tree);
+    } else if (parent->len == NODE_MAX) {
+        LineNode *new_parent = create_node(false);
+        add_last_sibling(tree, parent, new_parent);
+        parent = new_parent;
+    }
+    parent->children[parent->len] = sibling;
+    parent->ends[parent->len] = parent->count;
+    parent->row_ends[parent->len] = parent->rows;
+    parent->match_ends[parent->len] = parent->matches;
+    parent->len++;
+    sibling->parent = parent;
+}
+
+static void free_node(LineNode *node) {
+    if (!node->leaf) {
+        for (size_t i = 0; i < node->len; i++) {
+            free_node(node->children[i]);
+        }
+    }
+    free(node);
+}
+
+/**
+ * Builds the nodes of a tree out of an array of LineSlots in O(n).
+ *
+ * @param slots the slots to put in the tree, in order
+ * @param rows the number of rows each slot takes up. NULL if they all take up 1.
+ * @param matches the number of matches in each slot. NULL if there are none.
+ * @param len the number of slots. must be at least 1.
+ * @return the root of the new nodes
+ */
+static LineNode *build_nodes(const LineSlot *slots, const uint32_t *rows, const uint32_t *matches, size_t len) {
+    // spread the slots evenly so that no leaf starts out too small
+    size_t level_len = (len + NODE_MAX - 1) / NODE_MAX;
+    LineNode **level = malloc(level_len * sizeof(LineNode *));
+    if (level == NULL) {
+        fprintf(stderr, "Error allocating space for lines.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < level_len; i++) {
+        size_t beg = i * len / level_len;
+        size_t end = (i + 1) * len / level_len;
+        LineNode *leaf = create_node(true);
+        memcpy(leaf->slots, slots + beg, (end - beg) * sizeof(LineSlot));
+        leaf->len = end - beg;
+        leaf->count = end - beg;
+        for (size_t j = 0; j < leaf->len; j++) {
+            leaf->slot_rows[j] = rows == NULL ? 1 : rows[beg + j];
+            leaf->rows += leaf->slot_rows[j];
+            leaf->slot_matches[j] = matches == NULL ? 0 : matches[beg + j];
+            leaf->matches += leaf->slot_matches[j];
+        }
+        if (i > 0) {
+            leaf->prev = level[i - 1];
+            level[i - 1]->next = leaf;
+        }
+        level[i] = leaf;
+    }
+
+    // build each level of inner nodes on top of the one below it
+    while (level_len > 1) {
+        size_t parents_len = (level_len + NODE_MAX - 1) / NODE_MAX;
+        for (size_t i = 0; i < parents_len; i++) {
+            size_t beg = i * level_len / parents_len;
+            size_t end = (i + 1) * level_len / parents_len;
+            LineNode *parent = create_node(false);
+            for (size_t j = beg; j < end; j++) {
+                parent->children[parent->len++] = level[j];
+                parent->count += level[j]->count;
+                parent->ends[parent->len - 1] = parent->count;
+                parent->rows += level[j]->rows;
+                parent->row_ends[parent->len - 1] = parent->rows;
+                parent->matches += level[j]->matches;
+                parent->match_ends[parent->len - 1] = parent->matches;
+                level[j]->parent = parent;
+            }
+            level[i] = parent;
+        }
+        level_len = parents_len;
+    }
+
+    LineNode *root = level[0];
+    free(level);
+    return root;
+}
+
+LineTree *build_tree(const LineSlot *slots, size_t len) {
+    LineTree *tree = malloc(sizeof(LineTree));
+    if (tree == NULL) {
+        fprintf(stderr, "Error allocating space for lines.\n");
+        exit(EXIT_FAILURE);
+    }
+    tree->root = build_nodes(slots, NULL, NULL, len);
+    tree->hint = NULL;
+    tree->hint_beg = 0;
+    return tree;
+}
+
+size_t tree_len(LineTree *tree) {
+    return tree->root->count;
+}
+
+LineSlot *tree_get(LineTree *tree, size_t line_num) {
+    size_t idx;
+    LineNode *leaf = find_leaf(tree, line_num, &idx);
+    return &leaf->slots[idx];
+}
+
+void tree_insert(LineTree *tree, size_t line_num, LineSlot slot) {
+    size_t idx;
+    LineNode *leaf = find_leaf(tree, line_num, &idx);
+    if (leaf->len == NODE_MAX) {
+        split_node(tree, leaf);
+        tree->hint = NULL;
+        leaf = find_leaf(tree, line_num, &idx);
+    }
+    memmove(leaf->slots + idx + 1, leaf->slots + idx, (leaf->len - idx) * sizeof(LineSlot));
+    memmove(leaf->slot_rows + idx + 1, leaf->slot_rows + idx, (leaf->len - idx) * sizeof(uint32_t));
+    memmove(leaf->slot_matches + idx + 1, leaf->slot_matches + idx, (leaf->len - idx) * sizeof(uint32_t));
+    leaf->slots[idx] = slot;
+    leaf->slot_rows[idx] = 1;
+    leaf->slot_matches[idx] = 0;
+    leaf->len++;
+    add_count(leaf, 1, 1, 0);
+    tree->hint = NULL;
+}
+
+void tree_append(LineTree *tree, const LineSlot *slots, size_t len) {
+    tree->hint = NULL;
+    LineNode *leaf = tree->root;
+    while (!leaf->leaf) {
+        leaf = leaf->children[leaf->len - 1];
+    }
+    while (len > 0) {
+        // fill the last leaf and then start new ones instead of splitting it
+        if (leaf->len == NODE_MAX) {
+            LineNode *new_leaf = create_node(true);
+            add_last_sibling(tree, leaf, new_leaf);
+            new_leaf->prev = leaf;
+            leaf->next = new_leaf;
+            leaf = new_leaf;
+        }
+        size_t n = NODE_MAX - leaf->len < len ? NODE_MAX - leaf->len : len;
+        memcpy(leaf->slots + leaf->len, slots, n * sizeof(LineSlot));
+        for (size_t i = leaf->len; i < leaf->len + n; i++) {
+            leaf->slot_rows[i] = 1;
+            leaf->slot_matches[i] = 0;
+        }
+        leaf->len += n;
+        add_count(leaf, n, n, 0);
+        slots += n;
+        len -= n;
+    }
+    // the last nodes on each level can be left small, like the parents that
+    // add_last_sibling starts with one child
+    rebalance_path(tree, tree_len(tree) - 1);
+}
+
+/** The number of levels of nodes below a node */
+static size_t node_height(const LineNode *node) {
+    size_t height = 0;
+    for (; !node->leaf; node = node->children[0]) {
+        height++;
+    }
+    return height;
+}
+
+/**
+ * Puts nodes built by build_nodes into the tree before a line. The nodes on
+ * the line's path are split where the line starts, up to the level above the
+ * new nodes, and the new nodes go in between, so only the nodes on the path
+ * change.
+ *
+ * @param tree the tree to add to
+ * @param line_num the line to add before. less than the number of lines.
+ * @param sub the root of the new nodes
+ */
+static void splice_nodes(LineTree *tree, size_t line_num, LineNode *sub) {
+    size_t height = node_height(sub);
+    size_t beg;
+    size_t pos;
+    LineNode *node = descend(tree, line_num, &pos, &beg);
+    // the first leaf that goes after the new ones
+    LineNode *next_leaf = NULL;
+    // split each level so line_num starts a node, which is where the new ones go
+    for (size_t level = 0; level <= height; level++) {
+        LineNode *right = node;
+        if (pos > 0) {
+            right = split_node_at(tree, node, pos);
+        } else if (node->parent == NULL) {
+            grow_tree(tree);
+        }
+        if (level == 0) {
+            next_leaf = right;
+        }
+        node = right->parent;
+        pos = index_in_parent(right);
+    }
+
+    if (node->len == NODE_MAX) {
+        split_node(tree, node);
+        if (pos > node->len) {
+            pos -= node->len;
+            node = node->parent->children[index_in_parent(node) + 1];
+        }
+    }
+    memmove(node->children + pos + 1, node->children + pos, (node->len - pos) * sizeof(LineNode *));
+    node->children[pos] = sub;
+    node->len++;
+    sub->parent = node;
+    update_ends(node);
+    add_count(node, sub->count, sub->rows, sub->matches);
+
+    LineNode *first_leaf = sub;
+    while (!first_leaf->leaf) {
+        first_leaf = first_leaf->children[0];
+    }
+    LineNode *last_leaf = sub;
+    while (!last_leaf->leaf) {
+        last_leaf = last_leaf->children[last_leaf->len - 1];
+    }
+    first_leaf->prev = next_leaf->prev;
+    if (next_leaf->prev != NULL) {
+        next_leaf->prev->next = first_leaf;
+    }
+    last_leaf->next = next_leaf;
+    next_leaf->prev = last_leaf;
+}
+
+void tree_splice(LineTree *tree, size_t line_num, const LineSlot *slots, size_t len) {
+    if (line_num == tree_len(tree)) {
+        tree_append(tree, slots, len);
+        return;
+    }
+    if (len < SPLICE_BUILD_LEN) {
+        for (size_t i = 0; i < len; i++) {
+            tree_insert(tree, line_num + i, slots[i]);
+        }
+        return;
+    }
+
+    // build the new slots into nodes of their own, which only costs as much as
+    // the new slots, and link them in along the path to line_num
+    splice_nodes(tree, line_num, build_nodes(slots, NULL, NULL, len));
+    tree->hint = NULL;
+    // the nodes split on either side of the new ones can be small
+    if (line_num > 0) {
+        rebalance_path(tree, line_num - 1);
+    }
+    rebalance_path(tree, line_num);
+    rebalance_path(tree, line_num + len);
+}
+
+void tree_remove(LineTree *tree, size_t line_num) {
+    size_t idx;
+    LineNode *leaf = find_leaf(tree, line_num, &idx);
+    long rows = leaf->slot_rows[idx];
+    long matches = leaf->slot_matches[idx];
+    memmove(leaf->slots + idx, leaf->slots + idx + 1, (leaf->len - idx - 1) * sizeof(LineSlot));
+    memmove(leaf->slot_rows + idx, leaf->slot_rows + idx + 1, (leaf->len - idx - 1) * sizeof(uint32_t));
+    memmove(leaf->slot_matches + idx, leaf->slot_matches + idx + 1, (leaf->len - idx - 1) * sizeof(uint32_t));
+    leaf->len--;
+    add_count(leaf, -1, -rows, -matches);
+    tree->hint = NULL;
+    rebalance(tree, leaf);
+}
+
+void tree_set_rows(LineTree *tree, size_t line_num, size_t rows) {
+    if (rows > UINT32_MAX) {
+        rows = UINT32_MAX;
+    }
+    size_t idx;
+    LineNode *leaf = find_leaf(tree, line_num, &idx);
+    long row_delta = (long) rows - (long) leaf->slot_rows[idx];
+    if (row_delta != 0) {
+        leaf->slot_rows[idx] = rows;
+        add_count(leaf, 0, row_delta, 0);
+    }
+}
+
+/** Recounts the rows of every line in a node and the nodes below it. See tree_set_all_rows. */
+static void set_node_rows(LineNode *node, size_t (*count_rows)(const LineSlot *, void *), void *data) {
+    node->rows = 0;
+    if (node->leaf) {
+        for (size_t i = 0; i < node->len; i++) {
+            size_t rows = count_rows(&node->slots[i], data);
+            node->slot_rows[i] = rows > UINT32_MAX ? UINT32_MAX : rows;
+            node->rows += node->slot_rows[i];
+        }
+        return;
+    }
+    for (size_t i = 0; i < node->len; i++) {
+        set_node_rows(node->children[i], count_rows, data);
+    }
+    update_ends(node);
+    node->rows = node->row_ends[node->len - 1];
+}
+
+void tree_set_all_rows(LineTree *tree, size_t (*count_rows)(const LineSlot *, void *), void *data) {
+    set_node_rows(tree->root, count_rows, data);
+}
+
+size_t tree_rows(LineTree *tree) {
+    return tree->root->rows;
+}
+
+size_t tree_row_of(LineTree *tree, size_t line_num) {
+    LineNode *node = tree->root;
+    size_t beg = 0;
+    size_t row = 0;
+    while (!node->leaf) {
+        size_t i = find_child(node->ends, node->len, line_num - beg);
+        if (i > 0) {
+            beg += node->ends[i - 1];
+            row += node->row_ends[i - 1];
+        }
+        node = node->children[i];
+    }
+    for (size_t i = 0; i < line_num - beg; i++) {
+        row += node->slot_rows[i];
+    }
+    return row;
+}
+
+size_t tree_line_at_row(LineTree *tree, size_t row, size_t *row_in_line) {
+    LineNode *node = tree->root;
+    size_t beg = 0;
+    size_t row_beg = 0;
+    while (!node->leaf) {
+        size_t i = find_child(node->row_ends, node->len, row - row_beg);
+        if (i > 0) {
+            beg += node->ends[i - 1];
+            row_beg += node->row_ends[i - 1];
+        }
+        node = node->children[i];
+    }
+    size_t i = 0;
+    while (i + 1 < node->len && row_beg + node->slot_rows[i] <= row) {
+        row_beg += node->slot_rows[i];
+        i++;
+    }
+    *row_in_line = row - row_beg < node->slot_rows[i] ? row - row_beg : node->slot_rows[i] - 1;
+    return beg + i;
+}
+
+void tree_set_matches(LineTree *tree, size_t line_num, size_t matches) {
+    if (matches > UINT32_MAX) {
+        matches = UINT32_MAX;
+    }
+    size_t idx;
+    LineNode *leaf = find_leaf(tree, line_num, &idx);
+    long match_delta = (long) matches - (long) leaf->slot_matches[idx];
+    if (match_delta != 0) {
+        leaf->slot_matches[idx] = matches;
+        add_count(leaf, 0, 0, match_delta);
+    }
+}
+
+/** Recounts the matches of every line in a node and the nodes below it. See tree_set_all_matches. */
+static void set_node_matches(LineNode *node, size_t (*count_matches)(const LineSlot *, void *), void *data) {
+    node->matches = 0;
+    if (node->leaf) {
+        for (size_t i = 0; i < node->len; i++) {
+            size_t matches = count_matches(&node->slots[i], data);
+            node->slot_matches[i] = matches > UINT32_MAX ? UINT32_MAX : matches;
+            node->matches += node->slot_matches[i];
+        }
+        return;
+    }
+    for (size_t i = 0; i < node->len; i++) {
+        set_node_matches(node->children[i], count_matches, data);
+    }
+    update_ends(node);
+    node->matches = node->match_ends[node->len - 1];
+}
+
+void tree_set_all_matches(LineTree *tree, size_t (*count_matches)(const LineSlot *, void *), void *data) {
+    set_node_matches(tree->root, count_matches, data);
+}
+
+size_t tree_matches(LineTree *tree) {
+    return tree->root->matches;
+}
+
+size_t tree_matches_before(LineTree *tree, size_t line_num) {
+    LineNode *node = tree->root;
+    size_t beg = 0;
+    size_t matches = 0;
+    while (!node->leaf) {
+        size_t i = find_child(node->ends, node->len, line_num - beg);
+        if (i > 0) {
+            beg += node->ends[i - 1];
+            matches += node->match_ends[i - 1];
+        }
+        node = node->children[i];
+    }
+    for (size_t i = 0; i < line_num - beg; i++) {
+        matches += node->slot_matches[i];
+    }
+    return matches;
+}
+
+LineIter iter_tree(LineTree *tree, size_t line_num) {
+    LineIter iter;
+    iter.leaf = find_leaf(tree, line_num, &iter.idx);
+    return iter;
+}
+
+const LineSlot *tree_get_shared(const LineTree *tree, size_t line_num) {
+    size_t idx;
+    size_t beg;
+    LineNode *leaf = descend(tree, line_num, &idx, &beg);
+    return &leaf->slots[idx];
+}
+
+LineIter iter_tree_shared(const LineTree *tree, size_t line_num) {
+    LineIter iter;
+    size_t beg;
+    iter.leaf = descend(tree, line_num, &iter.idx, &beg);
+    return iter;
+}
+
+LineSlot *iter_next(LineIter *iter) {
+    while (iter->leaf != NULL && iter->idx >= iter->leaf->len) {
+        iter->leaf = iter->leaf->next;
+        iter->idx = 0;
+    }
+    if (iter->leaf == NULL) {
+        return NULL;
+    }
+    return &iter->leaf->slots[iter->idx++];
+}
+
+void free_tree(LineTree *tree) {
+    free_node(tree->root);
+    free(tree);
+}
+
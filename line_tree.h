@@ -0,0 +1,222 @@
+/**
+ * @file line_tree.h
+ * @author Willow Rimlinger
+ *
+ * Header for line_tree.c
+ *
+ * A balanced tree of blocks of LineSlots that can be indexed by line number.
+ * Every node knows how many lines are below it, so line numbers are implicit
+ * and inserting or removing a line costs O(log n) no matter where it is.
+ */
+
+#ifndef LINE_TREE_H
+#define LINE_TREE_H
+
+#include <stdlib.h>
+
+#include "types.h"
+
+/** Walks the slots of a LineTree in order. See iter_tree. */
+typedef struct LineIter_s {
+    struct LineNode_s *leaf;
+    size_t idx;
+} LineIter;
+
+/**
+ * Builds a LineTree out of an array of LineSlots in O(n).
+ *
+ * @param slots the slots to put in the tree, in order
+ * @param len the number of slots. must be at least 1.
+ * @return the new tree
+ */
+LineTree *build_tree(const LineSlot *slots, size_t len);
+
+/**
+ * Gets the number of lines in a tree.
+ *
+ * @param tree the tree
+ * @return the number of lines
+ */
+size_t tree_len(LineTree *tree);
+
+/**
+ * Gets the slot of a line in a tree.
+ *
+ * @param tree the tree to look in
+ * @param line_num the index of the line. must be less than tree_len.
+ * @return the slot of the line. only valid until the tree is next changed.
+ */
+LineSlot *tree_get(LineTree *tree, size_t line_num);
+
+/**
+ * Inserts a slot into a tree so that it becomes line line_num.
+ *
+ * @param tree the tree to insert into
+ * @param line_num where to insert. may be tree_len to append.
+ * @param slot the slot to insert
+ */
+void tree_insert(LineTree *tree, size_t line_num, LineSlot slot);
+
+/**
+ * Appends slots to the end of a tree. Leaves are filled before new ones are
+ * added, so appending n slots costs O(n + log n).
+ *
+ * @param tree the tree to append to
+ * @param slots the slots to append, in order
+ * @param len the number of slots
+ */
+void tree_append(LineTree *tree, const LineSlot *slots, size_t len);
+
+/**
+ * Inserts a run of slots into a tree so that the first becomes line line_num.
+ * Large runs are built into nodes of their own and linked in along the path to
+ * line_num in O(len + log n) rather than inserting each slot on its own.
+ *
+ * @param tree the tree to insert into
+ * @param line_num where to insert. may be tree_len to append.
+ * @param slots the slots to insert, in order
+ * @param len the number of slots
+ */
+void tree_splice(LineTree *tree, size_t line_num, const LineSlot *slots, size_t len);
+
+/**
+ * Removes a line from a tree. The lines after it move up one.
+ *
+ * @param tree the tree to remove from
+ * @param line_num the index of the line to remove
+ */
+void tree_remove(LineTree *tree, size_t line_num);
+
+/**
+ * Sets the number of screen rows a line takes up when it is wrapped. Every line
+ * takes up one row until this is called for it. The rows of all of the lines
+ * before a line are kept summed so rows can be mapped to lines in O(log n).
+ *
+ * @param tree the tree the line is in
+ * @param line_num the line
+ * @param rows the number of rows the line takes up
+ */
+void tree_set_rows(LineTree *tree, size_t line_num, size_t rows);
+
+/**
+ * Sets the number of screen rows of every line in a tree in O(n).
+ *
+ * @param tree the tree
+ * @param count_rows called with each slot and data to count the rows of the line
+ * @param data passed to count_rows
+ */
+void tree_set_all_rows(LineTree *tree, size_t (*count_rows)(const LineSlot *, void *), void *data);
+
+/**
+ * Gets the number of screen rows all of the lines in a tree take up.
+ *
+ * @param tree the tree
+ * @return the number of rows
+ */
+size_t tree_rows(LineTree *tree);
+
+/**
+ * Gets the first screen row of a line.
+ *
+ * @param tree the tree the line is in
+ * @param line_num the line. may be tree_len to get the number of rows.
+ * @return the number of rows the lines before it take up
+ */
+size_t tree_row_of(LineTree *tree, size_t line_num);
+
+/**
+ * Finds the line that is on a screen row.
+ *
+ * @param tree the tree to look in
+ * @param row the row. the last row of the last line is used if it is past the end.
+ * @param row_in_line set to which of the line's rows it is
+ * @return the line on the row
+ */
+size_t tree_line_at_row(LineTree *tree, size_t row, size_t *row_in_line);
+
+/**
+ * Sets the number of matches of the searched for pattern in a line. Lines
+ * have none until this is called for them. Like rows, the matches of all of the
+ * lines before a line are kept summed.
+ *
+ * @param tree the tree the line is in
+ * @param line_num the line
+ * @param matches the number of matches in the line
+ */
+void tree_set_matches(LineTree *tree, size_t line_num, size_t matches);
+
+/**
+ * Sets the number of matches in every line in a tree in O(n). The lines are
+ * counted in order.
+ *
+ * @param tree the tree
+ * @param count_matches called with each slot and data to count the matches in the line
+ * @param data passed to count_matches
+ */
+void tree_set_all_matches(LineTree *tree, size_t (*count_matches)(const LineSlot *, void *), void *data);
+
+/**
+ * Gets the number of matches in all of the lines in a tree.
+ *
+ * @param tree the tree
+ * @return the number of matches
+ */
+size_t tree_matches(LineTree *tree);
+
+/**
+ * Gets the number of matches in the lines before a line.
+ *
+ * @param tree the tree the line is in
+ * @param line_num the line. may be tree_len to get every match.
+ * @return the number of matches before it
+ */
+size_t tree_matches_before(LineTree *tree, size_t line_num);
+
+/**
+ * Starts walking a tree at a line.
+ *
+ * @param tree the tree to walk
+ * @param line_num the first line to visit
+ * @return an iterator for iter_next
+ */
+LineIter iter_tree(LineTree *tree, size_t line_num);
+
+/**
+ * Gets the slot of a line like tree_get, but without remembering where it was
+ * for the next lookup. Threads may call this at the same time as long as
+ * nothing changes the tree.
+ *
+ * @param tree the tree to look in
+ * @param line_num the index of the line. must be less than tree_len.
+ * @return the slot of the line
+ */
+const LineSlot *tree_get_shared(const LineTree *tree, size_t line_num);
+
+/**
+ * Starts walking a tree at a line like iter_tree, but without remembering
+ * where it was for the next lookup. Threads may call this at the same time as
+ * long as nothing changes the tree.
+ *
+ * @param tree the tree to walk
+ * @param line_num the first line to visit
+ * @return an iterator for iter_next
+ */
+LineIter iter_tree_shared(const LineTree *tree, size_t line_num);
+
+/**
+ * Gets the next slot from a tree iterator.
+ *
+ * @param iter the iterator
+ * @return the next slot or NULL if there are no more lines
+ */
+LineSlot *iter_next(LineIter *iter);
+
+/**
+ * Frees a tree. The Lines in its slots are not freed.
+ *
+ * @param tree the tree to free
+ */
+void free_tree(LineTree *tree);
+
+#endif
+
@@ -0,0 +1,206 @@
+/**
+ * @file loader.c
+ * @author Willow Rimlinger
+ *
+ * Indexes the lines of a file on a background thread so the editor can show
+ * the first lines while the rest of the file is still being read.
+ *
+ * The loader thread publishes the LineSlots it finds into fixed size segments
+ * that are never moved, then bumps an atomic count. The editor's thread reads
+ * up to that count and appends the slots to its LineTree, so the tree is only
+ * ever touched by one thread.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "types.h"
+#include "loader.h"
+#include "line_index.h"
+#include "line_tree.h"
+
+// the number of slots in a segment
+#define SEGMENT_LEN 65536
+// the first chunk is small so the first screen is ready quickly
+static const size_t FIRST_CHUNK_LEN = 64 * 1024;
+static const size_t CHUNK_LEN = 4 * 1024 * 1024;
+
+struct Loader_s {
+    pthread_t thread;
+    const char *buffer;
+    // the length of the buffer without a trailing \n
+    size_t text_len;
+
+    // published slots. segments are allocated by the loader thread before
+    // their slots are published and freed by the editor's thread once taken.
+    LineSlot **segments;
+    atomic_size_t published;
+    atomic_size_t scanned;
+    atomic_bool done;
+    atomic_bool cancelled;
+    pthread_mutex_t mutex;
+    pthread_cond_t found;
+
+    // only used by the editor's thread
+    size_t taken;
+    bool has_thread;
+    bool finished;
+};
+
+/**
+ * Copies newly found slots into the segments and makes them visible to the
+ * editor's thread.
+ */
+static void publish(Loader *loader, const LineSlot *slots, size_t len) {
+    size_t published = atomic_load_explicit(&loader->published, memory_order_relaxed);
+    while (len > 0) {
+        size_t seg = published / SEGMENT_LEN;
+        size_t idx = published % SEGMENT_LEN;
+        if (idx == 0) {
+            loader->segments[seg] = malloc(SEGMENT_LEN * sizeof(LineSlot));
+            if (loader->segments[seg] == NULL) {
+                fprintf(stderr, "Error allocating space for lines.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        size_t n = SEGMENT_LEN - idx < len ? SEGMENT_LEN - idx : len;
+        memcpy(loader->segments[seg] + idx, slots, n * sizeof(LineSlot));
+        slots += n;
+        len -= n;
+        published += n;
+    }
+    atomic_store_explicit(&loader->published, published, memory_order_release);
+}
+
+static void signal_found(Loader *loader) {
+    pthread_mutex_lock(&loader->mutex);
+    pthread_cond_broadcast(&loader->found);
+    pthread_mutex_unlock(&loader->mutex);
+}
+
+static void *load(void *arg) {
+    Loader *loader = arg;
+    LineIndex index = {NULL, 0, 0};
+    size_t beg = 0;
+    size_t chunk_len = FIRST_CHUNK_LEN;
+    while (beg < loader->text_len && !atomic_load(&loader->cancelled)) {
+        size_t end = loader->text_len - beg < chunk_len ? loader->text_len : beg + chunk_len;
+        index.len = 0;
+        index_lines(&index, loader->buffer, beg, end);
+        publish(loader, index.slots, index.len);
+        atomic_store(&loader->scanned, end);
+        signal_found(loader);
+        beg = end;
+        chunk_len = CHUNK_LEN;
+    }
+    free(index.slots);
+    atomic_store(&loader->done, true);
+    signal_found(loader);
+    return NULL;
+}
+
+Loader *start_loader(const char *buffer, size_t buf_len) {
+    Loader *loader = malloc(sizeof(Loader));
+    if (loader == NULL) {
+        fprintf(stderr, "Error allocating space for loader.\n");
+        exit(EXIT_FAILURE);
+    }
+    // a trailing \n ends the last line rather than starting a new one
+    size_t text_len = buf_len;
+    if (text_len > 0 && buffer[text_len - 1] == '\n') {
+        text_len--;
+    }
+    loader->buffer = buffer;
+    loader->text_len = text_len;
+    // there can't be more lines than chars
+    loader->segments = calloc(text_len / SEGMENT_LEN + 1, sizeof(LineSlot *));
+    if (loader->segments == NULL) {
+        fprintf(stderr, "Error allocating space for loader.\n");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&loader->published, 0);
+    atomic_init(&loader->scanned, 0);
+    atomic_init(&loader->done, false);
+    atomic_init(&loader->cancelled, false);
+    pthread_mutex_init(&loader->mutex, NULL);
+    pthread_cond_init(&loader->found, NULL);
+    loader->taken = 0;
+    loader->finished = false;
+
+    loader->has_thread = pthread_create(&loader->thread, NULL, load, loader) == 0;
+    if (!loader->has_thread) {
+        // index the file on this thread instead
+        load(loader);
+    }
+    return loader;
+}
+
+size_t take_loaded_lines(Loader *loader, LineTree *tree, bool wait) {
+    if (loader->finished) {
+        return 0;
+    }
+
+    // check done before published so that no lines are missed if it finishes in between
+    bool done = atomic_load(&loader->done);
+    size_t published = atomic_load_explicit(&loader->published, memory_order_acquire);
+    if (wait && !done && published == loader->taken) {
+        pthread_mutex_lock(&loader->mutex);
+        while (!(done = atomic_load(&loader->done))
+                && (published = atomic_load_explicit(&loader->published, memory_order_acquire)) == loader->taken) {
+            pthread_cond_wait(&loader->found, &loader->mutex);
+        }
+        pthread_mutex_unlock(&loader->mutex);
+        published = atomic_load_explicit(&loader->published, memory_order_acquire);
+    }
+
+    size_t taken_before = loader->taken;
+    while (loader->taken < published) {
+        size_t seg = loader->taken / SEGMENT_LEN;
+        size_t idx = loader->taken % SEGMENT_LEN;
+        size_t n = SEGMENT_LEN - idx < published - loader->taken ? SEGMENT_LEN - idx : published - loader->taken;
+        tree_append(tree, loader->segments[seg] + idx, n);
+        loader->taken += n;
+        if (idx + n == SEGMENT_LEN) {
+            free(loader->segments[seg]);
+            loader->segments[seg] = NULL;
+        }
+    }
+
+    if (done) {
+        if (loader->has_thread) {
+            pthread_join(loader->thread, NULL);
+            loader->has_thread = false;
+        }
+        loader->finished = true;
+    }
+    return loader->taken - taken_before;
+}
+
+bool is_loader_finished(Loader *loader) {
+    return loader->finished;
+}
+
+int get_load_percent(Loader *loader) {
+    if (loader->text_len == 0) {
+        return 100;
+    }
+    return atomic_load(&loader->scanned) * 100 / loader->text_len;
+}
+
+void stop_loader(Loader *loader) {
+    if (loader->has_thread) {
+        atomic_store(&loader->cancelled, true);
+        pthread_join(loader->thread, NULL);
+    }
+    size_t published = atomic_load(&loader->published);
+    for (size_t seg = loader->taken / SEGMENT_LEN; seg * SEGMENT_LEN < published; seg++) {
+        free(loader->segments[seg]);
+    }
+    free(loader->segments);
+    pthread_mutex_destroy(&loader->mutex);
+    pthread_cond_destroy(&loader->found);
+    free(loader);
+}
+
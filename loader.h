@@ -0,0 +1,64 @@
+/**
+ * @file loader.h
+ * @author Willow Rimlinger
+ *
+ * Header for loader.c
+ *
+ * Indexes the lines of a file on a background thread so the editor can show
+ * the first lines while the rest of the file is still being read.
+ */
+
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/**
+ * Starts indexing the lines of a buffer on a background thread. The first line
+ * always begins at offset 0, so only the lines after it are found.
+ *
+ * @param buffer the text to index. must stay valid until the loader is freed.
+ * @param buf_len the length of the buffer
+ * @return the new loader
+ */
+Loader *start_loader(const char *buffer, size_t buf_len);
+
+/**
+ * Appends the lines the loader has found since the last call to the end of a
+ * tree. Only call this from the thread that owns the tree.
+ *
+ * @param loader the loader to take lines from
+ * @param tree the tree to append to
+ * @param wait whether to block until at least one line is found or the
+ *     loader finishes if no new lines are ready
+ * @return the number of lines appended
+ */
+size_t take_loaded_lines(Loader *loader, LineTree *tree, bool wait);
+
+/**
+ * Checks whether every line of the buffer has been taken.
+ *
+ * @param loader the loader
+ * @return true if there are no lines left to take
+ */
+bool is_loader_finished(Loader *loader);
+
+/**
+ * Gets how much of the buffer the loader has indexed so far.
+ *
+ * @param loader the loader
+ * @return the percent of the buffer that has been indexed
+ */
+int get_load_percent(Loader *loader);
+
+/**
+ * Stops a loader if it is still running and frees it.
+ *
+ * @param loader the loader to stop
+ */
+void stop_loader(Loader *loader);
+
+#endif
+
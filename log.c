@@ -3,46 +3,259 @@
  * @author Max Rimlinger
  *
  * Functions to log info to a log file
+ *
+ * Messages are formatted straight into the slots of a ring buffer. Any thread
+ * can claim a slot by bumping the head with a compare and swap, and marks it
+ * ready through its sequence number once the message is in it. The flush
+ * thread takes ready slots in order, adds the timestamp and writes them to the
+ * log file in batches. Nothing waits on a lock: when the ring is full, new
+ * messages are counted and dropped instead.
  */
 
 #include <stdio.h>
-#include <time.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdarg.h>
+#include <strings.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "types.h"
+#include "log.h"
+
+// the number of slots in the ring. must be a power of 2.
+#define NUM_SLOTS 4096
+// the most bytes of a message that are kept
+#define SLOT_TEXT_LEN 240
+// how long the flush thread sleeps when the ring is empty
+static const long FLUSH_INTERVAL_NS = 20 * 1000 * 1000;
+// how many bytes the flush thread formats before writing them
+#define WRITE_BUF_LEN (64 * 1024)
+
+static const char *LEVEL_NAMES[] = {"debug", "info", "warn", "error", "off"};
+
+/** A message in the ring */
+typedef struct LogSlot_s {
+    // the slot can be claimed when this is the position being claimed and is
+    // ready to be written out when it is one past it
+    atomic_size_t seq;
+    LogLevel level;
+    struct timespec time;
+    size_t len;
+    char text[SLOT_TEXT_LEN];
+} LogSlot;
+
+/** The ring and the thread that empties it */
+typedef struct Log_s {
+    LogSlot *slots;
+    // the position of the next slot to claim
+    atomic_size_t head;
+    // the position of the next slot to write out. only used by the flush thread.
+    size_t tail;
+    atomic_size_t dropped;
+    atomic_bool stopping;
+    int fd;
+    pthread_t thread;
+    char *write_buf;
+} Log;
+
+LogLevel log_level = LOG_OFF;
+
+static Log *active_log = NULL;
+
+void log_message(LogLevel level, const char *fmt, ...) {
+    Log *lg = active_log;
+    if (lg == NULL) {
+        return;
+    }
+    size_t pos = atomic_load_explicit(&lg->head, memory_order_relaxed);
+    LogSlot *slot;
+    while (true) {
+        slot = &lg->slots[pos % NUM_SLOTS];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq == pos) {
+            if (atomic_compare_exchange_weak_explicit(&lg->head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (seq < pos) {
+            // the flush thread hasn't written out the message a lap ago yet
+            atomic_fetch_add_explicit(&lg->dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&lg->head, memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    clock_gettime(CLOCK_REALTIME, &slot->time);
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(slot->text, SLOT_TEXT_LEN, fmt, args);
+    va_end(args);
+    slot->len = len < 0 ? 0 : (size_t) len < SLOT_TEXT_LEN ? (size_t) len : SLOT_TEXT_LEN - 1;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+/** Writes all of some bytes to a file, giving up if it fails. */
+static void write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, buf, len);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return;
+        }
+        buf += written;
+        len -= written;
+    }
+}
+
+/**
+ * Formats one line of the log file.
+ *
+ * @return the length of the line
+ */
+static size_t format_line(char *buf, struct timespec time, LogLevel level, const char *text, size_t len) {
+    struct tm tm;
+    localtime_r(&time.tv_sec, &tm);
+    size_t pos = strftime(buf, 32, "[%Y-%m-%d %H:%M:%S", &tm);
+    pos += sprintf(buf + pos, ".%03ld] %s: ", time.tv_nsec / 1000000, LEVEL_NAMES[level]);
+    memcpy(buf + pos, text, len);
+    pos += len;
+    buf[pos++] = '\n';
+    return pos;
+}
 
 /**
- * Logs a message to the mim.log file. No \n needed at the end of the message.
- * Use params just like printf.
+ * Writes out every message that is ready.
+ *
+ * @return the number of messages written out
  */
-void log_to_file(const char *fmt, ...) {
-    FILE *file = fopen("mim.log", "a");
-    if (file == NULL) {
-        fprintf(stderr, "Error opening mim.log\n");
+static size_t flush_ready(Log *lg, size_t *reported_dropped) {
+    size_t buf_len = 0;
+    size_t flushed = 0;
+    while (true) {
+        LogSlot *slot = &lg->slots[lg->tail % NUM_SLOTS];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != lg->tail + 1) {
+            break;
+        }
+        // a line is at most the timestamp and level plus the text
+        if (buf_len + SLOT_TEXT_LEN + 64 > WRITE_BUF_LEN) {
+            write_all(lg->fd, lg->write_buf, buf_len);
+            buf_len = 0;
+        }
+        buf_len += format_line(lg->write_buf + buf_len, slot->time, slot->level, slot->text, slot->len);
+        atomic_store_explicit(&slot->seq, lg->tail + NUM_SLOTS, memory_order_release);
+        lg->tail++;
+        flushed++;
     }
 
-    time_t curr_time = time(NULL);
-    char *time_str = ctime(&curr_time);
-    time_str[strlen(time_str)-1] = '\0';
+    size_t dropped = atomic_load_explicit(&lg->dropped, memory_order_relaxed);
+    if (dropped != *reported_dropped) {
+        char text[64];
+        int len = snprintf(text, sizeof(text), "%zu messages dropped", dropped - *reported_dropped);
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        if (buf_len + SLOT_TEXT_LEN + 64 > WRITE_BUF_LEN) {
+            write_all(lg->fd, lg->write_buf, buf_len);
+            buf_len = 0;
+        }
+        buf_len += format_line(lg->write_buf + buf_len, now, LOG_WARN, text, len);
+        *reported_dropped = dropped;
+    }
+    write_all(lg->fd, lg->write_buf, buf_len);
+    return flushed;
+}
 
-    va_list args;
-    va_start(args, fmt);
+static void *flush(void *arg) {
+    Log *lg = arg;
+    size_t reported_dropped = 0;
+    while (true) {
+        // check before flushing so the messages logged before stopping are
+        // always written out
+        bool stopping = atomic_load(&lg->stopping);
+        if (flush_ready(lg, &reported_dropped) == 0) {
+            if (stopping) {
+                return NULL;
+            }
+            struct timespec interval = {0, FLUSH_INTERVAL_NS};
+            nanosleep(&interval, NULL);
+        }
+    }
+}
 
-    fprintf(file, "[%s] ", time_str);
-    vfprintf(file, fmt, args);
-    fprintf(file, "\n");
+bool start_log(const char *filename, LogLevel level) {
+    stop_log();
+    if (level == LOG_OFF) {
+        return true;
+    }
 
-    fclose(file);
-    va_end(args);
+    Log *lg = malloc(sizeof(Log));
+    LogSlot *slots = malloc(NUM_SLOTS * sizeof(LogSlot));
+    char *write_buf = malloc(WRITE_BUF_LEN);
+    if (lg == NULL || slots == NULL || write_buf == NULL) {
+        fprintf(stderr, "Error allocating space for log.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < NUM_SLOTS; i++) {
+        atomic_init(&slots[i].seq, i);
+    }
+    lg->slots = slots;
+    lg->write_buf = write_buf;
+    atomic_init(&lg->head, 0);
+    lg->tail = 0;
+    atomic_init(&lg->dropped, 0);
+    atomic_init(&lg->stopping, false);
+
+    lg->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (lg->fd < 0) {
+        free(slots);
+        free(write_buf);
+        free(lg);
+        return false;
+    }
+    int err = pthread_create(&lg->thread, NULL, flush, lg);
+    if (err != 0) {
+        close(lg->fd);
+        free(slots);
+        free(write_buf);
+        free(lg);
+        errno = err;
+        return false;
+    }
+    active_log = lg;
+    log_level = level;
+    return true;
+}
+
+void stop_log(void) {
+    Log *lg = active_log;
+    if (lg == NULL) {
+        return;
+    }
+    log_level = LOG_OFF;
+    atomic_store(&lg->stopping, true);
+    pthread_join(lg->thread, NULL);
+    active_log = NULL;
+    close(lg->fd);
+    free(lg->slots);
+    free(lg->write_buf);
+    free(lg);
 }
 
-/** Clears the log file */
-void clear_log(void) {
-    FILE *file = fopen("mim.log", "w");
-    if (file == NULL) {
-        fprintf(stderr, "Error opening mim.log\n");
+bool parse_log_level(const char *name, LogLevel *level) {
+    for (size_t i = 0; i <= LOG_OFF; i++) {
+        if (strcasecmp(name, LEVEL_NAMES[i]) == 0) {
+            *level = i;
+            return true;
+        }
     }
-    fprintf(file, "");
-    fclose(file);
+    return false;
 }
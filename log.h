@@ -2,9 +2,83 @@
  * @file log.h
  * @author Max Rimlinger
  *
- * Functions to log info to a log file
+ * Header for log.c
+ *
+ * Functions to log info to a log file. Messages are formatted into a ring
+ * buffer and written out by a background thread, so logging never does file
+ * I/O on the thread that called it.
  */
 
-void log_to_file(const char *fmt, ...);
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdbool.h>
+
+#include "types.h"
+
+// messages less important than this are compiled out entirely. build with
+// make LOG_MIN_LEVEL=LOG_OFF to drop them all.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_DEBUG
+#endif
+
+/** The least important level that is logged. Only start_log changes it. */
+extern LogLevel log_level;
+
+/** Checks whether messages of a level would be logged. */
+#define log_enabled(level) ((level) >= LOG_MIN_LEVEL && (level) >= log_level)
+
+/**
+ * Logs a message if its level is enabled. The arguments aren't evaluated if it
+ * isn't. No \n needed at the end of the message. Use params just like printf.
+ */
+#define log_at(level, ...) do { \
+    if (log_enabled(level)) { \
+        log_message((level), __VA_ARGS__); \
+    } \
+} while (0)
+
+#define log_debug(...) log_at(LOG_DEBUG, __VA_ARGS__)
+#define log_info(...) log_at(LOG_INFO, __VA_ARGS__)
+#define log_warn(...) log_at(LOG_WARN, __VA_ARGS__)
+#define log_error(...) log_at(LOG_ERROR, __VA_ARGS__)
+
+/**
+ * Starts logging to a file, which is emptied first. Starts the thread that
+ * writes messages out.
+ *
+ * @param filename the file to log to
+ * @param level the least important level to log
+ * @return true if the file could be opened and the thread started. errno is
+ *     set if not.
+ */
+bool start_log(const char *filename, LogLevel level);
+
+/**
+ * Stops logging. Every message logged before this is written out and the file
+ * is closed. No other thread may be logging while it stops. Does nothing if
+ * logging wasn't started.
+ */
+void stop_log(void);
+
+/**
+ * Gets the log level with a name.
+ *
+ * @param name debug, info, warn, error or off
+ * @param level set to the level
+ * @return true if the name is a level
+ */
+bool parse_log_level(const char *name, LogLevel *level);
+
+/**
+ * Logs a message whatever its level. Use the log_debug family instead so that
+ * disabled messages cost nothing. Messages longer than a few hundred bytes are
+ * cut off, and messages are dropped if they come faster than they can be
+ * written out.
+ *
+ * @param level how important the message is
+ * @param fmt the printf format of the message
+ */
+void log_message(LogLevel level, const char *fmt, ...);
 
-void clear_log(void);
+#endif
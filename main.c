@@ -9,6 +9,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <locale.h>
 #include <ncurses.h>
 
 #include "log.h"
@@ -19,223 +22,438 @@
 #include "insert.h"
 #include "display.h"
 #include "command.h"
+#include "stats.h"
+#include "render.h"
+#include "search.h"
+#include "match_index.h"
+
+// how often the screen is redrawn while a file is loading
+static const int LOAD_REDRAW_MS = 50;
+// the longest a burst of keys is applied for before the screen is drawn again
+static const double FRAME_MS = 33;
+// the biggest count that can be typed before a command
+static const size_t MAX_COUNT = 999999999;
 
 static const char *NORMAL_KEYS = "`~1!2@3#4$5%6^7&8*9(0)-_=+qwertyuiop[]\\QWERTYUIOP{}|asdfghjkl;'ASDFGHJKL:\"zxcvbnm,./ZXCVBNM<>? ";
 
-static void loop(FileProxy fp, const char *filename) {
+// the keys ncurses reports for the sequences that terminals wrap pasted text in
+#define KEY_PASTE_BEGIN (KEY_MAX + 1)
+#define KEY_PASTE_END (KEY_MAX + 2)
+static const char *PASTE_BEGIN_SEQ = "\033[200~";
+static const char *PASTE_END_SEQ = "\033[201~";
+static const char *ENABLE_BRACKETED_PASTE = "\033[?2004h";
+static const char *DISABLE_BRACKETED_PASTE = "\033[?2004l";
+// how long to wait for more of a paste before giving up on the end of it
+static const int PASTE_TIMEOUT_MS = 1000;
+// where to write the latency stats when the program exits, if it is set
+static const char *STATS_FILE_ENV = "WIM_STATS_FILE";
+// the environment variable that turns on logging to LOG_FILE at a level
+static const char *LOG_LEVEL_ENV = "WIM_LOG_LEVEL";
+static const char *LOG_FILE = "mim.log";
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * Reads pasted text up to the end of the paste.
+ *
+ * @param len set to the length of the text
+ * @return the text, which needs to be freed
+ */
+static char *read_paste(size_t *len) {
+    size_t cap = 4096;
+    char *text = malloc(cap);
+    if (text == NULL) {
+        fprintf(stderr, "Error allocating space for paste.\n");
+        exit(EXIT_FAILURE);
+    }
+    *len = 0;
+    timeout(PASTE_TIMEOUT_MS);
+    int key;
+    bool after_cr = false;
+    while ((key = getch()) != ERR && key != KEY_PASTE_END) {
+        // text with \r\n line endings has one newline per line, not two
+        if (key == '\n' && after_cr) {
+            after_cr = false;
+            continue;
+        }
+        after_cr = key == '\r';
+        // terminals send newlines as \r
+        if (key == '\r' || key == KEY_ENTER) {
+            key = '\n';
+        }
+        if (key > 0xff) {
+            // not text
+            continue;
+        }
+        if (*len == cap) {
+            cap *= 2;
+            text = realloc(text, cap);
+            if (text == NULL) {
+                fprintf(stderr, "Error allocating space for paste.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        text[(*len)++] = key;
+    }
+    timeout(0);
+    return text;
+}
+
+/**
+ * Inserts pasted text at the cursor. Only the first line is pasted into the
+ * command line.
+ *
+ * @param fp the FileProxy being edited
+ * @param view the current View
+ * @param ms the state of the program
+ */
+static void paste(FileProxy *fp, View *view, MimState *ms) {
+    size_t len;
+    char *text = read_paste(&len);
+    if (ms->mode == COMMAND) {
+        char *nl = memchr(text, '\n', len);
+        insert_text(ms->cmd_fp, ms->cmd_view, *ms, text, nl == NULL ? len : (size_t) (nl - text));
+    } else {
+        insert_text(fp, view, *ms, text, len);
+    }
+    free(text);
+}
+
+/**
+ * Applies one key press.
+ *
+ * @param key the key that was pressed
+ * @param fp the FileProxy being edited
+ * @param view the current View
+ * @param ms the state of the program
+ * @param filename the name of the file being edited
+ * @param pending the first key of a command that takes two keys, 0 if none
+ * @param count the count typed before a command in normal mode, 0 if none
+ * @return false if the program should quit
+ */
+static bool handle_key(int key, FileProxy *fp, View *view, MimState *ms, const char *filename, int *pending,
+                       size_t *count) {
+    if (key == KEY_PASTE_BEGIN) {
+        *pending = 0;
+        *count = 0;
+        paste(fp, view, ms);
+        return true;
+    }
+    if (*pending == 'g') {
+        *pending = 0;
+        if (key == 'g') {
+            if (*count > 0) {
+                move_to_line_num(*fp, view, *ms, *count);
+            } else {
+                move_to_bof(*fp, view);
+            }
+        }
+        *count = 0;
+        return true;
+    }
+    if (ms->mode == NORMAL && ((key >= '1' && key <= '9') || (key == '0' && *count > 0))) {
+        // stop growing instead of overflowing
+        if (*count <= (MAX_COUNT - (key - '0')) / 10) {
+            *count = *count * 10 + (key - '0');
+        }
+        return true;
+    }
+    // how many times to apply the key, which uses up the count unless it's
+    // the first of two keys
+    bool counted = *count > 0;
+    size_t n = counted ? *count : 1;
+    if (key != 'g') {
+        *count = 0;
+    }
+
+    switch (ms->mode) {
+        case INSERT:
+            switch (key) {
+                case KEY_UP:
+                    move_up(*fp, view, *ms);
+                    break;
+                case KEY_DOWN:
+                    move_down(*fp, view, *ms);
+                    break;
+                case KEY_LEFT:
+                    move_left(*fp, view);
+                    break;
+                case KEY_RIGHT:
+                    move_right(*fp, view, *ms);
+                    break;
+                case KEY_END:
+                    move_to_eol(*fp, view, *ms);
+                    break;
+                case KEY_HOME:
+                    move_to_bol(*fp, view);
+                    break;
+                case KEY_ENTER:
+                case '\n':
+                case '\r':
+                    insert_newline(fp, view, *ms);
+                    break;
+                case KEY_BACKSPACE:
+                    backspace(fp, view, *ms);
+                    break;
+                case KEY_DC:
+                    delete_char(fp, view, *ms);
+                    break;
+                case 27:
+                    switch_mode(*fp, view, ms, NORMAL);
+                    break;
+            }
+            // text insertion
+            for (int i = 0; NORMAL_KEYS[i] != '\0'; i++) {
+                if (key == NORMAL_KEYS[i]) {
+                    insert_char(key, fp, view, *ms);
+                }
+            }
+            // tabs and the bytes of chars outside of ASCII are typed as they are
+            if (key == '\t' || (key >= 0x80 && key <= 0xff)) {
+                insert_char(key, fp, view, *ms);
+            }
+            break;
+        case NORMAL:
+            switch (key) {
+                case KEY_UP:
+                case 'k':
+                    move_up_by(*fp, view, *ms, n);
+                    break;
+                case KEY_DOWN:
+                case 'j':
+                    move_down_by(*fp, view, *ms, n);
+                    break;
+                case KEY_LEFT:
+                case 'h':
+                    move_left_by(*fp, view, n);
+                    break;
+                case KEY_RIGHT:
+                case 'l':
+                    move_right_by(*fp, view, *ms, n);
+                    break;
+                case KEY_END:
+                case '$':
+                    move_to_eol(*fp, view, *ms);
+                    break;
+                case KEY_HOME:
+                case '0':
+                    move_to_bol(*fp, view);
+                    break;
+                case '^':
+                    move_to_bol_non_ws(*fp, view, *ms);
+                    break;
+                case 'G':
+                    if (counted) {
+                        move_to_line_num(*fp, view, *ms, n);
+                    } else {
+                        move_to_eof(*fp, view);
+                    }
+                    break;
+                case 'g':
+                    *pending = 'g';
+                    break;
+                case KEY_ENTER:
+                case '\n':
+                case '\r':
+                    move_down_by(*fp, view, *ms, n);
+                    move_to_bol_non_ws(*fp, view, *ms);
+                    break;
+                case KEY_BACKSPACE:
+                    // TODO move left, or move up a line if on first char
+                    break;
+                case KEY_DC:
+                case 'x':
+                    delete_char(fp, view, *ms);
+                    break;
+                case 'i':
+                    switch_mode(*fp, view, ms, INSERT);
+                    break;
+                case 'a':
+                    switch_mode(*fp, view, ms, INSERT);
+                    move_right(*fp, view, *ms);
+                    break;
+                case 'A':
+                    switch_mode(*fp, view, ms, INSERT);
+                    move_to_eol(*fp, view, *ms);
+                    break;
+                case 'o':
+                    switch_mode(*fp, view, ms, INSERT);
+                    move_to_eol(*fp, view, *ms);
+                    insert_newline(fp, view, *ms);
+                    break;
+                case 'w':
+                    move_to_beg_n_tobj(*fp, view, WORD, n);
+                    break;
+                case 'b':
+                    move_to_beg_p_tobj(*fp, view, WORD, n);
+                    break;
+                case ':':
+                case '/':
+                case '?':
+                    ms->cmd_prompt = key;
+                    switch_mode(*fp, view, ms, COMMAND);
+                    break;
+                case 'n':
+                    search_again(ms, *fp, view, false);
+                    break;
+                case 'N':
+                    search_again(ms, *fp, view, true);
+                    break;
+            }
+                break;
+        case COMMAND:
+            switch (key) {
+                case KEY_LEFT:
+                    move_left(*ms->cmd_fp, ms->cmd_view);
+                    break;
+                case KEY_RIGHT:
+                    move_right(*ms->cmd_fp, ms->cmd_view, *ms);
+                    break;
+                case KEY_ENTER:
+                case '\n':
+                case '\r':
+                    return exec_command(ms, *fp, view, filename);
+                    break;
+                case KEY_END:
+                    move_to_eol(*ms->cmd_fp, ms->cmd_view, *ms);
+                    break;
+                case KEY_HOME:
+                    move_to_bol(*ms->cmd_fp, ms->cmd_view);
+                    break;
+                case KEY_BACKSPACE:
+                    backspace(ms->cmd_fp, ms->cmd_view, *ms);
+                    break;
+                case KEY_DC:
+                    delete_char(ms->cmd_fp, ms->cmd_view, *ms);
+                    break;
+            }
+            // text insertion
+            for (int i = 0; NORMAL_KEYS[i] != '\0'; i++) {
+                if (key == NORMAL_KEYS[i]) {
+                    insert_char(key, ms->cmd_fp, ms->cmd_view, *ms);
+                }
+            }
+            break;
+    }
+    return true;
+}
+
+static FileProxy loop(FileProxy fp, const char *filename) {
     CurPos init_cur = {0, 0};
-    View view = {0, 0, LINES - 1, COLS, init_cur, 0};
+    View view = {0, 0, LINES - 1, COLS, init_cur, 0, 0};
     FileProxy cmd_fp = create_empty_fp();
-    View cmd_view = {0, 0, 1, COLS - 1, 0, 0, 0};
+    View cmd_view = {0, 0, 1, COLS - 1, {0, 0}, 0, 0};
     char status_msg[MAX_STATUS_MSG_LEN];
-    MimState ms = {&cmd_fp, &cmd_view, status_msg, NORMAL};
+    MimState ms = {&cmd_fp, &cmd_view, status_msg, NORMAL, ':', {NULL, false}};
     switch_mode(fp, &view, &ms, NORMAL);
+    // the rest of the file keeps loading in the background
+    wait_for_line(fp, view.vlimit - 1);
+    int pending = 0;
+    size_t count = 0;
     bool running = true;
+    // when the first key that hasn't been displayed yet was read, 0 if none
+    uint64_t input_start = 0;
     while (running) {
+        bool loading = update_loading(fp);
+        bool counting = update_match_index(fp);
         display(ms, fp, view);
+        if (input_start != 0) {
+            record_stat(STAT_INPUT_TO_PAINT, input_start);
+            input_start = 0;
+        }
+        // wake up to show more of the file while it is loading or the matches
+        // are being counted
+        timeout(loading || counting ? LOAD_REDRAW_MS : -1);
         int key = getch();
-        switch (ms.mode) {
-            case INSERT:
-                switch (key) {
-                    case KEY_UP:
-                        move_up(fp, &view, ms);
-                        break;
-                    case KEY_DOWN:
-                        move_down(fp, &view, ms);
-                        break;
-                    case KEY_LEFT:
-                        move_left(fp, &view);
-                        break;
-                    case KEY_RIGHT:
-                        move_right(fp, &view, ms);
-                        break;
-                    case KEY_END:
-                        move_to_eol(fp, &view, ms);
-                        break;
-                    case KEY_HOME:
-                        move_to_bol(fp, &view);
-                        break;
-                    case KEY_ENTER:
-                    case '\n':
-                    case '\r':
-                        insert_newline(&fp, &view, ms);
-                        break;
-                    case KEY_BACKSPACE:
-                        backspace(&fp, &view, ms);
-                        break;
-                    case KEY_DC:
-                        delete_char(&fp, &view, ms);
-                        break;
-                    case 27:
-                        switch_mode(fp, &view, &ms, NORMAL);
-                        break;
-                }
-                // text insertion
-                for (int i = 0; NORMAL_KEYS[i] != '\0'; i++) {
-                    if (key == NORMAL_KEYS[i]) {
-                        insert_char(key, &fp, &view, ms);
-                    }
-                }
-                break;
-            case NORMAL:
-                switch (key) {
-                    case KEY_UP:
-                    case 'k':
-                        move_up(fp, &view, ms);
-                        break;
-                    case KEY_DOWN:
-                    case 'j':
-                        move_down(fp, &view, ms);
-                        break;
-                    case KEY_LEFT:
-                    case 'h':
-                        move_left(fp, &view);
-                        break;
-                    case KEY_RIGHT:
-                    case 'l':
-                        move_right(fp, &view, ms);
-                        break;
-                    case KEY_END:
-                    case '$':
-                        move_to_eol(fp, &view, ms);
-                        break;
-                    case KEY_HOME:
-                    case '0':
-                        move_to_bol(fp, &view);
-                        break;
-                    case '^':
-                        move_to_bol_non_ws(fp, &view, ms);
-                        break;
-                    case 'G':
-                        move_to_eof(fp, &view);
-                        break;
-                    case 'g':
-                        {
-                            int key2 = getch();
-                            switch (key2) {
-                                case 'g':
-                                    move_to_bof(fp, &view);
-                                    break;
-                                break;
-                            }
-                        }
-                        break;
-                    case KEY_ENTER:
-                    case '\n':
-                    case '\r':
-                        move_down(fp, &view, ms);
-                        move_to_bol_non_ws(fp, &view, ms);
-                        break;
-                    case KEY_BACKSPACE:
-                        // TODO move left, or move up a line if on first char
-                        break;
-                    case KEY_DC:
-                    case 'x':
-                        delete_char(&fp, &view, ms);
-                        break;
-                    case 'i':
-                        switch_mode(fp, &view, &ms, INSERT);
-                        break;
-                    case 'a':
-                        switch_mode(fp, &view, &ms, INSERT);
-                        move_right(fp, &view, ms);
-                        break;
-                    case 'A':
-                        switch_mode(fp, &view, &ms, INSERT);
-                        move_to_eol(fp, &view, ms);
-                        break;
-                    case 'o':
-                        switch_mode(fp, &view, &ms, INSERT);
-                        move_to_eol(fp, &view, ms);
-                        insert_newline(&fp, &view, ms);
-                        break;
-                    case 'w':
-                        move_to_beg_n_tobj(fp, &view, WORD);
-                        break;
-                    case 'b':
-                        move_to_beg_p_tobj(fp, &view, WORD);
-                        break;
-                    case ':':
-                        switch_mode(fp, &view, &ms, COMMAND);
-                        break;
-                }
-                    break;
-            case COMMAND:
-                switch (key) {
-                    case KEY_LEFT:
-                        move_left(*ms.cmd_fp, ms.cmd_view);
-                        break;
-                    case KEY_RIGHT:
-                        move_right(*ms.cmd_fp, ms.cmd_view, ms);
-                        break;
-                    case KEY_ENTER:
-                    case '\n':
-                    case '\r':
-                        running = exec_command(&ms, fp, &view, filename);
-                        break;
-                    case KEY_END:
-                        move_to_eol(*ms.cmd_fp, ms.cmd_view, ms);
-                        break;
-                    case KEY_HOME:
-                        move_to_bol(*ms.cmd_fp, ms.cmd_view);
-                        break;
-                    case KEY_BACKSPACE:
-                        backspace(ms.cmd_fp, ms.cmd_view, ms);
-                        break;
-                    case KEY_DC:
-                        delete_char(ms.cmd_fp, ms.cmd_view, ms);
-                        break;
-                }
-                // text insertion
-                for (int i = 0; NORMAL_KEYS[i] != '\0'; i++) {
-                    if (key == NORMAL_KEYS[i]) {
-                        insert_char(key, ms.cmd_fp, ms.cmd_view, ms);
-                    }
-                }
+        if (key != ERR) {
+            input_start = stat_clock();
+        }
+        // apply every key that is already waiting before drawing again, but
+        // still draw every so often during a long burst like a paste
+        double frame_end = now_ms() + FRAME_MS;
+        timeout(0);
+        while (key != ERR && running) {
+            uint64_t edit_start = stat_clock();
+            running = handle_key(key, &fp, &view, &ms, filename, &pending, &count);
+            record_stat(STAT_EDIT, edit_start);
+            if (now_ms() >= frame_end) {
                 break;
+            }
+            key = getch();
         }
     }
+    free_fp(cmd_fp);
+    if (ms.search.pat != NULL) {
+        set_match_pattern(fp, NULL);
+        free_pattern(ms.search.pat);
+    }
+    // edits can move the lines of fp, so hand back the latest copy to be freed
+    return fp;
 }
 
 int main(int argc, char *argv[]) {
-    clear_log();
-
     if (argc != 2) {
         printf("Usage: wim <filename>\n");
         return EXIT_FAILURE;
     }
 
-    // open file
-    FILE *file = fopen(argv[1], "r");
-    if (file == NULL) {
+    const char *log_level_name = getenv(LOG_LEVEL_ENV);
+    if (log_level_name != NULL) {
+        LogLevel level;
+        if (!parse_log_level(log_level_name, &level)) {
+            fprintf(stderr, "Unknown log level \"%s\". Use debug, info, warn, error or off.\n", log_level_name);
+            return EXIT_FAILURE;
+        }
+        if (!start_log(LOG_FILE, level)) {
+            fprintf(stderr, "Error opening %s: %s\n", LOG_FILE, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    // read file
+    FileProxy fp;
+    if (!read_fp(&fp, argv[1])) {
         fprintf(stderr, "File \"%s\" not found.\n", argv[1]);
+        stop_log();
         return EXIT_FAILURE;
     }
-    // get file size
-    fseek(file, 0, SEEK_END);
-    size_t file_size = ftell(file);
-    // go back to the beginning of the file
-    fseek(file, 0, SEEK_SET);
-
-    // move file into buffer
-    size_t byte = sizeof(unsigned char);
-    char *buffer = malloc(file_size);
-    fread(buffer, byte, file_size / byte, file);
-    fclose(file);
-
-    // split buffer into array of Lines
-    FileProxy fp = split_buffer(buffer, file_size / byte);
-    free(buffer);
+    log_info("opened \"%s\"", argv[1]);
 
+    // decode UTF-8 as the terminal does so wide chars are printed whole
+    setlocale(LC_ALL, "");
+    // have the terminal mark pasted text so that it can be inserted all at
+    // once. written before ncurses starts and after it ends so it isn't mixed
+    // up with the output ncurses buffers.
+    printf("%s", ENABLE_BRACKETED_PASTE);
+    fflush(stdout);
     initscr();
     keypad(stdscr, TRUE);
     noecho();
+    // keep \r as it is typed or pasted so \r\n can be told apart from \n\n
+    nonl();
     set_escdelay(10);
+    define_key(PASTE_BEGIN_SEQ, KEY_PASTE_BEGIN);
+    define_key(PASTE_END_SEQ, KEY_PASTE_END);
+    Renderer renderer = create_ncurses_renderer();
+    set_renderer(renderer);
 
     // main program loop
-    loop(fp, argv[1]);
+    fp = loop(fp, argv[1]);
 
     free_fp(fp);
+    free_renderer(renderer);
+    stop_log();
     endwin();
+    printf("%s", DISABLE_BRACKETED_PASTE);
+    fflush(stdout);
+
+    const char *stats_file = getenv(STATS_FILE_ENV);
+    if (stats_file != NULL && !dump_stats(stats_file)) {
+        fprintf(stderr, "Error writing stats to \"%s\": %s\n", stats_file, strerror(errno));
+    }
     return EXIT_SUCCESS;
 }
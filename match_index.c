@@ -0,0 +1,312 @@
+/**
+ * @file match_index.c
+ * @author Willow Rimlinger
+ *
+ * Keeps count of the matches of the last search in every line of a FileProxy.
+ *
+ * A thread counts the matches in the original text of the file a line at a
+ * time, skipping lines without one the way a search does, and records the
+ * lines that have some. The editor's thread then puts the counts in the
+ * LineTree, which sums them like it sums rows, and counts lines itself from
+ * then on only when they are edited or loaded. So the tree is still only
+ * touched by one thread.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "types.h"
+#include "match_index.h"
+#include "fileproxy.h"
+#include "line_tree.h"
+#include "search.h"
+
+// how much of the text is counted between checks for being stopped
+static const size_t COUNT_WINDOW = 1024 * 1024;
+
+/** The matches in a line of the original text */
+typedef struct OrigCount_s {
+    // where the line starts in the original text
+    size_t off;
+    size_t count;
+} OrigCount;
+
+struct MatchIndex_s {
+    // NULL if there is nothing to count
+    const Pattern *pat;
+    // matches lines on the editor's thread
+    Matcher *matcher;
+
+    // the text the thread counts
+    const char *orig;
+    size_t orig_len;
+    pthread_t thread;
+    // whether the thread needs to be joined
+    bool has_thread;
+    // set once the thread is done and counts can be read
+    atomic_bool done;
+    atomic_bool cancelled;
+    // the lines of the original text that have matches, in order. written by
+    // the thread until it's done.
+    OrigCount *counts;
+    size_t num_counts;
+    size_t counts_cap;
+
+    // whether the counts in the tree are up to date
+    bool counted;
+};
+
+MatchIndex *create_match_index(void) {
+    MatchIndex *index = malloc(sizeof(MatchIndex));
+    if (index == NULL) {
+        fprintf(stderr, "Error allocating space for match index.\n");
+        exit(EXIT_FAILURE);
+    }
+    index->pat = NULL;
+    index->matcher = NULL;
+    index->orig = NULL;
+    index->orig_len = 0;
+    index->has_thread = false;
+    atomic_init(&index->done, false);
+    atomic_init(&index->cancelled, false);
+    index->counts = NULL;
+    index->num_counts = 0;
+    index->counts_cap = 0;
+    index->counted = false;
+    return index;
+}
+
+/**
+ * Counts the matches that start in part of a line. Overlapping matches are all
+ * counted because n stops at each of them.
+ *
+ * @param matcher what to match with
+ * @param text the line
+ * @param len the length of the line
+ * @param end one past the last position to count matches starting at
+ * @return the number of matches
+ */
+static size_t count_line(Matcher *matcher, const char *text, size_t len, size_t end) {
+    size_t count = 0;
+    size_t pos = 0;
+    size_t start;
+    size_t match_len;
+    while (pos < end && find_match(matcher, text, len, pos, &start, &match_len) && start < end) {
+        count++;
+        pos = start + 1;
+    }
+    return count;
+}
+
+static void add_orig_count(MatchIndex *index, size_t off, size_t count) {
+    if (index->num_counts == index->counts_cap) {
+        index->counts_cap = index->counts_cap == 0 ? 1024 : index->counts_cap * 2;
+        index->counts = realloc(index->counts, index->counts_cap * sizeof(OrigCount));
+        if (index->counts == NULL) {
+            fprintf(stderr, "Error allocating space for match counts.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    index->counts[index->num_counts++] = (OrigCount) {off, count};
+}
+
+/** Counts the matches in each line of the original text. Run by the thread. */
+static void *count_orig(void *arg) {
+    MatchIndex *index = arg;
+    Matcher *matcher = create_matcher(index->pat);
+    const char *text = index->orig;
+    const char *text_end = index->orig + index->orig_len;
+    while (text < text_end && !atomic_load(&index->cancelled)) {
+        // a window is whole lines so each line is counted at once
+        const char *window_end = text_end;
+        if ((size_t) (text_end - text) > COUNT_WINDOW) {
+            window_end = memchr(text + COUNT_WINDOW, '\n', text_end - text - COUNT_WINDOW);
+            if (window_end == NULL) {
+                window_end = text_end;
+            }
+        }
+        while (text < window_end) {
+            const char *line = find_matching_line(matcher, text, window_end - text);
+            if (line == NULL) {
+                break;
+            }
+            const char *line_end = memchr(line, '\n', window_end - line);
+            if (line_end == NULL) {
+                line_end = window_end;
+            }
+            size_t count = count_line(matcher, line, line_end - line, SIZE_MAX);
+            if (count > 0) {
+                add_orig_count(index, line - index->orig, count);
+            }
+            text = line_end + 1;
+        }
+        text = window_end + 1;
+    }
+    free_matcher(matcher);
+    atomic_store(&index->done, true);
+    return NULL;
+}
+
+/** Stops counting and forgets the pattern. */
+static void clear_index(MatchIndex *index) {
+    if (index->has_thread) {
+        atomic_store(&index->cancelled, true);
+        pthread_join(index->thread, NULL);
+        index->has_thread = false;
+    }
+    if (index->matcher != NULL) {
+        free_matcher(index->matcher);
+        index->matcher = NULL;
+    }
+    index->pat = NULL;
+    free(index->counts);
+    index->counts = NULL;
+    index->num_counts = 0;
+    index->counts_cap = 0;
+    index->counted = false;
+    atomic_store(&index->done, false);
+    atomic_store(&index->cancelled, false);
+}
+
+void free_match_index(MatchIndex *index) {
+    clear_index(index);
+    free(index);
+}
+
+void set_match_pattern(FileProxy fp, const Pattern *pat) {
+    MatchIndex *index = fp.match_index;
+    clear_index(index);
+    mark_all_dirty(fp);
+    if (pat == NULL) {
+        return;
+    }
+    index->pat = pat;
+    index->matcher = create_matcher(pat);
+    index->orig = fp.orig;
+    index->orig_len = fp.orig == NULL ? 0 : fp.orig_len;
+    index->has_thread = pthread_create(&index->thread, NULL, count_orig, index) == 0;
+    if (!index->has_thread) {
+        // count on this thread instead
+        count_orig(index);
+    }
+}
+
+/** Where the lines being counted are and how far through the original counts they are */
+typedef struct Counting_s {
+    FileProxy fp;
+    // the first original count that may be for the next line
+    size_t next;
+} Counting;
+
+/**
+ * Finds the count of a line of the original text. Lines are usually looked up
+ * in order, so the one after the last line found is checked first.
+ *
+ * @param index the index
+ * @param off where the line starts in the original text
+ * @param next the first count that may be for the line. updated for the next line.
+ * @return the number of matches in the line
+ */
+static size_t find_orig_count(const MatchIndex *index, size_t off, size_t *next) {
+    size_t i = *next;
+    if (i < index->num_counts && index->counts[i].off == off) {
+        *next = i + 1;
+        return index->counts[i].count;
+    }
+    if ((i == index->num_counts || index->counts[i].off > off) && (i == 0 || index->counts[i - 1].off < off)) {
+        return 0;
+    }
+    size_t beg = 0;
+    size_t end = index->num_counts;
+    while (beg < end) {
+        size_t mid = beg + (end - beg) / 2;
+        if (index->counts[mid].off < off) {
+            beg = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    if (beg < index->num_counts && index->counts[beg].off == off) {
+        *next = beg + 1;
+        return index->counts[beg].count;
+    }
+    *next = beg;
+    return 0;
+}
+
+/**
+ * Counts the matches in the line of a slot. Called by tree_set_all_matches.
+ *
+ * @param slot the slot of the line
+ * @param data the Counting the line is part of
+ * @return the number of matches
+ */
+static size_t count_slot_matches(const LineSlot *slot, void *data) {
+    Counting *counting = data;
+    MatchIndex *index = counting->fp.match_index;
+    if (slot->line == NULL) {
+        return find_orig_count(index, slot->off, &counting->next);
+    }
+    size_t len;
+    const char *text = peek_line(counting->fp, slot, &len);
+    return count_line(index->matcher, text, len, SIZE_MAX);
+}
+
+bool update_match_index(FileProxy fp) {
+    MatchIndex *index = fp.match_index;
+    if (index->pat == NULL || index->counted) {
+        return false;
+    }
+    if (!atomic_load(&index->done)) {
+        return true;
+    }
+    if (index->has_thread) {
+        pthread_join(index->thread, NULL);
+        index->has_thread = false;
+    }
+    Counting counting = {fp, 0};
+    tree_set_all_matches(fp.lines, count_slot_matches, &counting);
+    index->counted = true;
+    return false;
+}
+
+void update_matches(FileProxy fp, size_t beg, size_t end) {
+    // the whole tree is counted when the thread is done
+    if (!fp.match_index->counted) {
+        return;
+    }
+    Counting counting = {fp, 0};
+    LineIter iter = iter_tree(fp.lines, beg);
+    for (size_t i = beg; i < end; i++) {
+        tree_set_matches(fp.lines, i, count_slot_matches(iter_next(&iter), &counting));
+    }
+}
+
+bool get_match_count(FileProxy fp, CurPos pos, size_t *upto, size_t *total) {
+    MatchIndex *index = fp.match_index;
+    if (index->pat == NULL || !index->counted) {
+        return false;
+    }
+    size_t len;
+    const char *text = peek_line(fp, tree_get(fp.lines, pos.line), &len);
+    // an empty match at the end of the line is under the cursor on the last char
+    size_t end = pos.ch + 1 >= len ? SIZE_MAX : pos.ch + 1;
+    *upto = tree_matches_before(fp.lines, pos.line) + count_line(index->matcher, text, len, end);
+    *total = tree_matches(fp.lines);
+    return true;
+}
+
+bool find_highlight(FileProxy fp, const char *text, size_t len, size_t from, size_t *start, size_t *end) {
+    MatchIndex *index = fp.match_index;
+    if (index->pat == NULL) {
+        return false;
+    }
+    size_t match_len;
+    if (!find_match(index->matcher, text, len, from, start, &match_len)) {
+        return false;
+    }
+    *end = *start + match_len;
+    return true;
+}
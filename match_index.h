@@ -0,0 +1,88 @@
+/**
+ * @file match_index.h
+ * @author Willow Rimlinger
+ *
+ * Header for match_index.c
+ *
+ * Keeps count of the matches of the last search in every line of a FileProxy,
+ * so which match the cursor is on is known without searching the whole file
+ * again. The original text is counted on a thread in the background, and after
+ * that only lines that change are counted again.
+ */
+
+#ifndef MATCH_INDEX_H
+#define MATCH_INDEX_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "types.h"
+
+/**
+ * Creates an index with no pattern.
+ *
+ * @return the new index
+ */
+MatchIndex *create_match_index(void);
+
+/**
+ * Frees an index, stopping its thread if it's still counting.
+ *
+ * @param index the index to free
+ */
+void free_match_index(MatchIndex *index);
+
+/**
+ * Starts counting the matches of a pattern in the background and highlighting
+ * them. Every line is displayed again.
+ *
+ * @param fp the FileProxy to count the matches in
+ * @param pat the pattern, which has to outlive the index or be replaced first.
+ *     NULL to stop counting and highlighting.
+ */
+void set_match_pattern(FileProxy fp, const Pattern *pat);
+
+/**
+ * Puts the counts into the FileProxy once the background thread is done.
+ * Called from the editor's loop.
+ *
+ * @param fp the FileProxy
+ * @return true if the matches are still being counted
+ */
+bool update_match_index(FileProxy fp);
+
+/**
+ * Counts the matches in lines again after they changed. Called by the
+ * FileProxy when lines are edited, added or loaded.
+ *
+ * @param fp the FileProxy the lines are in
+ * @param beg the first line that changed
+ * @param end one past the last line that changed
+ */
+void update_matches(FileProxy fp, size_t beg, size_t end);
+
+/**
+ * Gets which match a position is at.
+ *
+ * @param fp the FileProxy
+ * @param pos the position
+ * @param upto set to the number of matches that start at or before the position
+ * @param total set to the number of matches in the FileProxy
+ * @return false if there is no pattern or its matches haven't been counted yet
+ */
+bool get_match_count(FileProxy fp, CurPos pos, size_t *upto, size_t *total);
+
+/**
+ * Finds the next match to highlight in a line.
+ *
+ * @param fp the FileProxy the line is in
+ * @param text the line
+ * @param len the length of the line
+ * @param from where to start looking
+ * @param start set to where the match starts
+ * @param end set to where the match ends
+ * @return false if there is no pattern or no match at or after from
+ */
+bool find_highlight(FileProxy fp, const char *text, size_t len, size_t from, size_t *start, size_t *end);
+
+#endif
@@ -24,7 +24,7 @@ void switch_to_normal_mode(FileProxy fp, View *view, MimState *ms) {
     ms->mode = NORMAL;
 
     // handle cursor past the end of a line in insert mode
-    Line *cur_line = fp.lines[view->cur.line];
+    Line *cur_line = get_line(fp, view->cur.line);
     if (cur_line->len > 0) {
         move_left(fp, view);
     }
@@ -36,19 +36,17 @@ void switch_to_command_mode(MimState *ms) {
 
 void switch_from_command_mode(MimState *ms) {
     // clear line
-    Line *line = ms->cmd_fp->lines[0];
-    free(line->text);
-    free(line);
-    line = create_line(0);
+    insert_line(ms->cmd_fp, 0, create_line(*ms->cmd_fp));
+    remove_line(ms->cmd_fp, 1);
 
     // clear view
     ms->cmd_view->top_line = 0;
-    ms->cmd_view->left_ch = 0;
+    ms->cmd_view->left_col = 0;
     ms->cmd_view->vlimit = 1;
     ms->cmd_view->hlimit = COLS - 1;
     ms->cmd_view->cur.ch = 0;
     ms->cmd_view->cur.line = 0;
-    ms->cmd_view->cur_desired_ch = 0;
+    ms->cmd_view->cur_desired_col = 0;
 }
 
 void switch_mode(FileProxy fp, View *view, MimState *ms, Mode new_mode) {
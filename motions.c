@@ -7,124 +7,207 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <ncurses.h>
+#include <stdint.h>
 
 #include "log.h"
 #include "types.h"
 #include "motions.h"
 #include "text_utils.h"
 #include "text_objects.h"
+#include "columns.h"
 
-void pan(View *view) {
-    if (view->cur.line < view->top_line) {
-        view->top_line = view->cur.line;
-    } else if (view->cur.line > view->top_line + view->vlimit - 1) {
-        view->top_line = view->cur.line - (view->vlimit - 1);
+/**
+ * Gets the last place the cursor can be on a line. The cursor can be after the
+ * last char in insert and command mode but not in normal mode.
+ *
+ * @param line the line
+ * @param past_end whether the cursor can be after the last char
+ * @return where the char the cursor can be on starts
+ */
+static size_t get_last_ch(Line *line, bool past_end) {
+    if (past_end || line->len == 0) {
+        return line->len;
+    }
+    return prev_ch(line, line->len);
+}
+
+/** Checks whether the cursor can be after the last char of a line in a mode */
+static bool can_pass_end(MimState ms) {
+    return ms.mode == INSERT || ms.mode == COMMAND;
+}
+
+/**
+ * Moves the cursor to the char on its line that covers its desired column, or
+ * as close as it can get if the line is too short.
+ *
+ * @param fp the FileProxy to move in
+ * @param view the view whose cursor is moved
+ * @param past_end whether the cursor can be after the last char
+ */
+static void move_to_desired_col(FileProxy fp, View *view, bool past_end) {
+    Line *line = get_line(fp, view->cur.line);
+    size_t ch = get_ch_at_col(fp, line, view->cur_desired_col, NULL);
+    size_t last_ch = get_last_ch(line, past_end);
+    view->cur.ch = ch < last_ch ? ch : last_ch;
+}
+
+/** Makes the column the cursor is at the one it goes to when it moves up or down */
+static void set_desired_col(FileProxy fp, View *view) {
+    view->cur_desired_col = get_col(fp, get_line(fp, view->cur.line), view->cur.ch);
+}
+
+/**
+ * Points the top of a view at the row that is at the top of the screen again
+ * after an edit changed the rows of the lines. top_row can be past the last
+ * row of top_line once the line gets shorter, which would put the text on
+ * the screen a row lower than where the rows are counted from.
+ *
+ * @param fp the FileProxy being viewed
+ * @param view the view whose top is fixed
+ */
+static void normalize_top(FileProxy fp, View *view) {
+    size_t num_lines = get_num_lines(fp);
+    if (view->top_line >= num_lines) {
+        view->top_line = num_lines - 1;
+        view->top_row = 0;
     }
-    // handle scrolling horizontally when desired_ch is off screen
-    if (view->cur.ch < view->left_ch) {
-        view->left_ch = view->cur.ch;
-    } else if (view->cur.ch > view->left_ch + view->hlimit - 1) {
-        view->left_ch = view->cur.ch - (view->hlimit - 1);
+    size_t top_row = get_row_of_line(fp, view->top_line) + view->top_row;
+    size_t num_rows = get_row_of_line(fp, num_lines);
+    if (top_row >= num_rows) {
+        top_row = num_rows > 0 ? num_rows - 1 : 0;
     }
+    view->top_line = get_line_at_row(fp, top_row, &view->top_row);
 }
 
-void move_up(FileProxy fp, View *view, MimState ms) {
-    if (view->cur.line == 0) {
+/**
+ * Scrolls so that the cursor is on the screen when lines are wrapped. Lines are
+ * never scrolled horizontally, but the top of the screen can be partway
+ * through a line.
+ *
+ * @param fp the FileProxy being viewed
+ * @param view the view to scroll
+ */
+static void pan_wrapped(FileProxy fp, View *view) {
+    view->left_col = 0;
+    normalize_top(fp, view);
+    size_t cur_row = get_row_of_pos(fp, view->cur);
+    size_t top_row = get_row_of_line(fp, view->top_line) + view->top_row;
+    if (cur_row < top_row) {
+        top_row = cur_row;
+    } else if (cur_row > top_row + view->vlimit - 1) {
+        top_row = cur_row - (view->vlimit - 1);
+    } else {
         return;
     }
+    view->top_line = get_line_at_row(fp, top_row, &view->top_row);
+}
 
-    view->cur.line -= 1;
-    view->cur.ch = view->cur_desired_ch;
-
-    size_t above_len = fp.lines[view->cur.line]->len;
-    if (above_len <= view->cur_desired_ch) {
-        if (ms.mode == INSERT || ms.mode == COMMAND) {
-            view->cur.ch = above_len;
-        } else {
-            view->cur.ch = above_len - 1;
+void pan(FileProxy fp, View *view) {
+    if (get_wrap_width(fp) > 0) {
+        pan_wrapped(fp, view);
+        return;
+    }
+    view->top_row = 0;
+    if (view->cur.line < view->top_line) {
+        view->top_line = view->cur.line;
+    } else if (view->cur.line > view->top_line + view->vlimit - 1) {
+        view->top_line = view->cur.line - (view->vlimit - 1);
+    }
+    // handle scrolling horizontally so that all of the char the cursor is on
+    // is on screen
+    Line *line = get_line(fp, view->cur.line);
+    size_t cur_col = get_col(fp, line, view->cur.ch);
+    size_t cur_width = 1;
+    if (view->cur.ch < line->len) {
+        uint32_t code;
+        decode_char(line->text + view->cur.ch, line->len - view->cur.ch, &code);
+        size_t width = char_width(code, cur_col);
+        if (width > 1 && width <= view->hlimit) {
+            cur_width = width;
         }
     }
-    if (above_len == 0) {
-        view->cur.ch = 0;
+    if (cur_col < view->left_col) {
+        view->left_col = cur_col;
+    } else if (cur_col + cur_width > view->left_col + view->hlimit) {
+        view->left_col = cur_col + cur_width - view->hlimit;
     }
+}
 
-    pan(view);
+void move_up(FileProxy fp, View *view, MimState ms) {
+    move_up_by(fp, view, ms, 1);
 }
 
-void move_down(FileProxy fp, View *view, MimState ms) {
-    if (view->cur.line == fp.len - 1) {
-        // can't move down, last line
+void move_up_by(FileProxy fp, View *view, MimState ms, size_t count) {
+    if (view->cur.line == 0) {
         return;
     }
 
-    view->cur.line += 1;
-    view->cur.ch = view->cur_desired_ch;
+    // the target line is worked out at once so a big count isn't a big loop
+    move_to_line(fp, view, ms, count < view->cur.line ? view->cur.line - count : 0);
+}
 
-    size_t below_len = fp.lines[view->cur.line]->len;
-    if (below_len <= view->cur_desired_ch) {
-        if (ms.mode == INSERT || ms.mode == COMMAND) {
-            view->cur.ch = below_len;
-        } else {
-            view->cur.ch = below_len - 1;
-        }
+void move_down(FileProxy fp, View *view, MimState ms) {
+    move_down_by(fp, view, ms, 1);
+}
+
+void move_down_by(FileProxy fp, View *view, MimState ms, size_t count) {
+    size_t line = count < SIZE_MAX - view->cur.line ? view->cur.line + count : SIZE_MAX;
+    if (!wait_for_line(fp, line)) {
+        // stop at the last line
+        line = get_num_lines(fp) - 1;
     }
-    if (below_len == 0) {
-        view->cur.ch = 0;
+    if (line == view->cur.line) {
+        // can't move down, last line
+        return;
     }
 
-    pan(view);
+    move_to_line(fp, view, ms, line);
 }
 
 void move_left(FileProxy fp, View *view) {
+    move_left_by(fp, view, 1);
+}
+
+void move_left_by(FileProxy fp, View *view, size_t count) {
     if (view->cur.ch == 0) {
         // can't move left, beginning of line
         return;
     }
 
-    view->cur.ch -= 1;
-    view->cur_desired_ch = view->cur.ch;
+    Line *line = get_line(fp, view->cur.line);
+    for (size_t i = 0; i < count && view->cur.ch > 0; i++) {
+        view->cur.ch = prev_ch(line, view->cur.ch);
+    }
+    set_desired_col(fp, view);
 
-    pan(view);
+    pan(fp, view);
 }
 
 void move_right(FileProxy fp, View *view, MimState ms) {
-    if (ms.mode == INSERT || ms.mode == COMMAND) {
-        if (view->cur.ch >= fp.lines[view->cur.line]->len) {
-            // can't move right, end of line
-            return;
-        }
-    } else {
-        if (fp.lines[view->cur.line]->len == 0
-                || view->cur.ch >= (fp.lines[view->cur.line]->len) - 1) {
-            // can't move right, end of line
-            return;
-        }
+    move_right_by(fp, view, ms, 1);
+}
+
+void move_right_by(FileProxy fp, View *view, MimState ms, size_t count) {
+    Line *line = get_line(fp, view->cur.line);
+    size_t last_ch = get_last_ch(line, can_pass_end(ms));
+    if (view->cur.ch >= last_ch) {
+        // can't move right, end of line
+        return;
     }
 
-    view->cur.ch += 1;
-    view->cur_desired_ch = view->cur.ch;
+    for (size_t i = 0; i < count && view->cur.ch < last_ch; i++) {
+        view->cur.ch = next_ch(line, view->cur.ch);
+    }
+    set_desired_col(fp, view);
 
-    pan(view);
+    pan(fp, view);
 }
 
 void move_to_line(FileProxy fp, View *view, MimState ms, const size_t line) {
     view->cur.line = line;
-    view->cur.ch = view->cur_desired_ch;
-
-    size_t line_len = fp.lines[view->cur.line]->len;
-    if (line_len <= view->cur_desired_ch) {
-        if (ms.mode == INSERT || ms.mode == COMMAND) {
-            view->cur.ch = line_len;
-        } else {
-            view->cur.ch = line_len - 1;
-        }
-    }
-    if (line_len == 0) {
-        view->cur.ch = 0;
-    }
+    move_to_desired_col(fp, view, can_pass_end(ms));
 
-    pan(view);
+    pan(fp, view);
 }
 
 /**
@@ -136,46 +219,33 @@ void move_to_line(FileProxy fp, View *view, MimState ms, const size_t line) {
  * @return the new view after moving to the desired character
  */
 void move_to_char(FileProxy fp, View *view, MimState ms, const size_t ch) {
-    Line *line = fp.lines[view->cur.line];
-    if (ms.mode == INSERT || ms.mode == COMMAND) {
-        if (ch >= line->len) {
-            return;
-        }
-    } else {
-        if (ch >= line->len - 1) {
-            return;
-        }
+    Line *line = get_line(fp, view->cur.line);
+    if (ch > get_last_ch(line, can_pass_end(ms))) {
+        return;
     }
 
     view->cur.ch = ch;
-    view->cur_desired_ch = ch;
+    set_desired_col(fp, view);
 
-    pan(view);
+    pan(fp, view);
 }
 
 void move_to_eol(FileProxy fp, View *view, MimState ms) {
-    size_t eol;
-    if (ms.mode == INSERT || ms.mode == COMMAND) {
-        eol = fp.lines[view->cur.line]->len;
-    } else {
-        eol = fp.lines[view->cur.line]->len - 1;
-    }
-
-    view->cur.ch = eol;
-    view->cur_desired_ch = eol;
+    view->cur.ch = get_last_ch(get_line(fp, view->cur.line), can_pass_end(ms));
+    set_desired_col(fp, view);
 
-    pan(view);
+    pan(fp, view);
 }
 
 void move_to_bol(FileProxy fp, View *view) {
     view->cur.ch = 0;
-    view->cur_desired_ch = 0;
+    view->cur_desired_col = 0;
 
-    pan(view);
+    pan(fp, view);
 }
 
 void move_to_bol_non_ws(FileProxy fp, View *view, MimState ms) {
-    Line *line = fp.lines[view->cur.line];
+    Line *line = get_line(fp, view->cur.line);
 
     size_t ch_idx = get_len_ws_beginning(*line);
     if (ms.mode == INSERT || ms.mode == COMMAND) {
@@ -188,50 +258,45 @@ void move_to_bol_non_ws(FileProxy fp, View *view, MimState ms) {
 
     move_to_char(fp, view, ms, ch_idx);
 
-    pan(view);
+    pan(fp, view);
 }
 
 void move_to_bof(FileProxy fp, View *view) {
     view->cur.line = 0;
+    move_to_desired_col(fp, view, false);
 
-    size_t beg_len = fp.lines[view->cur.line]->len;
-    if (beg_len <= view->cur_desired_ch) {
-        view->cur.ch = beg_len - 1;
-    }
-    if (beg_len == 0) {
-        view->cur.ch = 0;
-    }
+    pan(fp, view);
+}
 
-    pan(view);
+void move_to_line_num(FileProxy fp, View *view, MimState ms, size_t line_num) {
+    size_t line = line_num > 0 ? line_num - 1 : 0;
+    if (!wait_for_line(fp, line)) {
+        line = get_num_lines(fp) - 1;
+    }
+    move_to_line(fp, view, ms, line);
 }
 
 void move_to_eof(FileProxy fp, View *view) {
-    view->cur.line = fp.lines[fp.len - 1]->num;
-
-    size_t end_len = fp.lines[view->cur.line]->len;
-    if (end_len <= view->cur_desired_ch) {
-        view->cur.ch = end_len - 1;
-    }
-    if (end_len == 0) {
-        view->cur.ch = 0;
-    }
+    wait_for_line(fp, SIZE_MAX);
+    view->cur.line = get_num_lines(fp) - 1;
+    move_to_desired_col(fp, view, false);
 
-    pan(view);
+    pan(fp, view);
 }
 
-void move_to_beg_n_tobj(FileProxy fp, View *view, TextObject tobj) {
-    CurPos beg_n_tobj_pos = get_beg_pos_n_tobj(fp, view->cur, tobj);
+void move_to_beg_n_tobj(FileProxy fp, View *view, TextObject tobj, size_t count) {
+    CurPos beg_n_tobj_pos = get_beg_pos_n_tobj(fp, view->cur, tobj, count);
     view->cur.line = beg_n_tobj_pos.line;
     view->cur.ch = beg_n_tobj_pos.ch;
 
-    pan(view);
+    pan(fp, view);
 }
 
-void move_to_beg_p_tobj(FileProxy fp, View *view, TextObject tobj) {
-    CurPos beg_p_tobj_pos = get_beg_pos_p_tobj(fp, view->cur, tobj);
+void move_to_beg_p_tobj(FileProxy fp, View *view, TextObject tobj, size_t count) {
+    CurPos beg_p_tobj_pos = get_beg_pos_p_tobj(fp, view->cur, tobj, count);
     view->cur.line = beg_p_tobj_pos.line;
     view->cur.ch = beg_p_tobj_pos.ch;
 
-    pan(view);
+    pan(fp, view);
 }
 
@@ -14,14 +14,58 @@
 #include "types.h"
 #include "fileproxy.h"
 
+void pan(FileProxy fp, View *view);
+
 void move_up(FileProxy fp, View *view, MimState ms);
 
+/**
+ * Moves the cursor up some lines, or to the first line if there aren't enough.
+ *
+ * @param fp the FileProxy to move in
+ * @param view the view whose cursor is moved
+ * @param ms the state of the program
+ * @param count how many lines to move up by
+ */
+void move_up_by(FileProxy fp, View *view, MimState ms, size_t count);
+
 void move_down(FileProxy fp, View *view, MimState ms);
 
+/**
+ * Moves the cursor down some lines, or to the last line if there aren't
+ * enough. Only waits for the file to load as far as the line it moves to.
+ *
+ * @param fp the FileProxy to move in
+ * @param view the view whose cursor is moved
+ * @param ms the state of the program
+ * @param count how many lines to move down by
+ */
+void move_down_by(FileProxy fp, View *view, MimState ms, size_t count);
+
 void move_left(FileProxy fp, View *view);
 
+/**
+ * Moves the cursor left some chars without leaving its line.
+ *
+ * @param fp the FileProxy to move in
+ * @param view the view whose cursor is moved
+ * @param count how many chars to move left by
+ */
+void move_left_by(FileProxy fp, View *view, size_t count);
+
 void move_right(FileProxy fp, View *view, MimState ms);
 
+/**
+ * Moves the cursor right some chars without leaving its line.
+ *
+ * @param fp the FileProxy to move in
+ * @param view the view whose cursor is moved
+ * @param ms the state of the program
+ * @param count how many chars to move right by
+ */
+void move_right_by(FileProxy fp, View *view, MimState ms, size_t count);
+
+void move_to_line(FileProxy fp, View *view, MimState ms, const size_t line);
+
 void move_to_char(FileProxy fp, View *view, MimState ms, const size_t ch);
 
 void move_to_eol(FileProxy fp, View *view, MimState ms);
@@ -32,11 +76,22 @@ void move_to_bol_non_ws(FileProxy fp, View *view, MimState ms);
 
 void move_to_bof(FileProxy fp, View *view);
 
+/**
+ * Moves the cursor to a line by its number, counting from 1 like line numbers
+ * are shown, or to the last line if the file is shorter.
+ *
+ * @param fp the FileProxy to move in
+ * @param view the view whose cursor is moved
+ * @param ms the state of the program
+ * @param line_num the number of the line
+ */
+void move_to_line_num(FileProxy fp, View *view, MimState ms, size_t line_num);
+
 void move_to_eof(FileProxy fp, View *view);
 
-void move_to_beg_n_tobj(FileProxy fp, View *view, TextObject tobj);
+void move_to_beg_n_tobj(FileProxy fp, View *view, TextObject tobj, size_t count);
 
-void move_to_beg_p_tobj(FileProxy fp, View *view, TextObject tobj);
+void move_to_beg_p_tobj(FileProxy fp, View *view, TextObject tobj, size_t count);
 
 #endif
 
@@ -0,0 +1,869 @@
+/**
+ * @file regex.c
+ * @author Willow Rimlinger
+ *
+ * Regular expressions matched by a lazily built DFA.
+ *
+ * An expression is parsed straight into a Thompson NFA. A Dfa works out its
+ * states from sets of NFA nodes the first time it steps out of a state on a
+ * byte and remembers the transition, so scanning is one table lookup per byte
+ * once the states a text needs exist. The number of states is capped, and the
+ * cache starts over if an expression needs more.
+ *
+ * An unanchored Dfa adds the start of the NFA back in at every byte, so it
+ * finds matches that start anywhere. Lines are matched on their own: a \n
+ * always goes back to the start state for the beginning of a line.
+ *
+ * Most text doesn't come near a match, so an unanchored Dfa spends most of its
+ * time in its start state. If only a few bytes leave that state, the text is
+ * skipped through to the next of them with memchr or SIMD instead of a byte at
+ * a time.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "types.h"
+#include "regex.h"
+#include "columns.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// the out of a node that hasn't been connected yet
+#define NO_NODE UINT32_MAX
+// the most states a Dfa keeps before it starts over
+#define MAX_STATES 2048
+// the size of a Dfa's table of states. must be a power of 2.
+#define TABLE_CAP (2 * MAX_STATES)
+// a transition that hasn't been worked out yet
+#define UNKNOWN_TRANS (-1)
+// the most bytes that may leave a state for it to be skipped through
+#define MAX_ACCEL 3
+
+/** The kinds of nodes in an NFA */
+typedef enum NodeKind_e {
+    // consumes one byte in a set
+    NODE_SET,
+    // goes both ways without consuming anything
+    NODE_SPLIT,
+    // goes on without consuming anything
+    NODE_JUMP,
+    // only goes on at the beginning of a line
+    NODE_BOL,
+    // only goes on at the end of a line
+    NODE_EOL,
+    NODE_MATCH,
+} NodeKind;
+
+/** A set of bytes */
+typedef struct ByteSet_s {
+    uint64_t bits[4];
+} ByteSet;
+
+/** A node of an NFA */
+typedef struct Node_s {
+    NodeKind kind;
+    uint32_t out;
+    // the other way a NODE_SPLIT goes
+    uint32_t out2;
+    // the bytes a NODE_SET consumes
+    ByteSet set;
+} Node;
+
+struct Regex_s {
+    Node *nodes;
+    size_t num_nodes;
+    size_t cap;
+    uint32_t start;
+};
+
+/** A piece of an NFA with one way in and a NODE_JUMP at the end to connect */
+typedef struct Frag_s {
+    uint32_t start;
+    uint32_t end;
+} Frag;
+
+/** Where parsing an expression is up to */
+typedef struct Parser_s {
+    const char *pat;
+    size_t len;
+    size_t pos;
+    Regex *regex;
+    // NULL unless the expression is malformed
+    const char *err;
+} Parser;
+
+/** A state of a Dfa */
+typedef struct DfaState_s {
+    // the NODE_SET nodes the NFA is in, sorted
+    uint32_t *nodes;
+    size_t num_nodes;
+    // a match ends here
+    bool accept;
+    // a match ends here if the line does
+    bool eol_accept;
+} DfaState;
+
+struct Dfa_s {
+    const Regex *regex;
+    bool anchored;
+    DfaState *states;
+    size_t num_states;
+    // 256 transitions for each state. a transition is the index of the next
+    // state, or -index - 2 if a match ends on the way to it, or UNKNOWN_TRANS.
+    int32_t *trans;
+    size_t trans_cap;
+    // the indexes of the states by a hash of their nodes. -1 if empty.
+    int32_t *table;
+    // the start states in the middle of a line and at the beginning of one.
+    // -1 until they're needed.
+    int32_t starts[2];
+    // bumped every time the states are thrown away
+    size_t resets;
+    // the start state in the middle of a line if only the bytes in accel leave
+    // it, so it can be skipped through. -1 if it can't be.
+    int32_t accel_state;
+    unsigned char accel[MAX_ACCEL];
+    size_t num_accel;
+    // whether accel_state has been worked out since the states were thrown away
+    bool accel_known;
+    // scratch space as long as the NFA for working out states
+    uint32_t *seeds;
+    uint32_t *stack;
+    uint32_t *eol_stack;
+    uint32_t *found;
+    uint32_t *marks;
+    uint32_t *eol_marks;
+    uint32_t gen;
+};
+
+static void add_to_set(ByteSet *set, unsigned char byte) {
+    set->bits[byte / 64] |= (uint64_t) 1 << (byte % 64);
+}
+
+static void add_range(ByteSet *set, unsigned char lo, unsigned char hi) {
+    for (unsigned b = lo; b <= hi; b++) {
+        add_to_set(set, b);
+    }
+}
+
+static bool in_set(const ByteSet *set, unsigned char byte) {
+    return (set->bits[byte / 64] >> (byte % 64)) & 1;
+}
+
+static uint32_t add_node(Regex *regex, NodeKind kind) {
+    if (regex->num_nodes == regex->cap) {
+        regex->cap = regex->cap == 0 ? 64 : regex->cap * 2;
+        regex->nodes = realloc(regex->nodes, regex->cap * sizeof(Node));
+        if (regex->nodes == NULL) {
+            fprintf(stderr, "Error allocating space for regex.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    Node *node = &regex->nodes[regex->num_nodes];
+    memset(node, 0, sizeof(Node));
+    node->kind = kind;
+    node->out = NO_NODE;
+    node->out2 = NO_NODE;
+    return regex->num_nodes++;
+}
+
+/** Makes a fragment that goes straight through a node. */
+static Frag frag_of(Regex *regex, uint32_t node) {
+    uint32_t end = add_node(regex, NODE_JUMP);
+    regex->nodes[node].out = end;
+    return (Frag) {node, end};
+}
+
+static Frag frag_empty(Regex *regex) {
+    uint32_t node = add_node(regex, NODE_JUMP);
+    return (Frag) {node, node};
+}
+
+static Frag frag_set(Regex *regex, const ByteSet *set) {
+    uint32_t node = add_node(regex, NODE_SET);
+    regex->nodes[node].set = *set;
+    return frag_of(regex, node);
+}
+
+static Frag frag_byte(Regex *regex, unsigned char byte) {
+    ByteSet set = {{0}};
+    add_to_set(&set, byte);
+    return frag_set(regex, &set);
+}
+
+static Frag concat(Regex *regex, Frag a, Frag b) {
+    regex->nodes[a.end].out = b.start;
+    return (Frag) {a.start, b.end};
+}
+
+static Frag alternate(Regex *regex, Frag a, Frag b) {
+    uint32_t split = add_node(regex, NODE_SPLIT);
+    uint32_t end = add_node(regex, NODE_JUMP);
+    regex->nodes[split].out = a.start;
+    regex->nodes[split].out2 = b.start;
+    regex->nodes[a.end].out = end;
+    regex->nodes[b.end].out = end;
+    return (Frag) {split, end};
+}
+
+/**
+ * Repeats a fragment.
+ *
+ * @param op * for any number of times, + for at least once or ? for at most once
+ */
+static Frag repeat(Regex *regex, Frag a, char op) {
+    uint32_t split = add_node(regex, NODE_SPLIT);
+    uint32_t end = add_node(regex, NODE_JUMP);
+    regex->nodes[split].out = a.start;
+    regex->nodes[split].out2 = end;
+    regex->nodes[a.end].out = op == '?' ? end : split;
+    return (Frag) {op == '+' ? a.start : split, end};
+}
+
+/** Makes a fragment that matches any UTF-8 char of more than one byte. */
+static Frag frag_multibyte(Regex *regex) {
+    ByteSet cont = {{0}};
+    add_range(&cont, 0x80, 0xbf);
+    Frag chars = {0, 0};
+    for (unsigned num_cont = 1; num_cont <= 3; num_cont++) {
+        // the lead bytes of chars with this many continuation bytes
+        ByteSet lead = {{0}};
+        add_range(&lead, 0xff << (7 - num_cont) & 0xff, (0xff << (6 - num_cont) & 0xff) - 1);
+        Frag seq = frag_set(regex, &lead);
+        for (unsigned i = 0; i < num_cont; i++) {
+            seq = concat(regex, seq, frag_set(regex, &cont));
+        }
+        chars = num_cont == 1 ? seq : alternate(regex, chars, seq);
+    }
+    return chars;
+}
+
+/**
+ * Makes a fragment for a class of ASCII chars.
+ *
+ * @param set the ASCII chars in the class
+ * @param negate whether the class matches every char but those
+ */
+static Frag frag_class(Regex *regex, ByteSet set, bool negate) {
+    if (negate) {
+        ByteSet ascii = {{0}};
+        for (unsigned b = 0; b < 0x80; b++) {
+            if (!in_set(&set, b)) {
+                add_to_set(&ascii, b);
+            }
+        }
+        set = ascii;
+    }
+    // nothing matches the end of a line
+    set.bits[0] &= ~((uint64_t) 1 << '\n');
+    Frag frag = frag_set(regex, &set);
+    return negate ? alternate(regex, frag, frag_multibyte(regex)) : frag;
+}
+
+/**
+ * Adds the chars of a class escape like \d to a set.
+ *
+ * @return false if the char isn't a class escape
+ */
+static bool add_class_escape(ByteSet *set, char c, bool *negate) {
+    *negate = c == 'D' || c == 'W' || c == 'S';
+    switch (c) {
+        case 'd':
+        case 'D':
+            add_range(set, '0', '9');
+            return true;
+        case 'w':
+        case 'W':
+            add_range(set, '0', '9');
+            add_range(set, 'A', 'Z');
+            add_range(set, 'a', 'z');
+            add_to_set(set, '_');
+            return true;
+        case 's':
+        case 'S':
+            add_to_set(set, ' ');
+            add_to_set(set, '\t');
+            return true;
+        default:
+            return false;
+    }
+}
+
+static Frag parse_alt(Parser *p);
+
+/** Parses a [] class. The [ has been consumed. */
+static Frag parse_class(Parser *p) {
+    ByteSet set = {{0}};
+    bool negate = p->pos < p->len && p->pat[p->pos] == '^';
+    if (negate) {
+        p->pos++;
+    }
+    bool first = true;
+    while (p->pos < p->len && (p->pat[p->pos] != ']' || first)) {
+        first = false;
+        unsigned char lo = p->pat[p->pos++];
+        if (lo == '\\' && p->pos < p->len) {
+            bool escape_negate;
+            if (add_class_escape(&set, p->pat[p->pos], &escape_negate)) {
+                if (escape_negate) {
+                    p->err = "Negated escapes aren't supported in []";
+                }
+                p->pos++;
+                continue;
+            }
+            lo = p->pat[p->pos++];
+        }
+        unsigned char hi = lo;
+        if (p->pos + 1 < p->len && p->pat[p->pos] == '-' && p->pat[p->pos + 1] != ']') {
+            hi = p->pat[p->pos + 1];
+            p->pos += 2;
+        }
+        if (lo >= 0x80 || hi >= 0x80) {
+            p->err = "Chars outside of ASCII aren't supported in []";
+        } else if (lo > hi) {
+            p->err = "Range out of order in []";
+        } else {
+            add_range(&set, lo, hi);
+        }
+    }
+    if (p->pos == p->len) {
+        p->err = "Unmatched [";
+        return frag_empty(p->regex);
+    }
+    p->pos++;
+    return frag_class(p->regex, set, negate);
+}
+
+/** Parses a single char, expression in () or class. */
+static Frag parse_atom(Parser *p) {
+    Regex *regex = p->regex;
+    char c = p->pat[p->pos++];
+    switch (c) {
+        case '(': {
+            Frag frag = parse_alt(p);
+            if (p->pos == p->len || p->pat[p->pos] != ')') {
+                p->err = "Unmatched (";
+                return frag;
+            }
+            p->pos++;
+            return frag;
+        }
+        case '[':
+            return parse_class(p);
+        case '.': {
+            ByteSet none = {{0}};
+            return frag_class(regex, none, true);
+        }
+        case '^':
+            return frag_of(regex, add_node(regex, NODE_BOL));
+        case '$':
+            return frag_of(regex, add_node(regex, NODE_EOL));
+        case '\\': {
+            if (p->pos == p->len) {
+                p->err = "Trailing \\";
+                return frag_empty(regex);
+            }
+            ByteSet set = {{0}};
+            bool negate;
+            if (add_class_escape(&set, p->pat[p->pos], &negate)) {
+                p->pos++;
+                return frag_class(regex, set, negate);
+            }
+            p->pos++;
+            break;
+        }
+    }
+    // a literal char, all of whose bytes are repeated together
+    p->pos--;
+    uint32_t code;
+    size_t char_len = decode_char(p->pat + p->pos, p->len - p->pos, &code);
+    Frag frag = frag_byte(regex, p->pat[p->pos]);
+    for (size_t i = 1; i < char_len; i++) {
+        frag = concat(regex, frag, frag_byte(regex, p->pat[p->pos + i]));
+    }
+    p->pos += char_len;
+    return frag;
+}
+
+/** Parses an atom and any *, + and ? after it. */
+static Frag parse_repeat(Parser *p) {
+    Frag frag = parse_atom(p);
+    while (p->pos < p->len && strchr("*+?", p->pat[p->pos]) != NULL) {
+        frag = repeat(p->regex, frag, p->pat[p->pos++]);
+    }
+    return frag;
+}
+
+/** Parses atoms up to a | or ) or the end of the expression. */
+static Frag parse_concat(Parser *p) {
+    Frag frag = frag_empty(p->regex);
+    while (p->pos < p->len && p->pat[p->pos] != '|' && p->pat[p->pos] != ')' && p->err == NULL) {
+        frag = concat(p->regex, frag, parse_repeat(p));
+    }
+    return frag;
+}
+
+static Frag parse_alt(Parser *p) {
+    Frag frag = parse_concat(p);
+    while (p->pos < p->len && p->pat[p->pos] == '|' && p->err == NULL) {
+        p->pos++;
+        frag = alternate(p->regex, frag, parse_concat(p));
+    }
+    return frag;
+}
+
+Regex *compile_regex(const char *pat, size_t len, const char **err) {
+    Regex *regex = malloc(sizeof(Regex));
+    if (regex == NULL) {
+        fprintf(stderr, "Error allocating space for regex.\n");
+        exit(EXIT_FAILURE);
+    }
+    *regex = (Regex) {NULL, 0, 0, 0};
+    Parser p = {pat, len, 0, regex, NULL};
+    Frag frag = parse_alt(&p);
+    if (p.err == NULL && p.pos < len) {
+        p.err = "Unmatched )";
+    }
+    if (p.err != NULL) {
+        *err = p.err;
+        free_regex(regex);
+        return NULL;
+    }
+    uint32_t match = add_node(regex, NODE_MATCH);
+    regex->nodes[frag.end].out = match;
+    regex->start = frag.start;
+    return regex;
+}
+
+void free_regex(Regex *regex) {
+    free(regex->nodes);
+    free(regex);
+}
+
+Dfa *create_dfa(const Regex *regex, bool anchored) {
+    Dfa *dfa = malloc(sizeof(Dfa));
+    size_t n = regex->num_nodes;
+    if (dfa == NULL) {
+        fprintf(stderr, "Error allocating space for DFA.\n");
+        exit(EXIT_FAILURE);
+    }
+    dfa->regex = regex;
+    dfa->anchored = anchored;
+    dfa->states = malloc(MAX_STATES * sizeof(DfaState));
+    dfa->num_states = 0;
+    dfa->trans_cap = 16;
+    dfa->trans = malloc(dfa->trans_cap * 256 * sizeof(int32_t));
+    dfa->table = malloc(TABLE_CAP * sizeof(int32_t));
+    dfa->starts[0] = -1;
+    dfa->starts[1] = -1;
+    dfa->resets = 0;
+    dfa->accel_state = -1;
+    dfa->num_accel = 0;
+    dfa->accel_known = false;
+    // the start of the NFA is added to the seeds of an unanchored step
+    dfa->seeds = malloc((n + 1) * sizeof(uint32_t));
+    dfa->stack = malloc(n * sizeof(uint32_t));
+    dfa->eol_stack = malloc(n * sizeof(uint32_t));
+    dfa->found = malloc(n * sizeof(uint32_t));
+    dfa->marks = calloc(n, sizeof(uint32_t));
+    dfa->eol_marks = calloc(n, sizeof(uint32_t));
+    dfa->gen = 0;
+    if (dfa->states == NULL || dfa->trans == NULL || dfa->table == NULL || dfa->seeds == NULL
+            || dfa->stack == NULL || dfa->eol_stack == NULL || dfa->found == NULL || dfa->marks == NULL
+            || dfa->eol_marks == NULL) {
+        fprintf(stderr, "Error allocating space for DFA.\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(dfa->table, -1, TABLE_CAP * sizeof(int32_t));
+    return dfa;
+}
+
+/** Throws away every state of a Dfa. */
+static void reset_dfa(Dfa *dfa) {
+    for (size_t i = 0; i < dfa->num_states; i++) {
+        free(dfa->states[i].nodes);
+    }
+    dfa->num_states = 0;
+    memset(dfa->table, -1, TABLE_CAP * sizeof(int32_t));
+    dfa->starts[0] = -1;
+    dfa->starts[1] = -1;
+    dfa->resets++;
+    dfa->accel_state = -1;
+    dfa->accel_known = false;
+}
+
+void free_dfa(Dfa *dfa) {
+    reset_dfa(dfa);
+    free(dfa->states);
+    free(dfa->trans);
+    free(dfa->table);
+    free(dfa->seeds);
+    free(dfa->stack);
+    free(dfa->eol_stack);
+    free(dfa->found);
+    free(dfa->marks);
+    free(dfa->eol_marks);
+    free(dfa);
+}
+
+static int compare_nodes(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Follows every way through the NFA that doesn't consume a byte from some
+ * nodes. The NODE_SET nodes that are reached go in dfa->found.
+ *
+ * @param dfa the Dfa to use the scratch space of
+ * @param num_seeds the number of nodes in dfa->seeds to start from
+ * @param bol whether this is the beginning of a line
+ * @param accept set to whether NODE_MATCH is reached
+ * @param eol_accept set to whether NODE_MATCH is reached if the line ends here
+ * @return the number of nodes found
+ */
+static size_t follow(Dfa *dfa, size_t num_seeds, bool bol, bool *accept, bool *eol_accept) {
+    const Node *nodes = dfa->regex->nodes;
+    uint32_t gen = ++dfa->gen;
+    size_t num_found = 0;
+    size_t stack_len = 0;
+    size_t eol_len = 0;
+    *accept = false;
+    *eol_accept = false;
+    for (size_t i = 0; i < num_seeds; i++) {
+        uint32_t seed = dfa->seeds[i];
+        if (dfa->marks[seed] != gen) {
+            dfa->marks[seed] = gen;
+            dfa->stack[stack_len++] = seed;
+        }
+    }
+    while (stack_len > 0) {
+        const Node *node = &nodes[dfa->stack[--stack_len]];
+        uint32_t next[2] = {NO_NODE, NO_NODE};
+        switch (node->kind) {
+            case NODE_SET:
+                dfa->found[num_found++] = node - nodes;
+                break;
+            case NODE_SPLIT:
+                next[1] = node->out2;
+                // fall through
+            case NODE_JUMP:
+                next[0] = node->out;
+                break;
+            case NODE_BOL:
+                if (bol) {
+                    next[0] = node->out;
+                }
+                break;
+            case NODE_EOL:
+                // only a match can come after the end of a line, so the way on
+                // is followed separately and only to see if it reaches one
+                if (dfa->eol_marks[node->out] != gen) {
+                    dfa->eol_marks[node->out] = gen;
+                    dfa->eol_stack[eol_len++] = node->out;
+                }
+                break;
+            case NODE_MATCH:
+                *accept = true;
+                break;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (next[i] != NO_NODE && dfa->marks[next[i]] != gen) {
+                dfa->marks[next[i]] = gen;
+                dfa->stack[stack_len++] = next[i];
+            }
+        }
+    }
+    while (eol_len > 0) {
+        const Node *node = &nodes[dfa->eol_stack[--eol_len]];
+        uint32_t next[2] = {NO_NODE, NO_NODE};
+        switch (node->kind) {
+            case NODE_SPLIT:
+                next[1] = node->out2;
+                // fall through
+            case NODE_JUMP:
+            case NODE_EOL:
+                next[0] = node->out;
+                break;
+            case NODE_BOL:
+                if (bol) {
+                    next[0] = node->out;
+                }
+                break;
+            case NODE_MATCH:
+                *eol_accept = true;
+                break;
+            case NODE_SET:
+                break;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (next[i] != NO_NODE && dfa->eol_marks[next[i]] != gen) {
+                dfa->eol_marks[next[i]] = gen;
+                dfa->eol_stack[eol_len++] = next[i];
+            }
+        }
+    }
+    *eol_accept = *eol_accept || *accept;
+    qsort(dfa->found, num_found, sizeof(uint32_t), compare_nodes);
+    return num_found;
+}
+
+static size_t hash_state(const uint32_t *nodes, size_t num_nodes, bool accept, bool eol_accept) {
+    size_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < num_nodes; i++) {
+        hash = (hash ^ nodes[i]) * 1099511628211ULL;
+    }
+    return (hash ^ (accept * 2 + eol_accept)) * 1099511628211ULL;
+}
+
+/**
+ * Finds the state for the nodes in dfa->found, adding it if there isn't one.
+ * Throws away every state first if there are too many.
+ *
+ * @return the index of the state
+ */
+static int32_t get_state(Dfa *dfa, size_t num_found, bool accept, bool eol_accept) {
+    size_t hash = hash_state(dfa->found, num_found, accept, eol_accept);
+    for (size_t i = hash % TABLE_CAP;; i = (i + 1) % TABLE_CAP) {
+        int32_t idx = dfa->table[i];
+        if (idx == -1) {
+            break;
+        }
+        const DfaState *state = &dfa->states[idx];
+        if (state->num_nodes == num_found && state->accept == accept && state->eol_accept == eol_accept
+                && memcmp(state->nodes, dfa->found, num_found * sizeof(uint32_t)) == 0) {
+            return idx;
+        }
+    }
+
+    if (dfa->num_states == MAX_STATES) {
+        reset_dfa(dfa);
+    }
+    if (dfa->num_states == dfa->trans_cap) {
+        dfa->trans_cap *= 2;
+        dfa->trans = realloc(dfa->trans, dfa->trans_cap * 256 * sizeof(int32_t));
+        if (dfa->trans == NULL) {
+            fprintf(stderr, "Error allocating space for DFA.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    int32_t idx = dfa->num_states++;
+    DfaState *state = &dfa->states[idx];
+    state->nodes = malloc((num_found > 0 ? num_found : 1) * sizeof(uint32_t));
+    if (state->nodes == NULL) {
+        fprintf(stderr, "Error allocating space for DFA.\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(state->nodes, dfa->found, num_found * sizeof(uint32_t));
+    state->num_nodes = num_found;
+    state->accept = accept;
+    state->eol_accept = eol_accept;
+    for (size_t i = 0; i < 256; i++) {
+        dfa->trans[(size_t) idx * 256 + i] = UNKNOWN_TRANS;
+    }
+    size_t i = hash % TABLE_CAP;
+    while (dfa->table[i] != -1) {
+        i = (i + 1) % TABLE_CAP;
+    }
+    dfa->table[i] = idx;
+    return idx;
+}
+
+/** Gets the state a Dfa starts in. */
+static int32_t get_start(Dfa *dfa, bool bol) {
+    if (dfa->starts[bol] == -1) {
+        dfa->seeds[0] = dfa->regex->start;
+        bool accept;
+        bool eol_accept;
+        size_t num_found = follow(dfa, 1, bol, &accept, &eol_accept);
+        int32_t start = get_state(dfa, num_found, accept, eol_accept);
+        dfa->starts[bol] = start;
+    }
+    return dfa->starts[bol];
+}
+
+static int32_t encode_trans(int32_t idx, bool match) {
+    return match ? -idx - 2 : idx;
+}
+
+static int32_t decode_trans(int32_t trans) {
+    return trans >= 0 ? trans : -trans - 2;
+}
+
+/**
+ * Works out where a state goes on a byte and remembers it.
+ *
+ * @return the transition
+ */
+static int32_t step(Dfa *dfa, int32_t from, unsigned char byte) {
+    size_t resets = dfa->resets;
+    int32_t trans;
+    if (byte == '\n') {
+        bool eol_accept = dfa->states[from].eol_accept;
+        int32_t start = get_start(dfa, true);
+        trans = encode_trans(start, eol_accept || dfa->states[start].accept);
+    } else {
+        const DfaState *state = &dfa->states[from];
+        const Node *nodes = dfa->regex->nodes;
+        size_t num_seeds = 0;
+        for (size_t i = 0; i < state->num_nodes; i++) {
+            const Node *node = &nodes[state->nodes[i]];
+            if (in_set(&node->set, byte)) {
+                dfa->seeds[num_seeds++] = node->out;
+            }
+        }
+        if (!dfa->anchored) {
+            dfa->seeds[num_seeds++] = dfa->regex->start;
+        }
+        bool accept;
+        bool eol_accept;
+        size_t num_found = follow(dfa, num_seeds, false, &accept, &eol_accept);
+        trans = encode_trans(get_state(dfa, num_found, accept, eol_accept), accept);
+    }
+    // the state stepped from is gone if the states were thrown away
+    if (dfa->resets == resets) {
+        dfa->trans[(size_t) from * 256 + byte] = trans;
+    }
+    return trans;
+}
+
+/**
+ * Works out whether the start state in the middle of a line can be skipped
+ * through, which is when only a few bytes leave it.
+ */
+static void find_accel(Dfa *dfa) {
+    size_t resets = dfa->resets;
+    int32_t start = get_start(dfa, false);
+    size_t num_accel = 0;
+    dfa->accel_known = true;
+    for (unsigned b = 0; b < 256; b++) {
+        int32_t trans = dfa->trans[(size_t) start * 256 + b];
+        if (trans == UNKNOWN_TRANS) {
+            trans = step(dfa, start, b);
+        }
+        if (dfa->resets != resets) {
+            // too many states to work it out. don't try again until next time.
+            dfa->accel_known = true;
+            return;
+        }
+        if (trans != start) {
+            if (num_accel == MAX_ACCEL) {
+                return;
+            }
+            dfa->accel[num_accel++] = b;
+        }
+    }
+    // the SIMD loop always looks for MAX_ACCEL bytes
+    for (size_t i = num_accel; i > 0 && i < MAX_ACCEL; i++) {
+        dfa->accel[i] = dfa->accel[0];
+    }
+    dfa->num_accel = num_accel;
+    dfa->accel_state = start;
+}
+
+/**
+ * Skips to the next byte that leaves the accel state.
+ *
+ * @return the position of the byte, or len if there isn't one
+ */
+static size_t skip_accel(const Dfa *dfa, const unsigned char *bytes, size_t pos, size_t len) {
+    if (dfa->num_accel == 0) {
+        return len;
+    }
+    if (dfa->num_accel == 1) {
+        const unsigned char *found = memchr(bytes + pos, dfa->accel[0], len - pos);
+        return found == NULL ? len : (size_t) (found - bytes);
+    }
+#ifdef HAVE_X86_SIMD
+    const __m128i a = _mm_set1_epi8(dfa->accel[0]);
+    const __m128i b = _mm_set1_epi8(dfa->accel[1]);
+    const __m128i c = _mm_set1_epi8(dfa->accel[2]);
+    for (; pos + 16 <= len; pos += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (bytes + pos));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, a), _mm_cmpeq_epi8(block, b)),
+                _mm_cmpeq_epi8(block, c));
+        uint32_t mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; pos < len; pos++) {
+        if (bytes[pos] == dfa->accel[0] || bytes[pos] == dfa->accel[1] || bytes[pos] == dfa->accel[2]) {
+            return pos;
+        }
+    }
+    return len;
+}
+
+size_t scan_dfa(Dfa *dfa, const char *text, size_t len, bool at_bol) {
+    if (!dfa->accel_known) {
+        find_accel(dfa);
+    }
+    int32_t state = get_start(dfa, at_bol);
+    if (dfa->states[state].accept) {
+        return 0;
+    }
+    const unsigned char *bytes = (const unsigned char *) text;
+    for (size_t i = 0; i < len; i++) {
+        if (state == dfa->accel_state) {
+            i = skip_accel(dfa, bytes, i, len);
+            if (i == len) {
+                break;
+            }
+        }
+        int32_t trans = dfa->trans[(size_t) state * 256 + bytes[i]];
+        if (trans >= 0) {
+            state = trans;
+            continue;
+        }
+        bool eol_accept = dfa->states[state].eol_accept;
+        if (trans == UNKNOWN_TRANS) {
+            trans = step(dfa, state, bytes[i]);
+            if (trans >= 0) {
+                state = trans;
+                continue;
+            }
+        }
+        // the match is either on the line the \n ends or an empty one at the
+        // beginning of the next line
+        if (bytes[i] == '\n') {
+            return eol_accept ? i : i + 1;
+        }
+        return i + 1;
+    }
+    return dfa->states[state].eol_accept ? len : SIZE_MAX;
+}
+
+bool match_dfa(Dfa *dfa, const char *line, size_t len, size_t start, size_t *match_len) {
+    int32_t state = get_start(dfa, start == 0);
+    size_t end = dfa->states[state].accept ? start : SIZE_MAX;
+    const unsigned char *bytes = (const unsigned char *) line;
+    size_t i = start;
+    for (; i < len && dfa->states[state].num_nodes > 0; i++) {
+        int32_t trans = dfa->trans[(size_t) state * 256 + bytes[i]];
+        if (trans == UNKNOWN_TRANS) {
+            trans = step(dfa, state, bytes[i]);
+        }
+        state = decode_trans(trans);
+        if (trans < 0) {
+            end = i + 1;
+        }
+    }
+    if (i == len && dfa->states[state].eol_accept) {
+        end = len;
+    }
+    if (end == SIZE_MAX) {
+        return false;
+    }
+    if (match_len != NULL) {
+        *match_len = end - start;
+    }
+    return true;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file regex.h
+ * @author Willow Rimlinger
+ *
+ * Header for regex.c
+ *
+ * Regular expressions that are matched a line at a time by a DFA built lazily
+ * from the expression's NFA, so matching never backtracks and takes time
+ * proportional to the length of the text.
+ *
+ * The syntax is POSIX extended: . [] [^] () | * + ? ^ $ and \ to escape, plus
+ * \d \w \s and their negations \D \W \S. . and negated classes match whole
+ * UTF-8 chars, and nothing matches a \n.
+ */
+
+#ifndef REGEX_H
+#define REGEX_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "types.h"
+
+/**
+ * Compiles a regular expression.
+ *
+ * @param pat the expression
+ * @param len the length of the expression
+ * @param err set to a description of what's wrong with the expression if it
+ *     can't be compiled
+ * @return the compiled expression, or NULL if it can't be compiled
+ */
+Regex *compile_regex(const char *pat, size_t len, const char **err);
+
+/**
+ * Frees a compiled expression. Every Dfa made from it must be freed first.
+ *
+ * @param regex the expression to free
+ */
+void free_regex(Regex *regex);
+
+/**
+ * Creates a DFA for an expression. A Dfa builds its states as it needs them,
+ * so it can't be shared between threads but the Regex can.
+ *
+ * @param regex the expression
+ * @param anchored true to only match at the start of the text given to it,
+ *     false to find matches anywhere in the text
+ * @return the new DFA
+ */
+Dfa *create_dfa(const Regex *regex, bool anchored);
+
+/**
+ * Frees a DFA.
+ *
+ * @param dfa the DFA to free
+ */
+void free_dfa(Dfa *dfa);
+
+/**
+ * Scans lines for the first place a match ends. Each line is matched on its
+ * own.
+ *
+ * @param dfa an unanchored DFA
+ * @param text the lines, separated by \n
+ * @param len the length of the text
+ * @param at_bol whether the text starts at the beginning of a line
+ * @return a position that is in the line of the first match to end, or
+ *     SIZE_MAX if there is no match. Counting the \n before it gives the line.
+ *     A match on that line starts at or before the position.
+ */
+size_t scan_dfa(Dfa *dfa, const char *text, size_t len, bool at_bol);
+
+/**
+ * Finds the longest match that starts at a position in a line.
+ *
+ * @param dfa an anchored DFA
+ * @param line the text of the line, with no \n in it
+ * @param len the length of the line
+ * @param start where the match has to start. may be len.
+ * @param match_len set to the length of the match. may be NULL.
+ * @return true if there is a match
+ */
+bool match_dfa(Dfa *dfa, const char *line, size_t len, size_t start, size_t *match_len);
+
+#endif
@@ -0,0 +1,263 @@
+/**
+ * @file render.c
+ * @author Willow Rimlinger
+ *
+ * Renderers that don't need a terminal: a grid of cells in memory and one that
+ * draws nothing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "types.h"
+#include "render.h"
+#include "columns.h"
+
+// the most bytes a cell holds: a char and the chars that combine with it
+#define CELL_LEN 16
+
+/** A column of the screen of a grid renderer */
+typedef struct Cell_s {
+    char text[CELL_LEN];
+    // 0 if the cell is the second column of a wide char
+    size_t len;
+    bool highlight;
+} Cell;
+
+static const Cell BLANK_CELL = {" ", 1, false};
+
+/** The screen of a grid renderer */
+typedef struct Grid_s {
+    size_t lines;
+    size_t cols;
+    // lines * cols cells, a row at a time
+    Cell *cells;
+    size_t cur_row;
+    size_t cur_col;
+    // whether text that is put is highlighted
+    bool highlight;
+    // where get_grid_row puts the text of a row
+    char *row_text;
+} Grid;
+
+static size_t grid_lines(void *data) {
+    return ((Grid *) data)->lines;
+}
+
+static size_t grid_cols(void *data) {
+    return ((Grid *) data)->cols;
+}
+
+static void grid_move(void *data, size_t row, size_t col) {
+    Grid *grid = data;
+    grid->cur_row = row;
+    grid->cur_col = col;
+}
+
+/**
+ * Blanks a cell. Blanks the other column of a wide char too, like a terminal
+ * does when half of a wide char is written over.
+ */
+static void blank_cell(Grid *grid, Cell *row, size_t col) {
+    if (row[col].len == 0 && col > 0) {
+        row[col - 1] = BLANK_CELL;
+    }
+    if (col + 1 < grid->cols && row[col + 1].len == 0) {
+        row[col + 1] = BLANK_CELL;
+    }
+    row[col] = BLANK_CELL;
+}
+
+static void grid_clear_to_eol(void *data) {
+    Grid *grid = data;
+    if (grid->cur_row >= grid->lines || grid->cur_col >= grid->cols) {
+        return;
+    }
+    Cell *row = grid->cells + grid->cur_row * grid->cols;
+    for (size_t col = grid->cur_col; col < grid->cols; col++) {
+        blank_cell(grid, row, col);
+    }
+}
+
+static void grid_put_text(void *data, const char *text, size_t len) {
+    Grid *grid = data;
+    if (grid->cur_row >= grid->lines) {
+        return;
+    }
+    Cell *row = grid->cells + grid->cur_row * grid->cols;
+    size_t ch = 0;
+    while (ch < len) {
+        uint32_t code;
+        size_t char_len = decode_char(text + ch, len - ch, &code);
+        size_t width = char_width(code, grid->cur_col);
+        if (width == 0) {
+            // combines with the char before it
+            Cell *prev = grid->cur_col > 0 ? &row[grid->cur_col - 1] : NULL;
+            if (prev != NULL && prev->len == 0 && grid->cur_col > 1) {
+                prev--;
+            }
+            if (prev != NULL && prev->len + char_len <= CELL_LEN) {
+                memcpy(prev->text + prev->len, text + ch, char_len);
+                prev->len += char_len;
+            }
+        } else if (grid->cur_col + width > grid->cols) {
+            return;
+        } else {
+            for (size_t i = 0; i < width; i++) {
+                blank_cell(grid, row, grid->cur_col + i);
+            }
+            Cell *cell = &row[grid->cur_col];
+            memcpy(cell->text, text + ch, char_len);
+            cell->len = char_len;
+            cell->highlight = grid->highlight;
+            if (width == 2) {
+                row[grid->cur_col + 1].len = 0;
+                row[grid->cur_col + 1].highlight = grid->highlight;
+            }
+            grid->cur_col += width;
+        }
+        ch += char_len;
+    }
+}
+
+static void grid_set_highlight(void *data, bool on) {
+    ((Grid *) data)->highlight = on;
+}
+
+static void grid_scroll(void *data, size_t top, size_t bottom, long n) {
+    Grid *grid = data;
+    size_t rows = bottom - top;
+    size_t dist = n > 0 ? (size_t) n : (size_t) -n;
+    if (dist > rows) {
+        dist = rows;
+    }
+    Cell *region = grid->cells + top * grid->cols;
+    size_t kept_len = (rows - dist) * grid->cols;
+    Cell *blank;
+    if (n > 0) {
+        memmove(region, region + dist * grid->cols, kept_len * sizeof(Cell));
+        blank = region + kept_len;
+    } else {
+        memmove(region + dist * grid->cols, region, kept_len * sizeof(Cell));
+        blank = region;
+    }
+    for (size_t i = 0; i < dist * grid->cols; i++) {
+        blank[i] = BLANK_CELL;
+    }
+}
+
+static void grid_refresh(void *data) {
+    (void) data;
+}
+
+static void grid_free(void *data) {
+    Grid *grid = data;
+    free(grid->cells);
+    free(grid->row_text);
+    free(grid);
+}
+
+Renderer create_grid_renderer(size_t lines, size_t cols) {
+    Grid *grid = malloc(sizeof(Grid));
+    Cell *cells = malloc(lines * cols * sizeof(Cell));
+    char *row_text = malloc(cols * CELL_LEN);
+    if (grid == NULL || cells == NULL || row_text == NULL) {
+        fprintf(stderr, "Error allocating space for grid renderer.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < lines * cols; i++) {
+        cells[i] = BLANK_CELL;
+    }
+    *grid = (Grid) {lines, cols, cells, 0, 0, false, row_text};
+    return (Renderer) {
+        grid, grid_lines, grid_cols, grid_move, grid_clear_to_eol, grid_put_text, grid_set_highlight, grid_scroll,
+        grid_refresh, grid_free
+    };
+}
+
+const char *get_grid_row(Renderer renderer, size_t row, size_t *len) {
+    Grid *grid = renderer.data;
+    const Cell *cells = grid->cells + row * grid->cols;
+    *len = 0;
+    for (size_t col = 0; col < grid->cols; col++) {
+        memcpy(grid->row_text + *len, cells[col].text, cells[col].len);
+        *len += cells[col].len;
+    }
+    return grid->row_text;
+}
+
+bool is_grid_highlighted(Renderer renderer, size_t row, size_t col) {
+    Grid *grid = renderer.data;
+    return grid->cells[row * grid->cols + col].highlight;
+}
+
+CurPos get_grid_cursor(Renderer renderer) {
+    Grid *grid = renderer.data;
+    return (CurPos) {grid->cur_row, grid->cur_col};
+}
+
+/** The size of the screen of a null renderer */
+typedef struct NullScreen_s {
+    size_t lines;
+    size_t cols;
+} NullScreen;
+
+static size_t null_lines(void *data) {
+    return ((NullScreen *) data)->lines;
+}
+
+static size_t null_cols(void *data) {
+    return ((NullScreen *) data)->cols;
+}
+
+static void null_move(void *data, size_t row, size_t col) {
+    (void) data;
+    (void) row;
+    (void) col;
+}
+
+static void null_clear_to_eol(void *data) {
+    (void) data;
+}
+
+static void null_put_text(void *data, const char *text, size_t len) {
+    (void) data;
+    (void) text;
+    (void) len;
+}
+
+static void null_set_highlight(void *data, bool on) {
+    (void) data;
+    (void) on;
+}
+
+static void null_scroll(void *data, size_t top, size_t bottom, long n) {
+    (void) data;
+    (void) top;
+    (void) bottom;
+    (void) n;
+}
+
+static void null_refresh(void *data) {
+    (void) data;
+}
+
+Renderer create_null_renderer(size_t lines, size_t cols) {
+    NullScreen *screen = malloc(sizeof(NullScreen));
+    if (screen == NULL) {
+        fprintf(stderr, "Error allocating space for null renderer.\n");
+        exit(EXIT_FAILURE);
+    }
+    *screen = (NullScreen) {lines, cols};
+    return (Renderer) {
+        screen, null_lines, null_cols, null_move, null_clear_to_eol, null_put_text, null_set_highlight, null_scroll,
+        null_refresh, free
+    };
+}
+
+void free_renderer(Renderer renderer) {
+    renderer.free_data(renderer.data);
+}
@@ -0,0 +1,85 @@
+/**
+ * @file render.h
+ * @author Willow Rimlinger
+ *
+ * Header for render.c and render_ncurses.c
+ *
+ * The screens that display() can draw on. The ncurses renderer draws on the
+ * terminal. The grid renderer draws into memory so that frames can be rendered
+ * and compared without a terminal, and the null renderer throws everything away
+ * so that only the cost of deciding what to draw is measured.
+ */
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "types.h"
+
+/**
+ * Creates a Renderer that draws on the ncurses stdscr. initscr must have been
+ * called already. The screen is the size of the terminal.
+ *
+ * @return the new renderer
+ */
+Renderer create_ncurses_renderer(void);
+
+/**
+ * Creates a Renderer that draws into a grid of cells in memory. Every cell
+ * starts out as a space and wide chars take up two cells like they do on a
+ * terminal.
+ *
+ * @param lines the number of rows of the screen
+ * @param cols the number of columns of the screen
+ * @return the new renderer
+ */
+Renderer create_grid_renderer(size_t lines, size_t cols);
+
+/**
+ * Gets the text on a row of the screen of a grid renderer.
+ *
+ * @param renderer a renderer from create_grid_renderer
+ * @param row the row. must be less than the number of lines.
+ * @param len set to the length of the text
+ * @return the UTF-8 text of the row, which is not \0 terminated and is only
+ *     valid until the next call
+ */
+const char *get_grid_row(Renderer renderer, size_t row, size_t *len);
+
+/**
+ * Gets whether a cell of the screen of a grid renderer is highlighted.
+ *
+ * @param renderer a renderer from create_grid_renderer
+ * @param row the row of the cell. must be less than the number of lines.
+ * @param col the column of the cell. must be less than the number of columns.
+ * @return true if the text in the cell was put while highlighting was on
+ */
+bool is_grid_highlighted(Renderer renderer, size_t row, size_t col);
+
+/**
+ * Gets where the cursor of a grid renderer is.
+ *
+ * @param renderer a renderer from create_grid_renderer
+ * @return the row and column of the cursor
+ */
+CurPos get_grid_cursor(Renderer renderer);
+
+/**
+ * Creates a Renderer that draws nothing.
+ *
+ * @param lines the number of rows the screen pretends to have
+ * @param cols the number of columns the screen pretends to have
+ * @return the new renderer
+ */
+Renderer create_null_renderer(size_t lines, size_t cols);
+
+/**
+ * Frees a Renderer. Doesn't end ncurses.
+ *
+ * @param renderer the renderer to free
+ */
+void free_renderer(Renderer renderer);
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * @file render_ncurses.c
+ * @author Willow Rimlinger
+ *
+ * A renderer that draws on the terminal with ncurses.
+ */
+
+#include <stdlib.h>
+#include <ncurses.h>
+
+#include "types.h"
+#include "render.h"
+
+static size_t ncurses_lines(void *data) {
+    (void) data;
+    return LINES;
+}
+
+static size_t ncurses_cols(void *data) {
+    (void) data;
+    return COLS;
+}
+
+static void ncurses_move(void *data, size_t row, size_t col) {
+    (void) data;
+    move(row, col);
+}
+
+static void ncurses_clear_to_eol(void *data) {
+    (void) data;
+    clrtoeol();
+}
+
+static void ncurses_put_text(void *data, const char *text, size_t len) {
+    (void) data;
+    addnstr(text, len);
+}
+
+static void ncurses_set_highlight(void *data, bool on) {
+    (void) data;
+    if (on) {
+        attron(A_REVERSE);
+    } else {
+        attroff(A_REVERSE);
+    }
+}
+
+static void ncurses_scroll(void *data, size_t top, size_t bottom, long n) {
+    (void) data;
+    // with idlok on, refresh turns this into the terminal's own scrolling so
+    // only the rows that are scrolled in are sent
+    setscrreg(top, bottom - 1);
+    scrollok(stdscr, TRUE);
+    scrl(n);
+    scrollok(stdscr, FALSE);
+    setscrreg(0, LINES - 1);
+}
+
+static void ncurses_refresh(void *data) {
+    (void) data;
+    refresh();
+}
+
+static void ncurses_free(void *data) {
+    (void) data;
+}
+
+Renderer create_ncurses_renderer(void) {
+    // let refresh use the terminal's insert and delete line to scroll
+    idlok(stdscr, TRUE);
+    return (Renderer) {
+        NULL, ncurses_lines, ncurses_cols, ncurses_move, ncurses_clear_to_eol, ncurses_put_text,
+        ncurses_set_highlight, ncurses_scroll, ncurses_refresh, ncurses_free
+    };
+}
@@ -0,0 +1,801 @@
+/**
+ * @file search.c
+ * @author Willow Rimlinger
+ *
+ * Finds text and regular expressions in a FileProxy.
+ *
+ * The kernels compare the first and last bytes of the pattern against a whole
+ * block of starting positions at once and only check the positions where both
+ * match with memcmp, so rare patterns are skipped over at the speed of the
+ * loads.
+ *
+ * Lines that haven't been loaded still point into the file, and the ones that
+ * follow each other are usually right next to each other in it, so they are
+ * gathered into runs that are scanned as one piece of text. Deleting lines
+ * leaves holes in a run, which is caught when a match is found by checking
+ * that the line the match is on is where the run says it is.
+ *
+ * A regex is run over a whole run by an unanchored DFA to find the line of the
+ * first match, and only that line is matched a start at a time. Big searches
+ * are split into chunks of lines that threads take in turn, and the chunks'
+ * results are merged in line order.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "types.h"
+#include "search.h"
+#include "fileproxy.h"
+#include "line_tree.h"
+#include "regex.h"
+#include "cpu.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// the most lines that are gathered into runs at once, and the lines each
+// thread searches at a time
+#define WINDOW_LINES 4096
+// the most threads that search at once
+#define MAX_THREADS 16
+// a pattern with any of these is a regular expression
+#define REGEX_CHARS "\\.[]()*+?|^$"
+
+/** Lines whose text is next to each other in memory, separated by \n */
+typedef struct Run_s {
+    size_t line_num;
+    size_t num_lines;
+    const char *text;
+    size_t len;
+} Run;
+
+struct Pattern_s {
+    char *text;
+    size_t len;
+    // NULL if the pattern is plain text
+    Regex *regex;
+};
+
+/** What a thread needs to match a Pattern. Dfas can't be shared between threads. */
+struct Matcher_s {
+    const Pattern *pat;
+    // finds where matches end. NULL if the pattern is plain text.
+    Dfa *scan;
+    // finds whether a match starts at a position. NULL if the pattern is plain text.
+    Dfa *anchored;
+};
+
+typedef enum ChunkState_e {
+    CHUNK_PENDING,
+    CHUNK_NOT_FOUND,
+    CHUNK_FOUND,
+} ChunkState;
+
+/** What a thread found in a chunk of lines */
+typedef struct ChunkResult_s {
+    ChunkState state;
+    CurPos match;
+} ChunkResult;
+
+/** The lines being searched by threads a chunk at a time */
+typedef struct Scan_s {
+    FileProxy fp;
+    const Pattern *pat;
+    size_t beg;
+    size_t end;
+    bool backward;
+    size_t num_chunks;
+    // the next chunk that a thread should take
+    atomic_size_t next_chunk;
+    // the first chunk that a match was found in. the chunks after it don't
+    // need to be searched.
+    atomic_size_t cutoff;
+    pthread_mutex_t lock;
+    // signaled when a chunk is done
+    pthread_cond_t done;
+    // the result of each chunk. protected by lock.
+    ChunkResult *results;
+} Scan;
+
+/**
+ * Finds the first match that starts at or after a position with memchr. Used
+ * for what's left after the blocks and on CPUs without SIMD.
+ */
+static const char *find_scalar(const char *text, size_t len, const char *pat, size_t pat_len, size_t beg) {
+    const char *cur = text + beg;
+    const char *last = text + len - pat_len;
+    while (cur <= last) {
+        cur = memchr(cur, pat[0], last - cur + 1);
+        if (cur == NULL) {
+            return NULL;
+        }
+        if (memcmp(cur, pat, pat_len) == 0) {
+            return cur;
+        }
+        cur++;
+    }
+    return NULL;
+}
+
+/** Finds the last match that starts before a position a byte at a time. */
+static const char *find_last_scalar(const char *text, const char *pat, size_t pat_len, size_t end) {
+    for (size_t pos = end; pos-- > 0;) {
+        if (text[pos] == pat[0] && memcmp(text + pos, pat, pat_len) == 0) {
+            return text + pos;
+        }
+    }
+    return NULL;
+}
+
+#ifdef HAVE_X86_SIMD
+
+/**
+ * Finds the first match in the blocks of 16 starting positions that fit in the
+ * text.
+ *
+ * @param next set to the first position that wasn't checked
+ */
+static const char *find_sse2(const char *text, size_t len, const char *pat, size_t pat_len, size_t *next) {
+    const __m128i first = _mm_set1_epi8(pat[0]);
+    const __m128i last = _mm_set1_epi8(pat[pat_len - 1]);
+    size_t pos = 0;
+    for (; pos + pat_len - 1 + 16 <= len; pos += 16) {
+        __m128i firsts = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (text + pos)), first);
+        __m128i lasts = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (text + pos + pat_len - 1)), last);
+        uint32_t mask = _mm_movemask_epi8(_mm_and_si128(firsts, lasts));
+        while (mask != 0) {
+            const char *cand = text + pos + __builtin_ctz(mask);
+            if (memcmp(cand, pat, pat_len) == 0) {
+                return cand;
+            }
+            mask &= mask - 1;
+        }
+    }
+    *next = pos;
+    return NULL;
+}
+
+__attribute__((target("avx2")))
+static const char *find_avx2(const char *text, size_t len, const char *pat, size_t pat_len, size_t *next) {
+    const __m256i first = _mm256_set1_epi8(pat[0]);
+    const __m256i last = _mm256_set1_epi8(pat[pat_len - 1]);
+    size_t pos = 0;
+    for (; pos + pat_len - 1 + 32 <= len; pos += 32) {
+        __m256i firsts = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (text + pos)), first);
+        __m256i lasts = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (text + pos + pat_len - 1)), last);
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(firsts, lasts));
+        while (mask != 0) {
+            const char *cand = text + pos + __builtin_ctz(mask);
+            if (memcmp(cand, pat, pat_len) == 0) {
+                return cand;
+            }
+            mask &= mask - 1;
+        }
+    }
+    *next = pos;
+    return NULL;
+}
+
+/**
+ * Finds the last match in the blocks of 16 starting positions that fit in the
+ * text, going from the end.
+ *
+ * @param next set to the end of the positions that weren't checked
+ */
+static const char *find_last_sse2(const char *text, size_t len, const char *pat, size_t pat_len, size_t *next) {
+    const __m128i first = _mm_set1_epi8(pat[0]);
+    const __m128i last = _mm_set1_epi8(pat[pat_len - 1]);
+    size_t end = len - pat_len + 1;
+    for (; end >= 16; end -= 16) {
+        size_t pos = end - 16;
+        __m128i firsts = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (text + pos)), first);
+        __m128i lasts = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (text + pos + pat_len - 1)), last);
+        uint32_t mask = _mm_movemask_epi8(_mm_and_si128(firsts, lasts));
+        while (mask != 0) {
+            size_t bit = 31 - __builtin_clz(mask);
+            if (memcmp(text + pos + bit, pat, pat_len) == 0) {
+                return text + pos + bit;
+            }
+            mask &= ~(1u << bit);
+        }
+    }
+    *next = end;
+    return NULL;
+}
+
+__attribute__((target("avx2")))
+static const char *find_last_avx2(const char *text, size_t len, const char *pat, size_t pat_len, size_t *next) {
+    const __m256i first = _mm256_set1_epi8(pat[0]);
+    const __m256i last = _mm256_set1_epi8(pat[pat_len - 1]);
+    size_t end = len - pat_len + 1;
+    for (; end >= 32; end -= 32) {
+        size_t pos = end - 32;
+        __m256i firsts = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (text + pos)), first);
+        __m256i lasts = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (text + pos + pat_len - 1)), last);
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(firsts, lasts));
+        while (mask != 0) {
+            size_t bit = 31 - __builtin_clz(mask);
+            if (memcmp(text + pos + bit, pat, pat_len) == 0) {
+                return text + pos + bit;
+            }
+            mask &= ~(1u << bit);
+        }
+    }
+    *next = end;
+    return NULL;
+}
+
+#endif
+
+const char *find_text(const char *text, size_t len, const char *pat, size_t pat_len) {
+    if (pat_len == 0 || pat_len > len) {
+        return NULL;
+    }
+    size_t next = 0;
+#ifdef HAVE_X86_SIMD
+    const char *match = has_avx2()
+        ? find_avx2(text, len, pat, pat_len, &next)
+        : find_sse2(text, len, pat, pat_len, &next);
+    if (match != NULL) {
+        return match;
+    }
+#endif
+    return find_scalar(text, len, pat, pat_len, next);
+}
+
+const char *find_last_text(const char *text, size_t len, const char *pat, size_t pat_len) {
+    if (pat_len == 0 || pat_len > len) {
+        return NULL;
+    }
+    size_t next = len - pat_len + 1;
+#ifdef HAVE_X86_SIMD
+    const char *match = has_avx2()
+        ? find_last_avx2(text, len, pat, pat_len, &next)
+        : find_last_sse2(text, len, pat, pat_len, &next);
+    if (match != NULL) {
+        return match;
+    }
+#endif
+    return find_last_scalar(text, pat, pat_len, next);
+}
+
+/**
+ * Sets the length of a run of lines that haven't been loaded, which ends where
+ * its last line does.
+ *
+ * @param fp the FileProxy the run is in
+ * @param run the run
+ * @param last_slot the last line of the run
+ */
+static void end_run(FileProxy fp, Run *run, const LineSlot *last_slot) {
+    size_t len;
+    const char *text = peek_line(fp, last_slot, &len);
+    run->len = text + len - run->text;
+}
+
+/**
+ * Splits lines into runs. A line that hasn't been loaded joins the run before
+ * it if it comes after that run in the file. A line that has a Line gets a run
+ * of its own.
+ *
+ * @param fp the FileProxy the lines are in
+ * @param beg the first line
+ * @param end one past the last line. at most WINDOW_LINES after beg.
+ * @param runs where to put the runs
+ * @return the number of runs
+ */
+static size_t gather_runs(FileProxy fp, size_t beg, size_t end, Run *runs) {
+    size_t num_runs = 0;
+    // the last line of the run being gathered. NULL if the run can't be added to.
+    const LineSlot *last_slot = NULL;
+    LineIter iter = iter_tree_shared(fp.lines, beg);
+    for (size_t line_num = beg; line_num < end; line_num++) {
+        const LineSlot *slot = iter_next(&iter);
+        if (slot->line == NULL && last_slot != NULL && slot->off > last_slot->off) {
+            runs[num_runs - 1].num_lines++;
+            last_slot = slot;
+            continue;
+        }
+        if (last_slot != NULL) {
+            end_run(fp, &runs[num_runs - 1], last_slot);
+        }
+        if (slot->line != NULL) {
+            runs[num_runs++] = (Run) {line_num, 1, slot->line->text, slot->line->len};
+            last_slot = NULL;
+        } else {
+            runs[num_runs++] = (Run) {line_num, 1, fp.orig + slot->off, 0};
+            last_slot = slot;
+        }
+    }
+    if (last_slot != NULL) {
+        end_run(fp, &runs[num_runs - 1], last_slot);
+    }
+    return num_runs;
+}
+
+/**
+ * Finds which line of a run a match is on.
+ *
+ * @param fp the FileProxy the run is in
+ * @param run the run the match was found in
+ * @param found where the match starts
+ * @param match set to where the match is in the FileProxy
+ * @return false if the match is in text that was deleted from between the
+ *     lines of the run
+ */
+static bool locate_match(FileProxy fp, const Run *run, const char *found, CurPos *match) {
+    size_t line_in_run = 0;
+    const char *line_start = run->text;
+    const char *nl;
+    while ((nl = memchr(line_start, '\n', found - line_start)) != NULL) {
+        line_in_run++;
+        line_start = nl + 1;
+    }
+    // if any line before this one was deleted, the line after the last \n
+    // is further back in the file than the run's line with this number
+    if (line_in_run >= run->num_lines
+            || (line_in_run > 0
+                && fp.orig + tree_get_shared(fp.lines, run->line_num + line_in_run)->off != line_start)) {
+        return false;
+    }
+    *match = (CurPos) {run->line_num + line_in_run, found - line_start};
+    return true;
+}
+
+/** Whether a pattern has any chars that make it a regular expression */
+static bool is_regex(const char *text, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (strchr(REGEX_CHARS, text[i]) != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Pattern *compile_pattern(const char *text, size_t len, const char **err) {
+    Regex *regex = NULL;
+    if (is_regex(text, len)) {
+        regex = compile_regex(text, len, err);
+        if (regex == NULL) {
+            return NULL;
+        }
+    }
+    Pattern *pat = malloc(sizeof(Pattern));
+    char *copy = malloc(len > 0 ? len : 1);
+    if (pat == NULL || copy == NULL) {
+        fprintf(stderr, "Error allocating space for pattern.\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(copy, text, len);
+    *pat = (Pattern) {copy, len, regex};
+    return pat;
+}
+
+void free_pattern(Pattern *pat) {
+    if (pat->regex != NULL) {
+        free_regex(pat->regex);
+    }
+    free(pat->text);
+    free(pat);
+}
+
+const char *get_pattern_text(const Pattern *pat, size_t *len) {
+    *len = pat->len;
+    return pat->text;
+}
+
+Matcher *create_matcher(const Pattern *pat) {
+    Matcher *matcher = malloc(sizeof(Matcher));
+    if (matcher == NULL) {
+        fprintf(stderr, "Error allocating space for matcher.\n");
+        exit(EXIT_FAILURE);
+    }
+    matcher->pat = pat;
+    matcher->scan = pat->regex == NULL ? NULL : create_dfa(pat->regex, false);
+    matcher->anchored = pat->regex == NULL ? NULL : create_dfa(pat->regex, true);
+    return matcher;
+}
+
+void free_matcher(Matcher *matcher) {
+    if (matcher->pat->regex != NULL) {
+        free_dfa(matcher->scan);
+        free_dfa(matcher->anchored);
+    }
+    free(matcher);
+}
+
+/** Whether a byte is the first byte of a UTF-8 char, where matches may start */
+static bool is_char_start(unsigned char byte) {
+    return (byte & 0xc0) != 0x80;
+}
+
+/**
+ * Finds a match that starts in a range of a line.
+ *
+ * @param matcher what to match with
+ * @param text the line
+ * @param len the length of the line
+ * @param beg the first position a match may start at
+ * @param end one past the last position a match may start at. may be SIZE_MAX.
+ * @param backward whether to find the last match instead of the first
+ * @param start set to where the match starts
+ * @return true if there is a match
+ */
+static bool match_in_line(Matcher *matcher, const char *text, size_t len, size_t beg, size_t end, bool backward,
+        size_t *start) {
+    const Pattern *pat = matcher->pat;
+    if (pat->regex == NULL) {
+        if (end > len) {
+            end = len;
+        }
+        if (beg >= end) {
+            return false;
+        }
+        size_t text_end = end - 1 + pat->len < len ? end - 1 + pat->len : len;
+        const char *found = backward
+            ? find_last_text(text + beg, text_end - beg, pat->text, pat->len)
+            : find_text(text + beg, text_end - beg, pat->text, pat->len);
+        if (found == NULL) {
+            return false;
+        }
+        *start = found - text;
+        return true;
+    }
+
+    // an empty match can start right at the end of the line
+    if (end > len + 1) {
+        end = len + 1;
+    }
+    if (backward) {
+        for (size_t pos = end; pos-- > beg;) {
+            if ((pos == len || is_char_start(text[pos])) && match_dfa(matcher->anchored, text, len, pos, NULL)) {
+                *start = pos;
+                return true;
+            }
+        }
+        return false;
+    }
+    size_t pos = beg;
+    while (pos < end) {
+        // no match starts after where the first one to end does
+        size_t scan_end = scan_dfa(matcher->scan, text + pos, len - pos, pos == 0);
+        if (scan_end == SIZE_MAX) {
+            return false;
+        }
+        size_t last = pos + scan_end < end - 1 ? pos + scan_end : end - 1;
+        for (; pos <= last; pos++) {
+            if ((pos == len || is_char_start(text[pos])) && match_dfa(matcher->anchored, text, len, pos, NULL)) {
+                *start = pos;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool find_match(Matcher *matcher, const char *text, size_t len, size_t beg, size_t *start, size_t *match_len) {
+    if (!match_in_line(matcher, text, len, beg, SIZE_MAX, false, start)) {
+        return false;
+    }
+    if (matcher->pat->regex == NULL) {
+        *match_len = matcher->pat->len;
+    } else {
+        match_dfa(matcher->anchored, text, len, *start, match_len);
+    }
+    return true;
+}
+
+const char *find_matching_line(Matcher *matcher, const char *text, size_t len) {
+    const Pattern *pat = matcher->pat;
+    const char *found;
+    if (pat->regex == NULL) {
+        found = find_text(text, len, pat->text, pat->len);
+    } else {
+        size_t pos = scan_dfa(matcher->scan, text, len, true);
+        found = pos == SIZE_MAX ? NULL : text + pos;
+    }
+    if (found == NULL) {
+        return NULL;
+    }
+    while (found > text && found[-1] != '\n') {
+        found--;
+    }
+    return found;
+}
+
+/** Searches the lines of a run one at a time. */
+static bool find_in_lines(FileProxy fp, const Run *run, Matcher *matcher, bool backward, CurPos *match) {
+    for (size_t i = 0; i < run->num_lines; i++) {
+        size_t line_num = run->line_num + (backward ? run->num_lines - 1 - i : i);
+        size_t len;
+        const char *text = peek_line(fp, tree_get_shared(fp.lines, line_num), &len);
+        size_t start;
+        if (match_in_line(matcher, text, len, 0, SIZE_MAX, backward, &start)) {
+            *match = (CurPos) {line_num, start};
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Finds the line of a run that the first or last regex match is on by scanning
+ * the whole run with the DFA.
+ *
+ * @return where the match ends or just after it in the line, or NULL if there
+ *     is no match
+ */
+static const char *scan_run(const Run *run, Matcher *matcher, bool backward) {
+    const char *last = NULL;
+    size_t pos = 0;
+    while (pos <= run->len) {
+        size_t found = scan_dfa(matcher->scan, run->text + pos, run->len - pos, true);
+        if (found == SIZE_MAX) {
+            break;
+        }
+        last = run->text + pos + found;
+        const char *nl = memchr(last, '\n', run->text + run->len - last);
+        if (!backward || nl == NULL) {
+            break;
+        }
+        // go on from the next line in case there is a later match
+        pos = nl + 1 - run->text;
+    }
+    return last;
+}
+
+/** Searches a run, preferring the last match if searching backward. */
+static bool find_in_run(FileProxy fp, const Run *run, Matcher *matcher, bool backward, CurPos *match) {
+    const Pattern *pat = matcher->pat;
+    if (pat->regex == NULL) {
+        const char *found = backward
+            ? find_last_text(run->text, run->len, pat->text, pat->len)
+            : find_text(run->text, run->len, pat->text, pat->len);
+        if (found == NULL) {
+            return false;
+        }
+        if (locate_match(fp, run, found, match)) {
+            return true;
+        }
+        return find_in_lines(fp, run, matcher, backward, match);
+    }
+
+    const char *found = scan_run(run, matcher, backward);
+    if (found == NULL) {
+        return false;
+    }
+    CurPos line_pos;
+    if (locate_match(fp, run, found, &line_pos)) {
+        size_t len;
+        const char *text = peek_line(fp, tree_get_shared(fp.lines, line_pos.line), &len);
+        size_t start;
+        if (match_in_line(matcher, text, len, 0, SIZE_MAX, backward, &start)) {
+            *match = (CurPos) {line_pos.line, start};
+            return true;
+        }
+    }
+    return find_in_lines(fp, run, matcher, backward, match);
+}
+
+/**
+ * Searches the lines of a chunk.
+ *
+ * @param runs room for WINDOW_LINES runs
+ */
+static bool search_chunk(FileProxy fp, size_t beg, size_t end, Matcher *matcher, bool backward, Run *runs,
+        CurPos *match) {
+    size_t num_runs = gather_runs(fp, beg, end, runs);
+    for (size_t i = 0; i < num_runs; i++) {
+        if (find_in_run(fp, &runs[backward ? num_runs - 1 - i : i], matcher, backward, match)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Gets the lines of a chunk, which are numbered from the end if searching backward. */
+static void get_chunk(const Scan *scan, size_t chunk, size_t *beg, size_t *end) {
+    if (!scan->backward) {
+        *beg = scan->beg + chunk * WINDOW_LINES;
+        *end = scan->end - *beg < WINDOW_LINES ? scan->end : *beg + WINDOW_LINES;
+    } else {
+        *end = scan->end - chunk * WINDOW_LINES;
+        *beg = *end - scan->beg < WINDOW_LINES ? scan->beg : *end - WINDOW_LINES;
+    }
+}
+
+/** Searches chunks until they run out or an earlier one has a match. */
+static void *scan_chunks(void *arg) {
+    Scan *scan = arg;
+    Matcher *matcher = create_matcher(scan->pat);
+    Run *runs = malloc(WINDOW_LINES * sizeof(Run));
+    if (runs == NULL) {
+        fprintf(stderr, "Error allocating space for search.\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t chunk;
+    while ((chunk = atomic_fetch_add(&scan->next_chunk, 1)) < atomic_load(&scan->cutoff)) {
+        size_t beg;
+        size_t end;
+        get_chunk(scan, chunk, &beg, &end);
+        CurPos match;
+        bool found = search_chunk(scan->fp, beg, end, matcher, scan->backward, runs, &match);
+
+        pthread_mutex_lock(&scan->lock);
+        scan->results[chunk] = (ChunkResult) {found ? CHUNK_FOUND : CHUNK_NOT_FOUND, match};
+        if (found && chunk < atomic_load(&scan->cutoff)) {
+            atomic_store(&scan->cutoff, chunk);
+        }
+        pthread_cond_broadcast(&scan->done);
+        pthread_mutex_unlock(&scan->lock);
+    }
+    free(runs);
+    free_matcher(matcher);
+    return NULL;
+}
+
+/** Gets how many threads to search with. */
+static size_t count_threads(size_t num_chunks) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_threads = cpus < 1 ? 1 : (size_t) cpus;
+    if (num_threads > MAX_THREADS) {
+        num_threads = MAX_THREADS;
+    }
+    return num_threads < num_chunks ? num_threads : num_chunks;
+}
+
+/**
+ * Searches whole lines. Chunks of lines are handed out to threads, and their
+ * results are taken in order so the first match is returned as soon as every
+ * chunk before it is known not to have one. The threads only read the lines,
+ * so nothing may change them until this returns.
+ *
+ * @param fp the FileProxy to search
+ * @param beg the first line to search
+ * @param end one past the last line to search
+ * @param matcher what to match with on this thread
+ * @param backward whether to find the last match instead of the first
+ * @param runs room for WINDOW_LINES runs
+ * @param match set to where the match starts
+ * @return true if the pattern was found
+ */
+static bool search_lines(FileProxy fp, size_t beg, size_t end, Matcher *matcher, bool backward, Run *runs,
+        CurPos *match) {
+    if (beg >= end) {
+        return false;
+    }
+    size_t num_chunks = (end - beg + WINDOW_LINES - 1) / WINDOW_LINES;
+    size_t num_threads = count_threads(num_chunks);
+    if (num_threads <= 1) {
+        Scan scan = {.beg = beg, .end = end, .backward = backward};
+        for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+            size_t chunk_beg;
+            size_t chunk_end;
+            get_chunk(&scan, chunk, &chunk_beg, &chunk_end);
+            if (search_chunk(fp, chunk_beg, chunk_end, matcher, backward, runs, match)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Scan scan = {
+        .fp = fp, .pat = matcher->pat, .beg = beg, .end = end, .backward = backward, .num_chunks = num_chunks
+    };
+    atomic_init(&scan.next_chunk, 0);
+    atomic_init(&scan.cutoff, num_chunks);
+    pthread_mutex_init(&scan.lock, NULL);
+    pthread_cond_init(&scan.done, NULL);
+    scan.results = calloc(num_chunks, sizeof(ChunkResult));
+    pthread_t threads[MAX_THREADS];
+    if (scan.results == NULL) {
+        fprintf(stderr, "Error allocating space for search.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, scan_chunks, &scan) != 0) {
+            fprintf(stderr, "Error starting search thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    bool found = false;
+    pthread_mutex_lock(&scan.lock);
+    for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+        while (scan.results[chunk].state == CHUNK_PENDING) {
+            pthread_cond_wait(&scan.done, &scan.lock);
+        }
+        if (scan.results[chunk].state == CHUNK_FOUND) {
+            *match = scan.results[chunk].match;
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&scan.lock);
+    // the chunks after the match don't matter
+    atomic_store(&scan.cutoff, 0);
+    for (size_t i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_cond_destroy(&scan.done);
+    pthread_mutex_destroy(&scan.lock);
+    free(scan.results);
+    return found;
+}
+
+/**
+ * Searches for matches that start in a range of one line.
+ *
+ * @param fp the FileProxy to search
+ * @param line_num the line
+ * @param beg the first position a match may start at
+ * @param end one past the last position a match may start at
+ * @param matcher what to match with
+ * @param backward whether to find the last match instead of the first
+ * @param match set to where the match starts
+ * @return true if the pattern was found
+ */
+static bool search_part(FileProxy fp, size_t line_num, size_t beg, size_t end, Matcher *matcher, bool backward,
+        CurPos *match) {
+    size_t len;
+    const char *text = peek_line(fp, tree_get_shared(fp.lines, line_num), &len);
+    size_t start;
+    if (!match_in_line(matcher, text, len, beg, end, backward, &start)) {
+        return false;
+    }
+    *match = (CurPos) {line_num, start};
+    return true;
+}
+
+bool search_fp(FileProxy fp, const Pattern *pat, CurPos from, bool backward, CurPos *match, bool *wrapped) {
+    *wrapped = false;
+    if (pat->len == 0) {
+        return false;
+    }
+    Run *runs = malloc(WINDOW_LINES * sizeof(Run));
+    if (runs == NULL) {
+        fprintf(stderr, "Error allocating space for search.\n");
+        exit(EXIT_FAILURE);
+    }
+    Matcher *matcher = create_matcher(pat);
+
+    bool found;
+    if (!backward) {
+        found = search_part(fp, from.line, from.ch + 1, SIZE_MAX, matcher, false, match);
+        // search the lines that have been loaded while the rest are loaded
+        size_t beg = from.line + 1;
+        while (!found) {
+            size_t end = get_num_lines(fp);
+            found = search_lines(fp, beg, end, matcher, false, runs, match);
+            beg = end;
+            if (found || !wait_for_line(fp, end)) {
+                break;
+            }
+        }
+        if (!found) {
+            *wrapped = true;
+            found = search_lines(fp, 0, from.line, matcher, false, runs, match)
+                || search_part(fp, from.line, 0, from.ch + 1, matcher, false, match);
+        }
+    } else {
+        // the end of the file is needed to go around to it
+        wait_for_line(fp, SIZE_MAX);
+        found = search_part(fp, from.line, 0, from.ch, matcher, true, match)
+            || search_lines(fp, 0, from.line, matcher, true, runs, match);
+        if (!found) {
+            *wrapped = true;
+            found = search_lines(fp, from.line + 1, get_num_lines(fp), matcher, true, runs, match)
+                || search_part(fp, from.line, from.ch, SIZE_MAX, matcher, true, match);
+        }
+    }
+    free_matcher(matcher);
+    free(runs);
+    return found;
+}
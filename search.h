@@ -0,0 +1,127 @@
+/**
+ * @file search.h
+ * @author Willow Rimlinger
+ *
+ * Header for search.c
+ *
+ * Finds text and regular expressions in a FileProxy. Candidates are found with
+ * SIMD instructions when the CPU has them, and lines that haven't been loaded
+ * are scanned straight out of the file a run at a time instead of a line at a
+ * time. Big files are searched by a thread for each core.
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "types.h"
+
+/**
+ * Finds the first place a pattern appears in some text.
+ *
+ * @param text the text to search
+ * @param len the length of the text
+ * @param pat the pattern to look for
+ * @param pat_len the length of the pattern
+ * @return where the pattern starts in the text, or NULL if it isn't in it or
+ *     the pattern is empty
+ */
+const char *find_text(const char *text, size_t len, const char *pat, size_t pat_len);
+
+/**
+ * Finds the last place a pattern appears in some text.
+ *
+ * @param text the text to search
+ * @param len the length of the text
+ * @param pat the pattern to look for
+ * @param pat_len the length of the pattern
+ * @return where the pattern starts in the text, or NULL if it isn't in it or
+ *     the pattern is empty
+ */
+const char *find_last_text(const char *text, size_t len, const char *pat, size_t pat_len);
+
+/**
+ * Compiles a pattern to search for. A pattern with any of \.[]()*+?|^$ in it
+ * is a regular expression (see regex.h). Any other pattern is plain text.
+ *
+ * @param text the pattern
+ * @param len the length of the pattern
+ * @param err set to what's wrong with the pattern if it can't be compiled
+ * @return the compiled pattern, or NULL if it can't be compiled
+ */
+Pattern *compile_pattern(const char *text, size_t len, const char **err);
+
+/**
+ * Frees a compiled pattern.
+ *
+ * @param pat the pattern to free
+ */
+void free_pattern(Pattern *pat);
+
+/**
+ * Gets the text a pattern was compiled from.
+ *
+ * @param pat the pattern
+ * @param len set to the length of the text
+ * @return the text, which isn't null terminated
+ */
+const char *get_pattern_text(const Pattern *pat, size_t *len);
+
+/**
+ * Creates what a thread needs to match a pattern with. A Matcher can't be
+ * shared between threads but the Pattern can.
+ *
+ * @param pat the pattern, which has to outlive the Matcher
+ * @return the new Matcher
+ */
+Matcher *create_matcher(const Pattern *pat);
+
+/**
+ * Frees a Matcher.
+ *
+ * @param matcher the Matcher to free
+ */
+void free_matcher(Matcher *matcher);
+
+/**
+ * Finds the first match that starts at or after a position in a line.
+ *
+ * @param matcher what to match with
+ * @param text the line, with no \n in it
+ * @param len the length of the line
+ * @param beg where to start looking. an empty match can start at len.
+ * @param start set to where the match starts
+ * @param match_len set to the length of the match
+ * @return true if there is a match
+ */
+bool find_match(Matcher *matcher, const char *text, size_t len, size_t beg, size_t *start, size_t *match_len);
+
+/**
+ * Finds the first line that has a match in some lines.
+ *
+ * @param matcher what to match with
+ * @param text the lines, separated by \n. has to start at the beginning of a line.
+ * @param len the length of the text
+ * @return where the line starts, or NULL if no line has a match
+ */
+const char *find_matching_line(Matcher *matcher, const char *text, size_t len);
+
+/**
+ * Finds the next place a pattern appears in a FileProxy after a position,
+ * going around to the other end of the file if it isn't found before the end.
+ * Waits for as much of the file to be loaded as it needs to look through.
+ *
+ * @param fp the FileProxy to search
+ * @param pat the pattern to look for. a plain text pattern can't contain a \n.
+ * @param from where to search from. a match starting right at it is only found
+ *     after going all the way around.
+ * @param backward whether to search up the file instead of down
+ * @param match set to where the match starts
+ * @param wrapped set to whether the search went around the end of the file
+ * @return true if the pattern was found
+ */
+bool search_fp(FileProxy fp, const Pattern *pat, CurPos from, bool backward, CurPos *match, bool *wrapped);
+
+#endif
@@ -0,0 +1,140 @@
+/**
+ * @file stats.c
+ * @author Willow Rimlinger
+ *
+ * Latency histograms for the hot paths of the editor. Each histogram splits
+ * every power of two of nanoseconds into SUB_BUCKETS buckets, so adding a
+ * sample is a few shifts and an increment and every percentile is within
+ * 1 / SUB_BUCKETS of the real value.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "types.h"
+#include "stats.h"
+
+#define SUB_BITS 3
+#define SUB_BUCKETS (1 << SUB_BITS)
+// enough buckets for any 64 bit number of nanoseconds
+#define NUM_BUCKETS ((64 - SUB_BITS + 1) * SUB_BUCKETS)
+
+static const char *STAT_NAMES[] = {"input_to_paint", "edit", "render"};
+// shorter names that fit in the status bar
+static const char *STAT_LABELS[] = {"paint", "edit", "render"};
+
+typedef struct Histogram_s {
+    uint64_t buckets[NUM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+} Histogram;
+
+static Histogram histograms[NUM_STATS];
+
+/**
+ * Gets the bucket a number of nanoseconds goes in. Numbers below SUB_BUCKETS
+ * get a bucket each. Above that, the highest bit picks the power of two and the
+ * SUB_BITS bits below it pick the bucket within it.
+ */
+static size_t bucket_of(uint64_t ns) {
+    if (ns < SUB_BUCKETS) {
+        return ns;
+    }
+    int high_bit = 63 - __builtin_clzll(ns);
+    size_t sub = (ns >> (high_bit - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return (high_bit - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+/** Gets the smallest number of nanoseconds that goes in a bucket */
+static uint64_t bucket_start(size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    int high_bit = bucket / SUB_BUCKETS + SUB_BITS - 1;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    return (SUB_BUCKETS + sub) << (high_bit - SUB_BITS);
+}
+
+/**
+ * Gets a percentile of a histogram. Reports the middle of the bucket it falls
+ * in, but never more than the largest sample.
+ *
+ * @param hist the histogram
+ * @param percent the percentile, from 0 to 100
+ * @return the percentile in nanoseconds, 0 if nothing was recorded
+ */
+static uint64_t percentile(const Histogram *hist, double percent) {
+    if (hist->count == 0) {
+        return 0;
+    }
+    // the rank of the sample that is at the percentile, counting from 1
+    uint64_t rank = (uint64_t) (percent / 100 * hist->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint64_t start = bucket_start(i);
+            uint64_t mid = start + (bucket_start(i + 1) - start) / 2;
+            return mid < hist->max ? mid : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+uint64_t stat_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void record_stat(Stat stat, uint64_t start) {
+    uint64_t ns = stat_clock() - start;
+    Histogram *hist = &histograms[stat];
+    hist->buckets[bucket_of(ns)]++;
+    hist->count++;
+    hist->sum += ns;
+    if (ns > hist->max) {
+        hist->max = ns;
+    }
+}
+
+void format_stats(char *buf, size_t len) {
+    size_t used = snprintf(buf, len, "p50/p99/max ms:");
+    for (Stat stat = 0; stat < NUM_STATS && used < len; stat++) {
+        const Histogram *hist = &histograms[stat];
+        used += snprintf(buf + used, len - used, "%s %s %.2f/%.2f/%.2f",
+                stat == 0 ? "" : ",", STAT_LABELS[stat],
+                percentile(hist, 50) / 1e6, percentile(hist, 99) / 1e6, hist->max / 1e6);
+    }
+}
+
+bool dump_stats(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        return false;
+    }
+    for (Stat stat = 0; stat < NUM_STATS; stat++) {
+        const Histogram *hist = &histograms[stat];
+        fprintf(file, "{\"stat\": \"%s\", \"count\": %lu, \"mean_ns\": %.0f, \"p50_ns\": %lu, "
+                "\"p90_ns\": %lu, \"p99_ns\": %lu, \"p999_ns\": %lu, \"max_ns\": %lu, \"buckets\": [",
+                STAT_NAMES[stat], hist->count, hist->count > 0 ? (double) hist->sum / hist->count : 0,
+                percentile(hist, 50), percentile(hist, 90), percentile(hist, 99), percentile(hist, 99.9),
+                hist->max);
+        // only the buckets that were used, as [smallest ns, count]
+        bool first = true;
+        for (size_t i = 0; i < NUM_BUCKETS; i++) {
+            if (hist->buckets[i] > 0) {
+                fprintf(file, "%s[%lu, %lu]", first ? "" : ", ", bucket_start(i), hist->buckets[i]);
+                first = false;
+            }
+        }
+        fprintf(file, "]}\n");
+    }
+    return fclose(file) == 0;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file stats.h
+ * @author Willow Rimlinger
+ *
+ * Header for stats.c
+ *
+ * Records how long the hot paths of the editor take in histograms that cost a
+ * few nanoseconds to add to, so latency can be watched while editing real files.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "types.h"
+
+/**
+ * Reads the clock that stats are timed with.
+ *
+ * @return the current time in nanoseconds
+ */
+uint64_t stat_clock(void);
+
+/**
+ * Records how long something took.
+ *
+ * @param stat what was timed
+ * @param start the stat_clock time it started at
+ */
+void record_stat(Stat stat, uint64_t start);
+
+/**
+ * Describes the p50, p99 and max of every stat in one line.
+ *
+ * @param buf where to write the description
+ * @param len the size of buf
+ */
+void format_stats(char *buf, size_t len);
+
+/**
+ * Writes every stat and its histogram to a file as one line of JSON each.
+ *
+ * @param filename the file to write to, which is overwritten
+ * @return true if the stats were written, false if not with errno set
+ */
+bool dump_stats(const char *filename);
+
+#endif
@@ -0,0 +1,423 @@
+/**
+ * @file display_test.c
+ * @author Willow Rimlinger
+ *
+ * Regression tests for display(). Known files are drawn on the grid renderer
+ * and every row of the screen is compared byte for byte with the frame it
+ * should be, so changes to what is drawn show up without a terminal.
+ *
+ * usage: wim_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "../types.h"
+#include "../fileproxy.h"
+#include "../display.h"
+#include "../render.h"
+#include "../search.h"
+#include "../match_index.h"
+#include "../motions.h"
+#include "../insert.h"
+
+#define SCREEN_LINES 5
+#define SCREEN_COLS 20
+static const useconds_t COUNT_POLL_US = 100;
+
+static int failures = 0;
+
+/** The state a frame is drawn with */
+typedef struct Frame_s {
+    FileProxy fp;
+    View view;
+    MimState ms;
+    FileProxy cmd_fp;
+    View cmd_view;
+    char *status_msg;
+} Frame;
+
+/**
+ * Sets up a frame of a file in normal mode with the cursor at the start.
+ *
+ * @param frame the frame to set up
+ * @param text the text of the file, which must outlive the frame
+ */
+static void start_frame(Frame *frame, const char *text) {
+    frame->fp = split_buffer(text, strlen(text));
+    frame->view = (View) {0, 0, SCREEN_LINES - 1, SCREEN_COLS, {0, 0}, 0, 0};
+    frame->cmd_fp = create_empty_fp();
+    frame->cmd_view = (View) {0, 0, 1, SCREEN_COLS - 1, {0, 0}, 0, 0};
+    frame->status_msg = malloc(MAX_STATUS_MSG_LEN);
+    if (frame->status_msg == NULL) {
+        fprintf(stderr, "Error allocating space for status message.\n");
+        exit(EXIT_FAILURE);
+    }
+    frame->status_msg[0] = '\0';
+    frame->ms = (MimState) {&frame->cmd_fp, &frame->cmd_view, frame->status_msg, NORMAL, ':', {NULL, false}};
+}
+
+static void end_frame(Frame *frame) {
+    free_fp(frame->cmd_fp);
+    free_fp(frame->fp);
+    free(frame->status_msg);
+}
+
+/**
+ * Draws a frame on a new grid. The grid is new so every row is drawn.
+ *
+ * @return the grid, which needs to be freed
+ */
+static Renderer draw(Frame *frame) {
+    Renderer grid = create_grid_renderer(SCREEN_LINES, SCREEN_COLS);
+    set_renderer(grid);
+    display(frame->ms, frame->fp, frame->view);
+    return grid;
+}
+
+/**
+ * Draws a frame again on the grid it was last drawn on, so only what changed
+ * since then is drawn.
+ */
+static void redraw(Frame *frame) {
+    display(frame->ms, frame->fp, frame->view);
+}
+
+/**
+ * Checks every row of a grid against the rows it should have.
+ *
+ * @param test the name of the test, for the failure message
+ * @param grid the grid that was drawn on
+ * @param rows the text each row should have, including trailing spaces
+ */
+static void expect_rows(const char *test, Renderer grid, const char *rows[SCREEN_LINES]) {
+    for (size_t row = 0; row < SCREEN_LINES; row++) {
+        size_t len;
+        const char *text = get_grid_row(grid, row, &len);
+        if (len != strlen(rows[row]) || memcmp(text, rows[row], len) != 0) {
+            fprintf(stderr, "%s: row %zu is \"%.*s\", expected \"%s\"\n", test, row, (int) len, text, rows[row]);
+            failures++;
+        }
+    }
+}
+
+/**
+ * Checks where the cursor of a grid is.
+ *
+ * @param test the name of the test, for the failure message
+ * @param grid the grid that was drawn on
+ * @param row the row the cursor should be on
+ * @param col the column the cursor should be on
+ */
+static void expect_cursor(const char *test, Renderer grid, size_t row, size_t col) {
+    CurPos cur = get_grid_cursor(grid);
+    if (cur.line != row || cur.ch != col) {
+        fprintf(stderr, "%s: cursor is at %zu,%zu, expected %zu,%zu\n", test, cur.line, cur.ch, row, col);
+        failures++;
+    }
+}
+
+/**
+ * Checks a grid that was drawn on more than once against a new grid with the
+ * same frame drawn on it once. The new grid becomes the one that is drawn on.
+ *
+ * @param test the name of the test, for the failure message
+ * @param grid the grid that was drawn on more than once
+ * @param frame the frame last drawn on the grid
+ */
+static void expect_fresh(const char *test, Renderer grid, Frame *frame) {
+    Renderer fresh = draw(frame);
+    for (size_t row = 0; row < SCREEN_LINES; row++) {
+        size_t len, fresh_len;
+        const char *text = get_grid_row(grid, row, &len);
+        const char *fresh_text = get_grid_row(fresh, row, &fresh_len);
+        if (len != fresh_len || memcmp(text, fresh_text, len) != 0) {
+            fprintf(stderr, "%s: row %zu is \"%.*s\", drawn once it is \"%.*s\"\n", test, row, (int) len, text,
+                (int) fresh_len, fresh_text);
+            failures++;
+        }
+    }
+    CurPos cur = get_grid_cursor(fresh);
+    expect_cursor(test, grid, cur.line, cur.ch);
+    free_renderer(fresh);
+}
+
+static const char *LINES_TEXT = "short\nthis line is longer than the screen\n\tx\n";
+
+static void test_nowrap(void) {
+    Frame frame;
+    start_frame(&frame, LINES_TEXT);
+    Renderer grid = draw(&frame);
+    const char *rows[] = {
+        "short               ",
+        "this line is longer ",
+        "        x           ",
+        "                    ",
+        "                    ",
+    };
+    expect_rows("nowrap", grid, rows);
+    expect_cursor("nowrap", grid, 0, 0);
+    free_renderer(grid);
+    end_frame(&frame);
+}
+
+static void test_soft_wrap(void) {
+    Frame frame;
+    start_frame(&frame, LINES_TEXT);
+    set_wrap_width(frame.fp, SCREEN_COLS);
+    frame.view.cur = (CurPos) {1, 25};
+    Renderer grid = draw(&frame);
+    const char *rows[] = {
+        "short               ",
+        "this line is longer ",
+        "than the screen     ",
+        "        x           ",
+        "                    ",
+    };
+    expect_rows("soft_wrap", grid, rows);
+    // the cursor is on the second row of the wrapped line
+    expect_cursor("soft_wrap", grid, 2, 5);
+    free_renderer(grid);
+    end_frame(&frame);
+}
+
+static void test_wide_char(void) {
+    Frame frame;
+    start_frame(&frame, "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9ex\n");
+    // on the x after three chars that are two columns wide
+    frame.view.cur = (CurPos) {0, 9};
+    Renderer grid = draw(&frame);
+    const char *rows[] = {
+        "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9ex             ",
+        "                    ",
+        "                    ",
+        "                    ",
+        "                    ",
+    };
+    expect_rows("wide_char", grid, rows);
+    expect_cursor("wide_char", grid, 0, 6);
+    free_renderer(grid);
+    end_frame(&frame);
+}
+
+static void test_tab(void) {
+    Frame frame;
+    start_frame(&frame, "a\tb\n\t\tc\n");
+    frame.view.cur = (CurPos) {1, 2};
+    Renderer grid = draw(&frame);
+    const char *rows[] = {
+        "a       b           ",
+        "                c   ",
+        "                    ",
+        "                    ",
+        "                    ",
+    };
+    expect_rows("tab", grid, rows);
+    expect_cursor("tab", grid, 1, 16);
+    free_renderer(grid);
+    end_frame(&frame);
+}
+
+static void test_highlight(void) {
+    Frame frame;
+    start_frame(&frame, "foo bar foo\nbar\n");
+    const char *err;
+    Pattern *pat = compile_pattern("foo", 3, &err);
+    set_match_pattern(frame.fp, pat);
+    while (update_match_index(frame.fp)) {
+        usleep(COUNT_POLL_US);
+    }
+    Renderer grid = draw(&frame);
+    const char *rows[] = {
+        "foo bar foo         ",
+        "bar                 ",
+        "                    ",
+        "                    ",
+        "        match 1 of 2",
+    };
+    expect_rows("highlight", grid, rows);
+    for (size_t col = 0; col < SCREEN_COLS; col++) {
+        bool in_match = col < 3 || (col >= 8 && col < 11);
+        if (is_grid_highlighted(grid, 0, col) != in_match) {
+            fprintf(stderr, "highlight: column %zu is%s highlighted\n", col, in_match ? " not" : "");
+            failures++;
+        }
+        if (is_grid_highlighted(grid, 1, col)) {
+            fprintf(stderr, "highlight: column %zu of the line without matches is highlighted\n", col);
+            failures++;
+        }
+    }
+    free_renderer(grid);
+    set_match_pattern(frame.fp, NULL);
+    free_pattern(pat);
+    end_frame(&frame);
+}
+
+static void test_status_bar(void) {
+    Frame frame;
+    start_frame(&frame, "text\n");
+    strcpy(frame.status_msg, "\"f\" 1L, 5B written");
+    Renderer grid = draw(&frame);
+    const char *rows[] = {
+        "text                ",
+        "                    ",
+        "                    ",
+        "                    ",
+        "\"f\" 1L, 5B written  ",
+    };
+    expect_rows("status_bar", grid, rows);
+    free_renderer(grid);
+
+    frame.ms.mode = INSERT;
+    grid = draw(&frame);
+    rows[4] = "-- INSERT --        ";
+    expect_rows("status_bar_insert", grid, rows);
+    free_renderer(grid);
+    end_frame(&frame);
+}
+
+static const char *LONG_TEXT = "0\n1\n2\n3\n4\n5\n6\n7\n8\n9\n";
+
+static void test_edit_redraw(void) {
+    Frame frame;
+    start_frame(&frame, LINES_TEXT);
+    Renderer grid = draw(&frame);
+    frame.ms.mode = INSERT;
+    move_down(frame.fp, &frame.view, frame.ms);
+    insert_char('X', &frame.fp, &frame.view, frame.ms);
+    redraw(&frame);
+    frame.ms.mode = NORMAL;
+    move_to_line(frame.fp, &frame.view, frame.ms, 0);
+    // the cursor keeps its column, so this deletes the h
+    delete_char(&frame.fp, &frame.view, frame.ms);
+    redraw(&frame);
+    const char *rows[] = {
+        "sort                ",
+        "Xthis line is longer",
+        "        x           ",
+        "                    ",
+        "                    ",
+    };
+    expect_rows("edit_redraw", grid, rows);
+    expect_fresh("edit_redraw", grid, &frame);
+    free_renderer(grid);
+    end_frame(&frame);
+}
+
+static void test_pan_redraw(void) {
+    Frame frame;
+    start_frame(&frame, LONG_TEXT);
+    Renderer grid = draw(&frame);
+    // one line down, then two, then back up one
+    move_down_by(frame.fp, &frame.view, frame.ms, 4);
+    redraw(&frame);
+    move_down_by(frame.fp, &frame.view, frame.ms, 2);
+    redraw(&frame);
+    move_up_by(frame.fp, &frame.view, frame.ms, 4);
+    move_up(frame.fp, &frame.view, frame.ms);
+    redraw(&frame);
+    const char *rows[] = {
+        "1                   ",
+        "2                   ",
+        "3                   ",
+        "4                   ",
+        "                    ",
+    };
+    expect_rows("pan_redraw", grid, rows);
+    expect_fresh("pan_redraw", grid, &frame);
+    free_renderer(grid);
+    end_frame(&frame);
+}
+
+static void test_wrap_toggle(void) {
+    Frame frame;
+    start_frame(&frame, LINES_TEXT);
+    frame.view.cur = (CurPos) {1, 25};
+    Renderer grid = draw(&frame);
+    set_wrap_width(frame.fp, frame.view.hlimit);
+    pan(frame.fp, &frame.view);
+    redraw(&frame);
+    expect_fresh("wrap_toggle_on", grid, &frame);
+    free_renderer(grid);
+
+    grid = draw(&frame);
+    set_wrap_width(frame.fp, 0);
+    pan(frame.fp, &frame.view);
+    redraw(&frame);
+    expect_fresh("wrap_toggle_off", grid, &frame);
+    free_renderer(grid);
+    end_frame(&frame);
+}
+
+static void test_wrap_scroll(void) {
+    Frame frame;
+    start_frame(&frame, LINES_TEXT);
+    set_wrap_width(frame.fp, SCREEN_COLS);
+    Renderer grid = draw(&frame);
+    // a new line above the x scrolls by part of the wrapped line
+    move_down_by(frame.fp, &frame.view, frame.ms, 2);
+    frame.ms.mode = INSERT;
+    insert_newline(&frame.fp, &frame.view, frame.ms);
+    redraw(&frame);
+    const char *rows[] = {
+        "this line is longer ",
+        "than the screen     ",
+        "                    ",
+        "                x   ",
+        "-- INSERT --        ",
+    };
+    expect_rows("wrap_scroll", grid, rows);
+    expect_fresh("wrap_scroll", grid, &frame);
+    free_renderer(grid);
+    end_frame(&frame);
+}
+
+static void test_enter_at_wrap(void) {
+    Frame frame;
+    start_frame(&frame, "this line is longer than the screen\nshort\n");
+    set_wrap_width(frame.fp, SCREEN_COLS);
+    // the second row of the wrapped line is at the top of the screen
+    frame.view.top_row = 1;
+    frame.view.cur = (CurPos) {0, SCREEN_COLS};
+    Renderer grid = draw(&frame);
+    frame.ms.mode = INSERT;
+    insert_newline(&frame.fp, &frame.view, frame.ms);
+    redraw(&frame);
+    // the line above now fits on one row, so the text that was on the screen stays where it was
+    const char *rows[] = {
+        "than the screen     ",
+        "short               ",
+        "                    ",
+        "                    ",
+        "-- INSERT --        ",
+    };
+    expect_rows("enter_at_wrap", grid, rows);
+    expect_cursor("enter_at_wrap", grid, 0, 0);
+    expect_fresh("enter_at_wrap", grid, &frame);
+    free_renderer(grid);
+    end_frame(&frame);
+}
+
+int main(void) {
+    test_nowrap();
+    test_soft_wrap();
+    test_wide_char();
+    test_tab();
+    test_highlight();
+    test_status_bar();
+    test_edit_redraw();
+    test_pan_redraw();
+    test_wrap_toggle();
+    test_wrap_scroll();
+    test_enter_at_wrap();
+    if (failures > 0) {
+        fprintf(stderr, "%d check%s failed\n", failures, failures == 1 ? "" : "s");
+        return EXIT_FAILURE;
+    }
+    printf("all display tests passed\n");
+    return EXIT_SUCCESS;
+}
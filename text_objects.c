@@ -5,163 +5,89 @@
  * Functions that define the beginnings and ends of text objects
  */
 
-#include <ctype.h>
 #include <stdbool.h>
-#include <ctype.h>
 
 #include "log.h"
 #include "types.h"
-
-bool is_word(const char ch) {
-    return isalnum(ch) || ch == '_';
-}
-
-bool is_not_word(const char ch) {
-    return !is_word(ch);
-}
-
-bool is_word_or_ws(const char ch) {
-    return is_word(ch) || isspace(ch);
-}
-
-bool is_not_ws(const char ch) {
-    return !isspace(ch);
-}
-
-bool is_not_word_not_ws(const char ch) {
-    return !is_word(ch) && is_not_ws(ch);
-}
+#include "fileproxy.h"
+#include "words.h"
 
 CurPos get_beg_pos_cur_word(FileProxy fp, CurPos current_pos) {
-    bool (*is_different)(const char);
-    if (is_word(fp.lines[current_pos.line]->text[current_pos.ch])) {
-        is_different = &is_not_word;
-    } else if (is_not_word_not_ws(fp.lines[current_pos.line]->text[current_pos.ch])) {
-        is_different = &is_word_or_ws;
-    } else {
-        is_different = &is_not_ws;
-    }
-
+    Line *line = get_line(fp, current_pos.line);
+    CharClass class = get_char_class(line->text[current_pos.ch]);
     CurPos pos = current_pos;
-    for (size_t c = current_pos.ch; c-- > 0; ) {
-        char ch = fp.lines[pos.line]->text[c];
-        if (is_different(ch)) {
-            return pos;
-        }
-        pos.ch = c;
+    while (pos.ch > 0 && get_char_class(line->text[pos.ch - 1]) == class) {
+        pos.ch--;
     }
     return pos;
 }
 
-CurPos get_beg_pos_n_word(FileProxy fp, CurPos current_pos) {
-    bool (*is_different)(const char);
-    if (is_word(fp.lines[current_pos.line]->text[current_pos.ch])) {
-        is_different = &is_not_word_not_ws;
-    } else if (is_not_word_not_ws(fp.lines[current_pos.line]->text[current_pos.ch])) {
-        is_different = &is_word;
-    } else {
-        is_different = &is_not_ws;
+CurPos get_beg_pos_n_word(FileProxy fp, CurPos current_pos, size_t count) {
+    size_t n = count > 0 ? count : 1;
+    size_t l = current_pos.line;
+    size_t ch = find_next_word_start(fp, get_line(fp, l), current_pos.ch + 1, &n);
+    if (ch != SIZE_MAX) {
+        CurPos new_pos = {l, ch};
+        return new_pos;
     }
-
-    CurPos pos = current_pos;
-    bool seen_ws = false;
-    for (size_t l = current_pos.line; l < fp.len; l++) {
-        size_t c;
-        if (l == current_pos.line) {
-            c = current_pos.ch;
-        } else {
-            // start at the first char on each line after the current
-            c = 0;
-
-            // also check that if we are on a new empty line because that counts
-            // as the beginning of a word (but not the end aparrently)
-            if (fp.lines[l]->len == 0) {
-                CurPos new_pos = {l, c};
+    while (wait_for_line(fp, l + 1)) {
+        l++;
+        Line *line = get_line(fp, l);
+        // an empty line counts as the beginning of a word (but not the end aparrently)
+        if (line->len == 0) {
+            if (--n == 0) {
+                CurPos new_pos = {l, 0};
                 return new_pos;
             }
-            // a word of the same type (word or punctuation) continuing on the next line is a new word
-            seen_ws = true;
+            continue;
         }
-        for (/* see above */ ; c < fp.lines[l]->len; c++) {
-            char ch = fp.lines[l]->text[c];
-            CurPos new_pos = {l, c};
-            pos = new_pos;
-            if (isspace(ch)) {
-                seen_ws = true;
-            }
-            if (seen_ws) {
-                // once we've seen whitespace, words or punctuation are fair game
-                is_different = &is_not_ws;
-            }
-            if (is_different(ch)) {
-                // we found it
-                return pos;
-            }
+        // a word of the same type (word or punctuation) continuing on the next line is a new word
+        ch = find_next_word_start(fp, line, 0, &n);
+        if (ch != SIZE_MAX) {
+            CurPos new_pos = {l, ch};
+            return new_pos;
         }
     }
-    // this results in us going to the end of the buffer if there aren't any more words
-    return pos;
-}
 
-CurPos get_beg_pos_p_word(FileProxy fp, CurPos current_pos) {
-    char beg_ch = fp.lines[current_pos.line]->text[current_pos.ch];
-    if (is_not_ws(beg_ch)) {
-        CurPos beg_pos_cur_word = get_beg_pos_cur_word(fp, current_pos);
-        if (
-            beg_pos_cur_word.line != current_pos.line
-            || beg_pos_cur_word.ch != current_pos.ch
-        ) {
-            return beg_pos_cur_word;
-        }
+    // this results in us going to the end of the buffer if there aren't any more words
+    Line *last_line = get_line(fp, l);
+    if (last_line->len == 0) {
+        CurPos new_pos = {l, 0};
+        return l == current_pos.line ? current_pos : new_pos;
     }
-
-    bool (*is_different)(const char);
-    if (is_word(beg_ch)) {
-        is_different = &is_not_word_not_ws;
-    } else if (is_not_word_not_ws(beg_ch)) {
-        is_different = &is_word;
-    } else {
-        is_different = &is_not_ws;
+    if (l == current_pos.line && current_pos.ch >= last_line->len) {
+        return current_pos;
     }
+    CurPos new_pos = {l, last_line->len - 1};
+    return new_pos;
+}
 
-    CurPos pos = current_pos;
-    bool seen_ws = false;
-    for (size_t l = current_pos.line + 1; l-- > 0; ) {
-        size_t c;
-        if (l == current_pos.line) {
-            c = current_pos.ch + 1;
-        } else {
-            // start at the last char of each line after the current
-            c = fp.lines[l]->len;
-
-            // also check that if we are on a new empty line because that counts
-            // as the beginning of a word (but not the end aparrently)
-            if (fp.lines[l]->len == 0) {
-                CurPos new_pos = {l, c};
+CurPos get_beg_pos_p_word(FileProxy fp, CurPos current_pos, size_t count) {
+    size_t n = count > 0 ? count : 1;
+    size_t ch = find_prev_word_start(fp, get_line(fp, current_pos.line), current_pos.ch, &n);
+    if (ch != SIZE_MAX) {
+        CurPos new_pos = {current_pos.line, ch};
+        return new_pos;
+    }
+    for (size_t l = current_pos.line; l-- > 0; ) {
+        Line *line = get_line(fp, l);
+        // an empty line counts as the beginning of a word
+        if (line->len == 0) {
+            if (--n == 0) {
+                CurPos new_pos = {l, 0};
                 return new_pos;
             }
-            // a word of the same type (word or punctuation) continuing on the next line is a new word
-            seen_ws = true;
+            continue;
         }
-        for (/* see above */ ; c-- > 0; ) {
-            char ch = fp.lines[l]->text[c];
-            CurPos new_pos = {l, c};
-            pos = new_pos;
-            if (isspace(ch)) {
-                seen_ws = true;
-            }
-            if (seen_ws) {
-                // once we've seen whitespace, words or punctuation are fair game
-                is_different = &is_not_ws;
-            }
-            if (is_different(ch)) {
-                // we found it
-                return get_beg_pos_cur_word(fp, pos);
-            }
+        ch = find_prev_word_start(fp, line, SIZE_MAX, &n);
+        if (ch != SIZE_MAX) {
+            CurPos new_pos = {l, ch};
+            return new_pos;
         }
     }
-    // this results in us going to the end of the buffer if there aren't any more words
-    return get_beg_pos_cur_word(fp, pos);
+    // this results in us going to the start of the buffer if there aren't any more words
+    CurPos new_pos = {0, 0};
+    return new_pos;
 }
 
 CurPos get_beg_pos_cur_tobj(FileProxy fp, CurPos current_pos, TextObject tobj) {
@@ -169,6 +95,7 @@ CurPos get_beg_pos_cur_tobj(FileProxy fp, CurPos current_pos, TextObject tobj) {
         case WORD:
             return get_beg_pos_cur_word(fp, current_pos);
     }
+    return current_pos;
 }
 
 /*CurPos get_end_pos_cur_tobj(FileProxy fp, CurPos current_pos, TextObject tobj) {*/
@@ -178,17 +105,19 @@ CurPos get_beg_pos_cur_tobj(FileProxy fp, CurPos current_pos, TextObject tobj) {
 /*    }*/
 /*}*/
 /**/
-CurPos get_beg_pos_n_tobj(FileProxy fp, CurPos current_pos, TextObject tobj) {
+CurPos get_beg_pos_n_tobj(FileProxy fp, CurPos current_pos, TextObject tobj, size_t count) {
     switch (tobj) {
         case WORD:
-            return get_beg_pos_n_word(fp, current_pos);
+            return get_beg_pos_n_word(fp, current_pos, count);
     }
+    return current_pos;
 }
 
-CurPos get_beg_pos_p_tobj(FileProxy fp, CurPos current_pos, TextObject tobj) {
+CurPos get_beg_pos_p_tobj(FileProxy fp, CurPos current_pos, TextObject tobj, size_t count) {
     switch (tobj) {
         case WORD:
-            return get_beg_pos_p_word(fp, current_pos);
+            return get_beg_pos_p_word(fp, current_pos, count);
     }
+    return current_pos;
 }
 
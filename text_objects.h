@@ -34,9 +34,10 @@ CurPos get_end_pos_tobj(FileProxy fp, CurPos current_pos, TextObject tobj);
  * @param fp the fileproxy to find the text object in
  * @param current_pos the current cursor position
  * @param tobj the text object to find the first character of
+ * @param count how many text objects to move forward by
  * @return the position in the fileproxy of the first character of the next text object
  */
-CurPos get_beg_pos_n_tobj(FileProxy fp, CurPos current_pos, TextObject tobj);
+CurPos get_beg_pos_n_tobj(FileProxy fp, CurPos current_pos, TextObject tobj, size_t count);
 
 /**
  * Get the position in a FileProxy of the first character of the previous text object
@@ -45,6 +46,7 @@ CurPos get_beg_pos_n_tobj(FileProxy fp, CurPos current_pos, TextObject tobj);
  * @param fp the fileproxy to find the text object in
  * @param current_pos the current cursor position
  * @param tobj the text object to find the first character of
+ * @param count how many text objects to move back by
  * @return the position in the fileproxy of the first character of the previous text object
  */
-CurPos get_beg_pos_p_tobj(FileProxy fp, CurPos current_pos, TextObject tobj);
+CurPos get_beg_pos_p_tobj(FileProxy fp, CurPos current_pos, TextObject tobj, size_t count);
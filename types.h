@@ -9,26 +9,168 @@
 #define TYPES_H
 
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
 
-/** Represents an individual line in a FileProxy */
+/** The number of chars, including the \0, that a Line can hold without a buffer */
+#define LINE_INLINE_LEN 40
+
+/**
+ * Represents an individual line in a FileProxy. A line is a piece of text that
+ * either points into the original buffer of its FileProxy or, once it has been
+ * edited, into a buffer of its own.
+ */
 typedef struct Line_s {
     char *text;
-    size_t num;
     size_t len; // the number of characters in the line. doesn't count the \0.
-    size_t cap;
+    size_t cap; // 0 if text is a read-only view into the FileProxy's original buffer
+    // short lines keep their text here instead of in a buffer of their own
+    char inline_text[LINE_INLINE_LEN];
 } Line;
 
-/** Represents a file and has some metadata information about line and buffer lengths */
+/**
+ * A place for a line in a FileProxy. Lines that have not been displayed or
+ * edited yet don't have a Line and are only an offset into the original buffer.
+ */
+typedef struct LineSlot_s {
+    // NULL until the line is first needed. use get_line to access lines.
+    Line *line;
+    // where the line begins in the original buffer
+    size_t off;
+} LineSlot;
+
+/** Allocates the Line headers of a FileProxy. Defined in arena.c. */
+typedef struct LineArena_s LineArena;
+
+/** Holds the LineSlots of a FileProxy in order. Defined in line_tree.c. */
+typedef struct LineTree_s LineTree;
+
+/** Indexes the lines of a file in the background. Defined in loader.c. */
+typedef struct Loader_s Loader;
+
+/** Remembers the columns of long lines. Defined in columns.c. */
+typedef struct ColCache_s ColCache;
+
+/** Remembers where words start in long lines. Defined in words.c. */
+typedef struct WordCache_s WordCache;
+
+/** A compiled regular expression. Defined in regex.c. */
+typedef struct Regex_s Regex;
+
+/** The lazily built DFA of a Regex. Defined in regex.c. */
+typedef struct Dfa_s Dfa;
+
+/** Something to search for, either literal text or a Regex. Defined in search.c. */
+typedef struct Pattern_s Pattern;
+
+/** What a thread matches a Pattern with. Defined in search.c. */
+typedef struct Matcher_s Matcher;
+
+/** Counts the matches of the last search in each line. Defined in match_index.c. */
+typedef struct MatchIndex_s MatchIndex;
+
+/**
+ * The range of lines of a FileProxy that changed since it was last displayed.
+ * Nothing changed if beg >= end.
+ */
+typedef struct Damage_s {
+    size_t beg;
+    // one past the last line that changed. SIZE_MAX if the lines moved, so every
+    // line from beg to the end of the file changed.
+    size_t end;
+} Damage;
+
+/**
+ * Represents a file and has some metadata information about line and buffer
+ * lengths. Lines are numbered by their position in the tree, so use get_line
+ * to get a line by its number and get_num_lines to get the number of lines.
+ * FileProxies are passed around by value, so everything that changes lives
+ * behind a pointer.
+ */
 typedef struct FileProxy_s {
-    Line **lines;
-    size_t len;
+    LineTree *lines;
+    // still indexing the file. NULL if the FileProxy wasn't read from a file.
+    Loader *loader;
+    // where the Lines of the FileProxy are allocated from
+    LineArena *arena;
+    // the original contents of the file that unedited lines point into. NULL if
+    // the FileProxy wasn't read from a file.
+    const char *orig;
+    size_t orig_len;
+    // whether orig is a mapping of the file that needs to be unmapped
+    bool orig_mapped;
+    // the lines that need to be displayed again. See take_damage.
+    Damage *damage;
+    // the number of columns lines are wrapped at. 0 if lines aren't wrapped.
+    size_t *wrap_width;
+    // checkpoints for finding the columns of long lines. See columns.h.
+    ColCache *col_cache;
+    // where words start in long lines. See words.h.
+    WordCache *word_cache;
+    // the matches of the last search, which are highlighted. See match_index.h.
+    MatchIndex *match_index;
 } FileProxy;
 
+/** What happened when a FileProxy was written to disk. See write_fp. */
+typedef struct SaveStats_s {
+    size_t lines;
+    size_t bytes;
+    // how long the save took in milliseconds
+    double ms;
+} SaveStats;
+
+/**
+ * A screen that display() draws on. Each kind of screen fills in the functions
+ * with its own and they are all passed data. See render.h.
+ */
+typedef struct Renderer_s {
+    void *data;
+    // the size of the screen
+    size_t (*lines)(void *data);
+    size_t (*cols)(void *data);
+    // moves the cursor, which is where text is put and where it is shown
+    void (*move)(void *data, size_t row, size_t col);
+    // blanks the row of the cursor from the cursor to the right edge
+    void (*clear_to_eol)(void *data);
+    // puts UTF-8 text at the cursor and moves the cursor past it. every char
+    // must be printable and the text must fit before the right edge.
+    void (*put_text)(void *data, const char *text, size_t len);
+    // whether the text put after this is highlighted
+    void (*set_highlight)(void *data, bool on);
+    // moves the rows from top to one before bottom up by n rows, or down if n is
+    // negative. the rows that are scrolled in are blank.
+    void (*scroll)(void *data, size_t top, size_t bottom, long n);
+    // shows everything that was drawn since the last refresh
+    void (*refresh)(void *data);
+    void (*free_data)(void *data);
+} Renderer;
+
+/** The parts of the editor whose latency is recorded. See stats.c. */
+typedef enum Stat_e {
+    // from reading a key to the screen showing what it did
+    STAT_INPUT_TO_PAINT,
+    // applying a key, which runs the edit or motion it is bound to
+    STAT_EDIT,
+    // drawing the screen and refreshing the terminal
+    STAT_RENDER,
+    NUM_STATS,
+} Stat;
+
+/** How important a log message is. See log.c. */
+typedef enum LogLevel_e {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR,
+    // no messages are important enough
+    LOG_OFF,
+} LogLevel;
+
 /** A position in a FileProxy */
 typedef struct CurPos_s {
-    // the character that the cursor is on
+    // the line that the cursor is on
     size_t line;
-    // the character that the cursor is on
+    // the byte where the char that the cursor is on starts
     size_t ch;
 } CurPos;
 
@@ -36,16 +178,18 @@ typedef struct CurPos_s {
 typedef struct View_s {
     // the line that should be at the top of the screen
     size_t top_line;
-    // the character/column that should be at the left of the screen
-    size_t left_ch;
+    // the column that should be at the left of the screen
+    size_t left_col;
     // the number of lines available to display the FileProxy in
     size_t vlimit;
     // the number of cols available to display the FileProxy in
     size_t hlimit;
     // the cursor position
     CurPos cur;
-    // the character that the cursor should be moved to if the line is long enough
-    size_t cur_desired_ch;
+    // the column that the cursor should be moved to if the line is long enough
+    size_t cur_desired_col;
+    // which row of top_line should be at the top of the screen when lines are wrapped
+    size_t top_row;
 } View;
 
 /** The current mode of the mim program */
@@ -55,6 +199,14 @@ typedef enum Mode_e {
     COMMAND,
 } Mode;
 
+/** The last pattern searched for with / or ? */
+typedef struct Search_s {
+    // NULL if nothing has been searched for yet
+    Pattern *pat;
+    // whether it was searched for with ? so that n goes up the file
+    bool backward;
+} Search;
+
 /**
  * Represents the internal state of the mim program. This stuff is "global" 
  * across buffers and there should only be one per program.
@@ -64,8 +216,19 @@ typedef struct MimState_s {
     View *cmd_view;
     char *status_msg;
     Mode mode;
+    // what the command line is for: ':' for commands, '/' or '?' for searches
+    char cmd_prompt;
+    Search search;
 } MimState;
 
+/** What kind of char a byte is when finding words. See words.h. */
+typedef enum CharClass_e {
+    CLASS_SPACE,
+    CLASS_WORD,
+    // anything else, including the bytes of chars outside of ASCII
+    CLASS_PUNCT,
+} CharClass;
+
 /** 
  * Text objects that can be operated on or moved through. What they represent is
  * defined in the functions in text_objects.c. If C were object oriented, they'd
@@ -0,0 +1,277 @@
+/**
+ * @file words.c
+ * @author Willow Rimlinger
+ *
+ * Finds where words start in lines. The class of each byte is looked up in a
+ * table, and the word starts of a line are kept as a bitmap with a bit for
+ * each byte, which is made 64 bytes at a time with SIMD instructions when the
+ * CPU has them. Going over n words is then counting bits instead of looking
+ * at every byte. The bitmaps of the last few long lines that were used are
+ * kept until the lines change.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "types.h"
+#include "words.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// the number of bytes that share a word of a bitmap
+#define BLOCK_LEN 64
+// the number of lines that keep their bitmaps at once
+#define CACHED_LINES 64
+
+#define S CLASS_SPACE
+#define W CLASS_WORD
+#define P CLASS_PUNCT
+// whitespace is what isspace is in the C locale, and words are made of what
+// isalnum is and _
+static const unsigned char CHAR_CLASSES[256] = {
+    P, P, P, P, P, P, P, P, P, S, S, S, S, S, P, P,
+    P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+    S, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+    W, W, W, W, W, W, W, W, W, W, P, P, P, P, P, P,
+    P, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+    W, W, W, W, W, W, W, W, W, W, W, P, P, P, P, W,
+    P, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+    W, W, W, W, W, W, W, W, W, W, W, P, P, P, P, P,
+    P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+    P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+    P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+    P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+    P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+    P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+    P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+    P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+};
+#undef S
+#undef W
+#undef P
+
+/** The word starts of one line */
+typedef struct CachedWords_s {
+    // NULL if the bitmap doesn't belong to a line
+    const Line *line;
+    // the text and length of the line when the bitmap was made, so it isn't
+    // trusted if the line changed without being forgotten
+    const char *text;
+    size_t len;
+    // bit i % BLOCK_LEN of block i / BLOCK_LEN is set if a word starts at byte i
+    uint64_t *starts;
+    size_t cap;
+} CachedWords;
+
+struct WordCache_s {
+    CachedWords lines[CACHED_LINES];
+};
+
+WordCache *create_word_cache(void) {
+    WordCache *cache = calloc(1, sizeof(WordCache));
+    if (cache == NULL) {
+        fprintf(stderr, "Error allocating space for word cache.\n");
+        exit(EXIT_FAILURE);
+    }
+    return cache;
+}
+
+void free_word_cache(WordCache *cache) {
+    for (size_t i = 0; i < CACHED_LINES; i++) {
+        free(cache->lines[i].starts);
+    }
+    free(cache);
+}
+
+CharClass get_char_class(char ch) {
+    return CHAR_CLASSES[(unsigned char) ch];
+}
+
+/**
+ * Finds which bytes of a block are word chars and which are whitespace.
+ *
+ * @param text the block
+ * @param len the length of the block. at most BLOCK_LEN.
+ * @param word set to a mask of the word chars
+ * @param space set to a mask of the whitespace
+ */
+static void classify_scalar(const char *text, size_t len, uint64_t *word, uint64_t *space) {
+    *word = 0;
+    *space = 0;
+    for (size_t i = 0; i < len; i++) {
+        CharClass class = CHAR_CLASSES[(unsigned char) text[i]];
+        *word |= (uint64_t) (class == CLASS_WORD) << i;
+        *space |= (uint64_t) (class == CLASS_SPACE) << i;
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+
+/** Compares every byte to a range with a signed compare, since there is no unsigned one. */
+static __m128i in_range(__m128i bytes, unsigned char lo, unsigned char hi) {
+    __m128i shifted = _mm_add_epi8(bytes, _mm_set1_epi8((char) (0x80 - lo)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8((char) (0x80 + hi - lo + 1)));
+}
+
+/** Classifies a whole block 16 bytes at a time. See classify_scalar. */
+static void classify_sse2(const char *text, uint64_t *word, uint64_t *space) {
+    *word = 0;
+    *space = 0;
+    for (size_t i = 0; i < BLOCK_LEN / 16; i++) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (text + i * 16));
+        __m128i lower = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+        __m128i is_word = _mm_or_si128(
+            _mm_or_si128(in_range(bytes, '0', '9'), in_range(lower, 'a', 'z')),
+            _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_')));
+        __m128i is_space = _mm_or_si128(in_range(bytes, '\t', '\r'), _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')));
+        *word |= (uint64_t) (uint16_t) _mm_movemask_epi8(is_word) << (i * 16);
+        *space |= (uint64_t) (uint16_t) _mm_movemask_epi8(is_space) << (i * 16);
+    }
+}
+
+#endif
+
+/**
+ * Makes the word start bitmap of some text.
+ *
+ * @param text the text of a line
+ * @param len the length of the text
+ * @param starts where to put a block of the bitmap for every BLOCK_LEN bytes
+ */
+static void find_starts(const char *text, size_t len, uint64_t *starts) {
+    // the byte before the line counts as whitespace
+    uint64_t carry_word = 0;
+    uint64_t carry_space = 1;
+    for (size_t off = 0; off < len; off += BLOCK_LEN) {
+        size_t block_len = len - off < BLOCK_LEN ? len - off : BLOCK_LEN;
+        uint64_t word;
+        uint64_t space;
+#ifdef HAVE_X86_SIMD
+        if (block_len == BLOCK_LEN) {
+            classify_sse2(text + off, &word, &space);
+        } else {
+            classify_scalar(text + off, block_len, &word, &space);
+        }
+#else
+        classify_scalar(text + off, block_len, &word, &space);
+#endif
+        uint64_t punct = ~word & ~space;
+        if (block_len < BLOCK_LEN) {
+            punct &= ((uint64_t) 1 << block_len) - 1;
+        }
+        // the class of the byte before each byte
+        uint64_t prev_word = (word << 1) | carry_word;
+        uint64_t prev_space = (space << 1) | carry_space;
+        uint64_t prev_punct = ~prev_word & ~prev_space;
+        starts[off / BLOCK_LEN] = (word & ~prev_word) | (punct & ~prev_punct);
+        carry_word = word >> (BLOCK_LEN - 1);
+        carry_space = space >> (BLOCK_LEN - 1);
+    }
+}
+
+/**
+ * Gets the word start bitmap of a line, making it if it isn't cached.
+ *
+ * @param fp the FileProxy the line is in
+ * @param line the line
+ * @param small where to make the bitmap of a line that fits in one block,
+ *     which is quicker to make again than to cache
+ * @return the bitmap
+ */
+static const uint64_t *get_starts(FileProxy fp, const Line *line, uint64_t *small) {
+    if (line->len <= BLOCK_LEN) {
+        find_starts(line->text, line->len, small);
+        return small;
+    }
+    CachedWords *cached = &fp.word_cache->lines[((uintptr_t) line / sizeof(Line)) % CACHED_LINES];
+    if (cached->line == line && cached->text == line->text && cached->len == line->len) {
+        return cached->starts;
+    }
+    size_t num_blocks = (line->len + BLOCK_LEN - 1) / BLOCK_LEN;
+    if (num_blocks > cached->cap) {
+        free(cached->starts);
+        cached->starts = malloc(num_blocks * sizeof(uint64_t));
+        if (cached->starts == NULL) {
+            fprintf(stderr, "Error allocating space for word starts.\n");
+            exit(EXIT_FAILURE);
+        }
+        cached->cap = num_blocks;
+    }
+    find_starts(line->text, line->len, cached->starts);
+    cached->line = line;
+    cached->text = line->text;
+    cached->len = line->len;
+    return cached->starts;
+}
+
+size_t find_next_word_start(FileProxy fp, Line *line, size_t beg, size_t *n) {
+    if (beg >= line->len) {
+        return SIZE_MAX;
+    }
+    uint64_t small;
+    const uint64_t *starts = get_starts(fp, line, &small);
+    size_t block = beg / BLOCK_LEN;
+    uint64_t bits = starts[block] & (~(uint64_t) 0 << (beg % BLOCK_LEN));
+    size_t num_blocks = (line->len + BLOCK_LEN - 1) / BLOCK_LEN;
+    while (true) {
+        size_t count = __builtin_popcountll(bits);
+        if (count >= *n) {
+            // drop the word starts before the nth
+            for (; *n > 1; (*n)--) {
+                bits &= bits - 1;
+            }
+            *n = 0;
+            return block * BLOCK_LEN + __builtin_ctzll(bits);
+        }
+        *n -= count;
+        if (++block == num_blocks) {
+            return SIZE_MAX;
+        }
+        bits = starts[block];
+    }
+}
+
+size_t find_prev_word_start(FileProxy fp, Line *line, size_t end, size_t *n) {
+    if (end > line->len) {
+        end = line->len;
+    }
+    if (end == 0) {
+        return SIZE_MAX;
+    }
+    uint64_t small;
+    const uint64_t *starts = get_starts(fp, line, &small);
+    size_t block = (end - 1) / BLOCK_LEN;
+    size_t end_bit = end - block * BLOCK_LEN;
+    uint64_t bits = starts[block];
+    if (end_bit < BLOCK_LEN) {
+        bits &= ((uint64_t) 1 << end_bit) - 1;
+    }
+    while (true) {
+        size_t count = __builtin_popcountll(bits);
+        if (count >= *n) {
+            // drop the word starts after the nth
+            for (; *n > 1; (*n)--) {
+                bits &= ~((uint64_t) 1 << (BLOCK_LEN - 1 - __builtin_clzll(bits)));
+            }
+            *n = 0;
+            return block * BLOCK_LEN + BLOCK_LEN - 1 - __builtin_clzll(bits);
+        }
+        *n -= count;
+        if (block-- == 0) {
+            return SIZE_MAX;
+        }
+        bits = starts[block];
+    }
+}
+
+void forget_words(FileProxy fp, Line *line) {
+    CachedWords *cached = &fp.word_cache->lines[((uintptr_t) line / sizeof(Line)) % CACHED_LINES];
+    if (cached->line == line) {
+        cached->line = NULL;
+    }
+}
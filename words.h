@@ -0,0 +1,75 @@
+/**
+ * @file words.h
+ * @author Willow Rimlinger
+ *
+ * Header for words.c
+ *
+ * Finds where words start in the lines of a FileProxy for the w and b motions.
+ * A word starts at a byte that isn't whitespace and isn't the same CharClass as
+ * the byte before it, or at the first byte of a line that isn't whitespace.
+ */
+
+#ifndef WORDS_H
+#define WORDS_H
+
+#include <stdlib.h>
+
+#include "types.h"
+
+/**
+ * Creates a cache for the word starts of the lines of a FileProxy.
+ *
+ * @return the new cache
+ */
+WordCache *create_word_cache(void);
+
+/**
+ * Frees a cache made by create_word_cache.
+ *
+ * @param cache the cache to free
+ */
+void free_word_cache(WordCache *cache);
+
+/**
+ * Gets the class of a byte. Bytes of chars outside of ASCII are punctuation.
+ *
+ * @param ch the byte
+ * @return its class
+ */
+CharClass get_char_class(char ch);
+
+/**
+ * Finds the nth word start at or after a position in a line.
+ *
+ * @param fp the FileProxy the line is in
+ * @param line the line
+ * @param beg the first position to look at
+ * @param n the number of word starts to go over, the last of which is returned.
+ *     reduced by the number of word starts gone over.
+ * @return the position of the nth word start, or SIZE_MAX if the line runs out
+ *     first
+ */
+size_t find_next_word_start(FileProxy fp, Line *line, size_t beg, size_t *n);
+
+/**
+ * Finds the nth word start before a position in a line, going backward.
+ *
+ * @param fp the FileProxy the line is in
+ * @param line the line
+ * @param end one past the last position to look at. may be SIZE_MAX.
+ * @param n the number of word starts to go over, the last of which is returned.
+ *     reduced by the number of word starts gone over.
+ * @return the position of the nth word start, or SIZE_MAX if the start of the
+ *     line is reached first
+ */
+size_t find_prev_word_start(FileProxy fp, Line *line, size_t end, size_t *n);
+
+/**
+ * Forgets the word starts of a line because it changed or is being freed.
+ *
+ * @param fp the FileProxy the line is in
+ * @param line the line
+ */
+void forget_words(FileProxy fp, Line *line);
+
+#endif